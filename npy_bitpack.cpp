@@ -0,0 +1,295 @@
+#include "npy_bitpack.hpp"
+
+#include <array>
+#include <fcntl.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+    constexpr char bp_magic[8] = {'N', 'P', 'Y', 'F', 'O', 'R', 'B', 'P'};
+    constexpr uint32_t bp_version = 1;
+
+    // 64 values at width W occupy exactly W words; with W and i compile-time constants after unrolling, every
+    // shift and word index is fixed
+    template<unsigned W>
+    void pack_group(const uint64_t* in, uint64_t* out)
+    {
+        for (unsigned w = 0; w < W; ++w)
+            out[w] = 0;
+#pragma GCC unroll 64
+        for (unsigned i = 0; i < 64; ++i) {
+            const unsigned bit = i * W, w = bit >> 6, off = bit & 63;
+            out[w] |= in[i] << off;
+            if (off + W > 64)
+                out[w + 1] |= in[i] >> (64 - off);
+        }
+    }
+
+    template<unsigned W>
+    void unpack_group(const uint64_t* in, const uint64_t base, uint64_t* out)
+    {
+        constexpr uint64_t mask = W == 64 ? ~uint64_t{0} : (uint64_t{1} << W) - 1;
+#pragma GCC unroll 64
+        for (unsigned i = 0; i < 64; ++i) {
+            const unsigned bit = i * W, w = bit >> 6, off = bit & 63;
+            uint64_t v = in[w] >> off;
+            if (off + W > 64)
+                v |= in[w + 1] << (64 - off);
+            out[i] = base + (v & mask);
+        }
+    }
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    // AVX2 unpack for widths up to 32, four values at once. A value of at most 32 bits always lies within two
+    // consecutive 32-bit words, so one vpermd moves the word pair of each value into its 64-bit lane and one
+    // vpsrlvq shifts it into place. The eight-word windows are loaded masked where they would run past the
+    // group's 2W words, so nothing beyond the packed data is touched.
+    template<unsigned W>
+    __attribute__((target("avx2"))) void unpack_group_avx2(const uint64_t* in, const uint64_t base, uint64_t* out)
+    {
+        static_assert(W > 0 && W <= 32, "unpack_group_avx2: widths 1..32");
+        constexpr uint64_t mask = (uint64_t{1} << W) - 1;
+        const auto in32 = reinterpret_cast<const int*>(in);
+        const __m256i vmask = _mm256_set1_epi64x(static_cast<long long>(mask));
+        const __m256i vbase = _mm256_set1_epi64x(static_cast<long long>(base));
+#pragma GCC unroll 16
+        for (unsigned q = 0; q < 16; ++q) {
+            const unsigned first = q * 4 * W / 32;
+            const auto word = [&](const unsigned k) { return static_cast<int>(((q * 4 + k) * W >> 5) - first); };
+            const auto off = [&](const unsigned k) { return static_cast<long long>((q * 4 + k) * W & 31); };
+            const auto valid = [&](const unsigned j) { return first + j < 2 * W ? -1 : 0; };
+            const __m256i window =
+                first + 8 <= 2 * W
+                    ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in32 + first))
+                    : _mm256_maskload_epi32(in32 + first, _mm256_setr_epi32(valid(0), valid(1), valid(2), valid(3),
+                                                                            valid(4), valid(5), valid(6), valid(7)));
+            const __m256i pairs = _mm256_permutevar8x32_epi32(
+                window, _mm256_setr_epi32(word(0), word(0) + 1, word(1), word(1) + 1, word(2), word(2) + 1, word(3),
+                                          word(3) + 1));
+            const __m256i v = _mm256_srlv_epi64(pairs, _mm256_setr_epi64x(off(0), off(1), off(2), off(3)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + q * 4),
+                                _mm256_add_epi64(_mm256_and_si256(v, vmask), vbase));
+        }
+    }
+#endif
+
+    template<>
+    void pack_group<0>(const uint64_t*, uint64_t*)
+    {}
+
+    template<>
+    void unpack_group<0>(const uint64_t*, const uint64_t base, uint64_t* out)
+    {
+        std::fill(out, out + 64, base);
+    }
+
+    using PackFn = void (*)(const uint64_t*, uint64_t*);
+    using UnpackFn = void (*)(const uint64_t*, uint64_t, uint64_t*);
+
+    template<size_t... W>
+    constexpr std::array<PackFn, sizeof...(W)> pack_table(std::index_sequence<W...>)
+    {
+        return {{&pack_group<W>...}};
+    }
+
+    template<size_t... W>
+    constexpr std::array<UnpackFn, sizeof...(W)> unpack_table(std::index_sequence<W...>)
+    {
+        return {{&unpack_group<W>...}};
+    }
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    // Widths 1..32 take the AVX2 kernel, the others keep the scalar one
+    template<size_t... W>
+    constexpr std::array<UnpackFn, sizeof...(W)> unpack_table_avx2(std::index_sequence<W...>)
+    {
+        return {{(W >= 1 && W <= 32 ? &unpack_group_avx2<(W >= 1 && W <= 32 ? W : 1)> : &unpack_group<W>)...}};
+    }
+
+    bool has_avx2() { return __builtin_cpu_supports("avx2"); }
+#else
+    template<size_t... W>
+    constexpr std::array<UnpackFn, sizeof...(W)> unpack_table_avx2(std::index_sequence<W...> w)
+    {
+        return unpack_table(w);
+    }
+
+    bool has_avx2() { return false; }
+#endif
+
+    const std::array<PackFn, 65> pack_fns = pack_table(std::make_index_sequence<65>());
+    // Chosen once at load time from what the running CPU supports
+    const std::array<UnpackFn, 65> unpack_fns = has_avx2() ? unpack_table_avx2(std::make_index_sequence<65>())
+                                                           : unpack_table(std::make_index_sequence<65>());
+
+    template<typename V>
+    void put(std::vector<char>& out, const V v)
+    {
+        const size_t at = out.size();
+        out.resize(at + sizeof(V));
+        std::memcpy(&out[at], &v, sizeof(V));
+    }
+
+} // namespace
+
+void npy::_pack_block(const uint64_t* offsets, const size_t n, const unsigned width, uint64_t* words)
+{
+    const PackFn pack = pack_fns.at(width);
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64, words += width)
+        pack(offsets + i, words);
+    if (i < n) {
+        uint64_t tail[64] = {};
+        std::copy(offsets + i, offsets + n, tail);
+        pack(tail, words);
+    }
+}
+
+void npy::_unpack_block(const uint64_t* words, const size_t n, const unsigned width, const uint64_t base,
+                        uint64_t* values)
+{
+    const UnpackFn unpack = unpack_fns.at(width);
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64, words += width)
+        unpack(words, base, values + i);
+    if (i < n) {
+        uint64_t tail[64];
+        unpack(words, base, tail);
+        std::copy(tail, tail + (n - i), values + i);
+    }
+}
+
+void npy::_write_bitpacked(const std::string& fname, const std::string& descr, const bool fortran_order,
+                           const std::vector<size_t>& shape, const size_t block_len,
+                           const std::vector<uint64_t>& bases, const std::vector<uint8_t>& widths,
+                           const std::vector<std::vector<uint64_t>>& blocks)
+{
+    std::vector<char> header(bp_magic, bp_magic + sizeof(bp_magic));
+    put<uint32_t>(header, bp_version);
+    char d[4] = {};
+    std::memcpy(d, descr.data(), std::min<size_t>(descr.size(), sizeof(d)));
+    header.insert(header.end(), d, d + sizeof(d));
+    put<uint32_t>(header, fortran_order ? 1 : 0);
+    put<uint32_t>(header, static_cast<uint32_t>(shape.size()));
+    for (const size_t s: shape)
+        put<uint64_t>(header, s);
+    put<uint64_t>(header, block_len);
+    put<uint64_t>(header, bases.size());
+    for (const uint64_t b: bases)
+        put<uint64_t>(header, b);
+    uint64_t end = 0;
+    for (const auto& b: blocks)
+        put<uint64_t>(header, end += b.size());
+    header.insert(header.end(), widths.begin(), widths.end());
+    header.resize((header.size() + 7) / 8 * 8, 0);
+
+    const file_ptr fp = _open_file(fname, "wb");
+    if (!fp)
+        throw std::runtime_error("_write_bitpacked: Unable to open file " + fname);
+    if (fwrite(header.data(), 1, header.size(), fp.get()) != header.size())
+        throw std::runtime_error("_write_bitpacked: failed fwrite on " + fname);
+    for (const auto& b: blocks)
+        if (fwrite(b.data(), sizeof(uint64_t), b.size(), fp.get()) != b.size())
+            throw std::runtime_error("_write_bitpacked: failed fwrite on " + fname);
+}
+
+void npy::compress_npy_bitpacked(const std::string& in_file, const std::string& out_file, const BitPackOptions& opt)
+{
+    const MappedNpy src(in_file);
+    const std::string& d = src.header().descr;
+    const auto save = [&](const auto* data) { save_bitpacked(out_file, data, src.shape(), src.fortran_order(), opt); };
+    if (d == _npy_descr<int8_t>())
+        save(src.data<int8_t>());
+    else if (d == _npy_descr<int16_t>())
+        save(src.data<int16_t>());
+    else if (d == _npy_descr<int32_t>())
+        save(src.data<int32_t>());
+    else if (d == _npy_descr<int64_t>())
+        save(src.data<int64_t>());
+    else if (d == _npy_descr<uint8_t>())
+        save(src.data<uint8_t>());
+    else if (d == _npy_descr<uint16_t>())
+        save(src.data<uint16_t>());
+    else if (d == _npy_descr<uint32_t>())
+        save(src.data<uint32_t>());
+    else if (d == _npy_descr<uint64_t>())
+        save(src.data<uint64_t>());
+    else
+        throw std::runtime_error("compress_npy_bitpacked: only integer arrays, got " + d);
+}
+
+npy::BitPackedReader::BitPackedReader(const std::string& fname) : filename(fname)
+{
+    const int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("BitPackedReader: Unable to open file " + fname);
+    struct stat st{};
+    const bool ok = fstat(fd, &st) == 0;
+    const auto file_size = static_cast<size_t>(st.st_size);
+    void* base = ok && file_size > 0 ? mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (base == MAP_FAILED)
+        throw std::runtime_error("BitPackedReader: failed mmap on " + fname);
+    region = std::shared_ptr<void>(base, [file_size](void* p) { munmap(p, file_size); });
+
+    const auto p = static_cast<const char*>(base);
+    size_t pos = 0;
+    const auto need = [&](const size_t n) {
+        if (pos + n > file_size)
+            throw std::runtime_error("BitPackedReader: truncated file " + fname);
+    };
+    const auto u32 = [&]() {
+        need(4);
+        uint32_t v;
+        std::memcpy(&v, p + pos, 4);
+        pos += 4;
+        return v;
+    };
+    const auto u64 = [&]() {
+        need(8);
+        uint64_t v;
+        std::memcpy(&v, p + pos, 8);
+        pos += 8;
+        return v;
+    };
+
+    need(sizeof(bp_magic));
+    if (std::memcmp(p, bp_magic, sizeof(bp_magic)) != 0)
+        throw std::runtime_error("BitPackedReader: " + fname + " is not a bit-packed npy file");
+    pos = sizeof(bp_magic);
+    if (u32() != bp_version)
+        throw std::runtime_error("BitPackedReader: unsupported version in " + fname);
+    need(4);
+    dtype = std::string(p + pos, strnlen(p + pos, 4));
+    pos += 4;
+    fortran = u32() != 0;
+    dims.resize(u32());
+    n_values = 1;
+    for (size_t& s: dims) {
+        s = u64();
+        n_values *= s;
+    }
+    blk_len = u64();
+    n_blocks = u64();
+    if (blk_len == 0 || blk_len % 64 != 0 || n_blocks != (n_values + blk_len - 1) / blk_len)
+        throw std::runtime_error("BitPackedReader: corrupt header in " + fname);
+
+    need(n_blocks * 17);
+    bases = reinterpret_cast<const uint64_t*>(p + pos);
+    word_end = bases + n_blocks;
+    widths = reinterpret_cast<const uint8_t*>(word_end + n_blocks);
+    pos += n_blocks * 16 + (n_blocks + 7) / 8 * 8;
+    words = reinterpret_cast<const uint64_t*>(p + pos);
+    for (size_t b = 0; b < n_blocks; ++b) {
+        const size_t len = std::min(blk_len, n_values - b * blk_len);
+        if (widths[b] > 64 || (b == 0 ? 0 : word_end[b - 1]) + _packed_words(len, widths[b]) != word_end[b])
+            throw std::runtime_error("BitPackedReader: corrupt block index in " + fname);
+    }
+    need(n_blocks == 0 ? 0 : word_end[n_blocks - 1] * 8);
+}
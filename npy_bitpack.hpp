@@ -0,0 +1,224 @@
+#ifndef NPY_BITPACK_H_
+#define NPY_BITPACK_H_
+
+#include "npy_mmap.hpp"
+#include "npy_parallel.hpp"
+
+#include <cstring>
+#include <type_traits>
+
+namespace npy {
+
+    // Lossless frame-of-reference container for integer arrays of any shape:
+    //   "NPYFORBP" | u32 version | char descr[4] | u32 fortran_order | u32 ndim | u64 shape[ndim] |
+    //   u64 block_len | u64 n_blocks | u64 base[n_blocks] | u64 word_end[n_blocks] | u8 width[n_blocks] (padded
+    //   to 8 bytes) | u64 words[]
+    // Values are taken in storage order and cut into blocks of block_len (a multiple of 64). Each block stores
+    // its minimum and the offsets from it packed at the smallest bit width that holds the block's range,
+    // 64 values per `width` words, so every block can be decoded on its own.
+    struct BitPackOptions {
+        size_t block_len = 1024;
+        size_t n_threads = 0;
+    };
+
+    // Pack n offsets (n <= block_len, a partial last group is zero padded) at the given width into
+    // ceil(n / 64) * width words, and unpack them again adding base. Every width has its own fully unrolled
+    // routine with compile-time shifts and masks. On x86-64 CPUs with AVX2 (checked once at load time)
+    // widths 1..32 unpack four values per instruction with per-lane shifts; other widths and other CPUs use
+    // the scalar routines, which SSE2 cannot improve on as it has no per-lane variable shifts.
+    void _pack_block(const uint64_t* offsets, size_t n, unsigned width, uint64_t* words);
+    void _unpack_block(const uint64_t* words, size_t n, unsigned width, uint64_t base, uint64_t* values);
+
+    inline size_t _packed_words(const size_t n, const unsigned width) { return (n + 63) / 64 * width; }
+
+    // Smallest width that holds the largest offset
+    inline unsigned _bit_width(const uint64_t max_offset)
+    {
+        return max_offset == 0 ? 0 : 64 - static_cast<unsigned>(__builtin_clzll(max_offset));
+    }
+
+    void _write_bitpacked(const std::string& fname, const std::string& descr, bool fortran_order,
+                          const std::vector<size_t>& shape, size_t block_len, const std::vector<uint64_t>& bases,
+                          const std::vector<uint8_t>& widths, const std::vector<std::vector<uint64_t>>& blocks);
+
+    // Compress num_vals(shape) integers stored at data (C order, or Fortran when fortran_order is set);
+    // blocks are packed in parallel
+    template<typename T>
+    void save_bitpacked(const std::string& fname, const T* data, const std::vector<size_t>& shape,
+                        const bool fortran_order = false, const BitPackOptions& opt = BitPackOptions())
+    {
+        static_assert(std::is_integral<T>::value, "save_bitpacked: only integer arrays");
+        if (opt.block_len == 0 || opt.block_len % 64 != 0)
+            throw std::runtime_error("save_bitpacked: block_len must be a positive multiple of 64");
+        size_t n = 1;
+        for (const size_t s: shape)
+            n *= s;
+        const size_t nb = (n + opt.block_len - 1) / opt.block_len;
+        std::vector<uint64_t> bases(nb);
+        std::vector<uint8_t> widths(nb);
+        std::vector<std::vector<uint64_t>> blocks(nb);
+        parallel_for(nb, opt.n_threads, [&](const size_t b) {
+            const T* x = data + b * opt.block_len;
+            const size_t len = std::min(opt.block_len, n - b * opt.block_len);
+            const T lo = *std::min_element(x, x + len);
+            const T hi = *std::max_element(x, x + len);
+            // Offsets in modular 64-bit arithmetic, so signed and unsigned types share one code path
+            std::vector<uint64_t> offsets(len);
+            for (size_t i = 0; i < len; ++i)
+                offsets[i] = static_cast<uint64_t>(x[i]) - static_cast<uint64_t>(lo);
+            const unsigned width = _bit_width(static_cast<uint64_t>(hi) - static_cast<uint64_t>(lo));
+            bases[b] = static_cast<uint64_t>(lo);
+            widths[b] = static_cast<uint8_t>(width);
+            blocks[b].resize(_packed_words(len, width));
+            _pack_block(offsets.data(), len, width, blocks[b].data());
+        });
+        _write_bitpacked(fname, _npy_descr<T>(), fortran_order, shape, opt.block_len, bases, widths, blocks);
+    }
+
+    template<typename T, int ORDER>
+    void save_bitpacked(const std::string& fname, const Eigen::Matrix<T, -1, -1, ORDER>& mat,
+                        const BitPackOptions& opt = BitPackOptions())
+    {
+        save_bitpacked(fname, mat.data(), {static_cast<size_t>(mat.rows()), static_cast<size_t>(mat.cols())},
+                       ORDER == Eigen::ColMajor, opt);
+    }
+
+    // Compress an integer npy file of any shape and order
+    void compress_npy_bitpacked(const std::string& in_file, const std::string& out_file,
+                                const BitPackOptions& opt = BitPackOptions());
+
+    // Memory-mapped access to a bit-packed file: any block, value or value range decodes independently
+    class BitPackedReader {
+    public:
+        explicit BitPackedReader(const std::string& fname);
+
+        [[nodiscard]] const std::string& descr() const { return dtype; }
+        [[nodiscard]] const std::vector<size_t>& shape() const { return dims; }
+        [[nodiscard]] bool fortran_order() const { return fortran; }
+        [[nodiscard]] size_t num_vals() const { return n_values; }
+        [[nodiscard]] size_t block_len() const { return blk_len; }
+        [[nodiscard]] size_t num_blocks() const { return n_blocks; }
+        [[nodiscard]] unsigned width(const size_t b) const { return widths[b]; }
+
+        // Decode block b into out (block_len values, fewer for the last block)
+        template<typename T>
+        void read_block(const size_t b, T* out) const
+        {
+            check_type<T>();
+            const size_t len = std::min(blk_len, n_values - b * blk_len);
+            if (std::is_same<T, uint64_t>::value || std::is_same<T, int64_t>::value) {
+                _unpack_block(block_words(b), len, widths[b], bases[b], reinterpret_cast<uint64_t*>(out));
+            } else {
+                std::vector<uint64_t> values(len);
+                _unpack_block(block_words(b), len, widths[b], bases[b], values.data());
+                for (size_t i = 0; i < len; ++i)
+                    out[i] = static_cast<T>(values[i]);
+            }
+        }
+
+        // Value i in storage order, extracted straight from its block without unpacking the rest
+        template<typename T>
+        T at(const size_t i) const
+        {
+            check_type<T>();
+            if (i >= n_values)
+                throw std::runtime_error("BitPackedReader: index out of range in " + filename);
+            const size_t b = i / blk_len;
+            const unsigned w = widths[b];
+            if (w == 0)
+                return static_cast<T>(bases[b]);
+            const uint64_t* words = block_words(b);
+            const size_t bit = (i % blk_len) * w;
+            const unsigned off = bit & 63;
+            uint64_t v = words[bit >> 6] >> off;
+            if (off + w > 64)
+                v |= words[(bit >> 6) + 1] << (64 - off);
+            if (w < 64)
+                v &= (uint64_t{1} << w) - 1;
+            return static_cast<T>(bases[b] + v);
+        }
+
+        // Values [begin, begin + n) in storage order, blocks decoded in parallel
+        template<typename T>
+        void read_range(const size_t begin, const size_t n, T* out, const size_t n_threads = 0) const
+        {
+            check_type<T>();
+            if (begin + n > n_values)
+                throw std::runtime_error("BitPackedReader: range out of bounds in " + filename);
+            if (n == 0)
+                return;
+            const size_t b0 = begin / blk_len, b1 = (begin + n - 1) / blk_len + 1;
+            parallel_for(b1 - b0, n_threads, [&](const size_t t) {
+                const size_t b = b0 + t;
+                const size_t lo = std::max(begin, b * blk_len);
+                const size_t hi = std::min(begin + n, std::min(n_values, (b + 1) * blk_len));
+                if (lo == b * blk_len && hi == std::min(n_values, (b + 1) * blk_len)) { // whole block in place
+                    read_block(b, out + (lo - begin));
+                } else {
+                    std::vector<T> values(std::min(blk_len, n_values - b * blk_len));
+                    read_block(b, values.data());
+                    std::memcpy(out + (lo - begin), values.data() + (lo - b * blk_len), (hi - lo) * sizeof(T));
+                }
+            });
+        }
+
+        // Decode a 2D array into an Eigen matrix; when ORDER matches the stored order blocks are unpacked
+        // directly into the matrix, otherwise Eigen converts once after decoding
+        template<typename T, int ORDER = Eigen::RowMajor>
+        auto load_mat(const size_t n_threads = 0) const -> Eigen::Matrix<T, -1, -1, ORDER>
+        {
+            if (dims.size() != 2)
+                throw std::runtime_error("BitPackedReader: Only 2D arrays can be converted to Eigen matrices.");
+            const auto rows = static_cast<Eigen::Index>(dims[0]);
+            const auto cols = static_cast<Eigen::Index>(dims[1]);
+            if (fortran == (ORDER == Eigen::ColMajor)) {
+                Eigen::Matrix<T, -1, -1, ORDER> m(rows, cols);
+                read_range(0, n_values, m.data(), n_threads);
+                return m;
+            }
+            if (fortran) {
+                Eigen::Matrix<T, -1, -1, Eigen::ColMajor> m(rows, cols);
+                read_range(0, n_values, m.data(), n_threads);
+                return m;
+            }
+            Eigen::Matrix<T, -1, -1, Eigen::RowMajor> m(rows, cols);
+            read_range(0, n_values, m.data(), n_threads);
+            return m;
+        }
+
+    private:
+        template<typename T>
+        void check_type() const
+        {
+            if (dtype != _npy_descr<T>())
+                throw std::runtime_error("BitPackedReader: " + filename + " holds " + dtype);
+        }
+
+        [[nodiscard]] const uint64_t* block_words(const size_t b) const
+        {
+            return words + (b == 0 ? 0 : word_end[b - 1]);
+        }
+
+        std::string filename;
+        std::string dtype;
+        std::vector<size_t> dims;
+        bool fortran = false;
+        size_t n_values = 0;
+        size_t blk_len = 0;
+        size_t n_blocks = 0;
+        std::shared_ptr<void> region;
+        const uint64_t* bases = nullptr;
+        const uint64_t* word_end = nullptr;
+        const uint8_t* widths = nullptr;
+        const uint64_t* words = nullptr;
+    };
+
+    template<typename T, int ORDER = Eigen::RowMajor>
+    auto load_bitpacked_mat(const std::string& fname, const size_t n_threads = 0) -> Eigen::Matrix<T, -1, -1, ORDER>
+    {
+        return BitPackedReader(fname).load_mat<T, ORDER>(n_threads);
+    }
+
+} // namespace npy
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef NPY_CHUNKS_H_
+#define NPY_CHUNKS_H_
+
+#include "npy_mmap.hpp"
+#include "npy_parallel.hpp"
+#include "npy_virtual.hpp"
+
+namespace npy {
+
+    template<typename T>
+    using RowBlock = Eigen::Map<const Eigen::Matrix<T, -1, -1, Eigen::RowMajor>>;
+    template<typename T>
+    using ColBlock = Eigen::Map<const Eigen::Matrix<T, -1, -1, Eigen::ColMajor>>;
+    // A range of rows of a Fortran-order array: column-major with the full column length as outer stride
+    template<typename T>
+    using StridedRowBlock = Eigen::Map<const Eigen::Matrix<T, -1, -1, Eigen::ColMajor>, 0, Eigen::OuterStride<>>;
+
+    // Call f(worker, offset, block) for every chunk of a mapped 2D array from n_threads threads (0 = hardware
+    // concurrency); worker < num_workers(n_chunks, n_threads) identifies the calling thread for per-thread state
+    // (sizing that state by _resolve_threads(n_threads) is always enough).
+    // C-order arrays are cut into row blocks of chunk_rows rows (a RowBlock<T>, offset = first row),
+    // Fortran-order arrays into column blocks of chunk_rows columns by the full height of the array (a
+    // ColBlock<T>, offset = first column), so every block is contiguous and zero-copy; f must accept both,
+    // e.g. a generic lambda. A Fortran block's size grows with the row count, so kernels that copy or convert
+    // it should walk each column in row-bounded pieces.
+    // While a worker runs f it asks the kernel to prefetch the chunk it will most likely take next.
+    template<typename T, typename F>
+    void for_each_chunk_worker(const MappedNpy& arr, const size_t chunk_rows, F&& f, const size_t n_threads = 0)
+    {
+        if (arr.shape().size() != 2)
+            throw std::runtime_error("for_each_chunk: Only 2D arrays are supported");
+        if (arr.word_size() != sizeof(T))
+            throw std::runtime_error("for_each_chunk: word size does not match the requested type");
+        if (chunk_rows == 0)
+            throw std::runtime_error("for_each_chunk: chunk_rows must be positive");
+
+        const size_t rows = arr.shape()[0];
+        const size_t cols = arr.shape()[1];
+        const bool fortran = arr.fortran_order();
+        // Contiguous extent being chunked and the number of elements per unit of it
+        const size_t extent = fortran ? cols : rows;
+        const size_t stride = fortran ? rows : cols;
+        const size_t n_chunks = (extent + chunk_rows - 1) / chunk_rows;
+        const size_t workers = num_workers(n_chunks, n_threads);
+        const size_t chunk_bytes = chunk_rows * stride * sizeof(T);
+
+        parallel_for_worker(n_chunks, n_threads, [&](const size_t worker, const size_t c) {
+            arr.prefetch((c + workers) * chunk_bytes, chunk_bytes);
+            const size_t begin = c * chunk_rows;
+            const size_t n = std::min(chunk_rows, extent - begin);
+            const T* p = arr.data<T>() + begin * stride;
+            if (fortran)
+                f(worker, begin, ColBlock<T>(p, rows, n));
+            else
+                f(worker, begin, RowBlock<T>(p, n, cols));
+        });
+    }
+
+    // Row blocks of a VirtualArray; blocks crossing a shard boundary are assembled in a per-thread buffer
+    template<typename T, typename F>
+    void for_each_chunk_worker(const VirtualArray& arr, const size_t chunk_rows, F&& f, const size_t n_threads = 0)
+    {
+        if (chunk_rows == 0)
+            throw std::runtime_error("for_each_chunk: chunk_rows must be positive");
+
+        const size_t n_chunks = (arr.rows() + chunk_rows - 1) / chunk_rows;
+        std::vector<std::vector<T>> scratch(num_workers(n_chunks, n_threads));
+        parallel_for_worker(n_chunks, n_threads, [&](const size_t worker, const size_t c) {
+            const size_t begin = c * chunk_rows;
+            f(worker, begin, arr.rows<T>(begin, std::min(chunk_rows, arr.rows() - begin), scratch[worker]));
+        });
+    }
+
+    // Sources the chunk visitors accept directly; anything else (file names) goes through an overload
+    template<typename S>
+    using _is_chunk_source =
+            std::integral_constant<bool, std::is_same<S, MappedNpy>::value || std::is_same<S, VirtualArray>::value>;
+
+    // Same as for_each_chunk_worker without the worker index: f(offset, block)
+    template<typename T, typename Source, typename F, typename = std::enable_if_t<_is_chunk_source<Source>::value>>
+    void for_each_chunk(const Source& src, const size_t chunk_rows, F&& f, const size_t n_threads = 0)
+    {
+        for_each_chunk_worker<T>(
+                src, chunk_rows, [&f](size_t, const size_t offset, const auto& block) { f(offset, block); }, n_threads);
+    }
+
+    template<typename T, typename F>
+    void for_each_chunk(const std::string& fname, const size_t chunk_rows, F&& f, const size_t n_threads = 0)
+    {
+        for_each_chunk<T>(MappedNpy(fname), chunk_rows, std::forward<F>(f), n_threads);
+    }
+
+    // Like for_each_chunk_worker, but always hands out blocks of whole rows with offset = first row: a
+    // RowBlock<T> for C-order arrays and a StridedRowBlock<T> for Fortran-order arrays. Use this for kernels
+    // that need complete rows (filters, joins, row hashing) regardless of the storage order.
+    template<typename T, typename F>
+    void for_each_row_chunk_worker(const MappedNpy& arr, const size_t chunk_rows, F&& f, const size_t n_threads = 0)
+    {
+        if (!arr.fortran_order()) {
+            for_each_chunk_worker<T>(arr, chunk_rows, std::forward<F>(f), n_threads);
+            return;
+        }
+        if (arr.shape().size() != 2)
+            throw std::runtime_error("for_each_row_chunk: Only 2D arrays are supported");
+        if (arr.word_size() != sizeof(T))
+            throw std::runtime_error("for_each_row_chunk: word size does not match the requested type");
+        if (chunk_rows == 0)
+            throw std::runtime_error("for_each_row_chunk: chunk_rows must be positive");
+
+        const size_t rows = arr.shape()[0];
+        const size_t cols = arr.shape()[1];
+        const size_t n_chunks = (rows + chunk_rows - 1) / chunk_rows;
+        parallel_for_worker(n_chunks, n_threads, [&](const size_t worker, const size_t c) {
+            const size_t begin = c * chunk_rows;
+            const size_t n = std::min(chunk_rows, rows - begin);
+            f(worker, begin,
+              StridedRowBlock<T>(arr.data<T>() + begin, n, cols, Eigen::OuterStride<>(static_cast<Eigen::Index>(rows))));
+        });
+    }
+
+    template<typename T, typename F>
+    void for_each_row_chunk_worker(const VirtualArray& arr, const size_t chunk_rows, F&& f, const size_t n_threads = 0)
+    {
+        for_each_chunk_worker<T>(arr, chunk_rows, std::forward<F>(f), n_threads);
+    }
+
+    template<typename T, typename Source, typename F, typename = std::enable_if_t<_is_chunk_source<Source>::value>>
+    void for_each_row_chunk(const Source& src, const size_t chunk_rows, F&& f, const size_t n_threads = 0)
+    {
+        for_each_row_chunk_worker<T>(
+                src, chunk_rows, [&f](size_t, const size_t offset, const auto& block) { f(offset, block); }, n_threads);
+    }
+
+    inline size_t _num_cols(const MappedNpy& arr) { return arr.shape().size() == 2 ? arr.shape()[1] : 0; }
+    inline size_t _num_cols(const VirtualArray& arr) { return arr.num_cols(); }
+    inline size_t _num_rows(const MappedNpy& arr) { return arr.shape().empty() ? 0 : arr.shape()[0]; }
+    inline size_t _num_rows(const VirtualArray& arr) { return arr.rows(); }
+
+    // Map every chunk to a result with map_fn(offset, block) in parallel and fold the results in chunk order
+    // with reduce_fn(acc, result) starting from init, so the outcome does not depend on thread scheduling.
+    // Results are folded as soon as every earlier chunk has been folded; only those finished ahead of an
+    // earlier chunk are held meanwhile. src is a MappedNpy, a VirtualArray or a file name.
+    template<typename T, typename R, typename Source, typename MapFn, typename ReduceFn>
+    auto map_reduce_chunks(const Source& src, const size_t chunk_rows, MapFn&& map_fn, ReduceFn&& reduce_fn, R init,
+                           const size_t n_threads = 0) -> R
+    {
+        std::map<size_t, R> pending;
+        size_t next = 0;
+        bool folding = false;
+        std::mutex mutex;
+        for_each_chunk<T>(
+                src, chunk_rows,
+                [&](const size_t offset, const auto& block) {
+                    R r = map_fn(offset, block);
+                    std::unique_lock<std::mutex> lock(mutex);
+                    pending.emplace(offset / chunk_rows, std::move(r));
+                    // One thread folds at a time, outside the lock; the others only hand over their results
+                    if (folding)
+                        return;
+                    folding = true;
+                    for (auto it = pending.find(next); it != pending.end(); it = pending.find(next)) {
+                        R ready = std::move(it->second);
+                        pending.erase(it);
+                        ++next;
+                        lock.unlock();
+                        init = reduce_fn(std::move(init), std::move(ready));
+                        lock.lock();
+                    }
+                    folding = false;
+                },
+                n_threads);
+        return init;
+    }
+
+} // namespace npy
+
+#endif
@@ -0,0 +1,232 @@
+#include "npy_concurrent.hpp"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace {
+
+    struct RowCounters {
+        uint64_t reserved;
+        uint64_t committed;
+        uint64_t n_ranges;
+    };
+
+    // One reserve() call; the sidecar stores them after the counters in reservation (= start row) order
+    struct RowRange {
+        uint64_t start;
+        uint64_t n_rows;
+        uint64_t state;
+    };
+
+    enum : uint64_t { range_free = 0, range_writing = 1, range_committed = 2 };
+
+    auto sidecar_name(const std::string& fname) -> std::string { return fname + ".rows"; }
+
+    // Holds an exclusive advisory lock on the sidecar for the lifetime of the object
+    struct SidecarLock {
+        explicit SidecarLock(const int fd) : fd(fd)
+        {
+            if (flock(fd, LOCK_EX) != 0)
+                throw std::runtime_error("ConcurrentAppender: failed to lock sidecar");
+        }
+        ~SidecarLock() { flock(fd, LOCK_UN); }
+        int fd;
+    };
+
+    auto read_counters(const int fd) -> RowCounters
+    {
+        RowCounters c{};
+        if (pread(fd, &c, sizeof(c), 0) != static_cast<ssize_t>(sizeof(c)))
+            throw std::runtime_error("ConcurrentAppender: failed to read sidecar counters");
+        return c;
+    }
+
+    void write_counters(const int fd, const RowCounters& c)
+    {
+        if (pwrite(fd, &c, sizeof(c), 0) != static_cast<ssize_t>(sizeof(c)))
+            throw std::runtime_error("ConcurrentAppender: failed to write sidecar counters");
+    }
+
+    auto range_offset(const size_t i) -> off_t { return static_cast<off_t>(sizeof(RowCounters) + i * sizeof(RowRange)); }
+
+    auto read_range(const int fd, const size_t i) -> RowRange
+    {
+        RowRange r{};
+        if (pread(fd, &r, sizeof(r), range_offset(i)) != static_cast<ssize_t>(sizeof(r)))
+            throw std::runtime_error("ConcurrentAppender: failed to read sidecar range");
+        return r;
+    }
+
+    void write_range(const int fd, const size_t i, const RowRange& r)
+    {
+        if (pwrite(fd, &r, sizeof(r), range_offset(i)) != static_cast<ssize_t>(sizeof(r)))
+            throw std::runtime_error("ConcurrentAppender: failed to write sidecar range");
+    }
+
+    // Index of the reserved range starting at row start (binary search), throws if there is none
+    auto find_range(const int fd, const RowCounters& c, const size_t start) -> size_t
+    {
+        size_t lo = 0;
+        size_t hi = c.n_ranges;
+        while (lo < hi) {
+            const size_t mid = lo + (hi - lo) / 2;
+            if (read_range(fd, mid).start < start)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo == c.n_ranges || read_range(fd, lo).start != start)
+            throw std::runtime_error("ConcurrentAppender: row " + std::to_string(start) +
+                                     " does not start a reserved range");
+        return lo;
+    }
+
+} // namespace
+
+npy::ConcurrentAppender::ConcurrentAppender(const std::string& fname) : filename(fname)
+{
+    const NpyHeader h = npy_read_header(fname);
+    if (h.shape.size() != 2 || h.fortran_order)
+        throw std::runtime_error("ConcurrentAppender: " + fname + " is not a 2D C-order array");
+    cols = h.shape[1];
+    word_size = h.word_size;
+    data_offset = h.data_offset;
+
+    data_fd = open(fname.c_str(), O_WRONLY);
+    if (data_fd < 0)
+        throw std::runtime_error("ConcurrentAppender: Unable to open file " + fname);
+    side_fd = open(sidecar_name(fname).c_str(), O_RDWR);
+    if (side_fd < 0) {
+        close(data_fd);
+        throw std::runtime_error("ConcurrentAppender: no sidecar for " + fname + " (not created or already finalized)");
+    }
+}
+
+npy::ConcurrentAppender::~ConcurrentAppender()
+{
+    if (data_fd >= 0)
+        close(data_fd);
+    if (side_fd >= 0)
+        close(side_fd);
+}
+
+size_t npy::ConcurrentAppender::reserve(const size_t n_rows)
+{
+    SidecarLock lock(side_fd);
+    RowCounters c = read_counters(side_fd);
+    const size_t start = c.reserved;
+    if (n_rows == 0)
+        return start;
+    write_range(side_fd, c.n_ranges, RowRange{start, n_rows, range_free});
+    c.reserved += n_rows;
+    ++c.n_ranges;
+    write_counters(side_fd, c);
+    return start;
+}
+
+void npy::ConcurrentAppender::write_rows(const size_t start, const void* data, const size_t n_rows)
+{
+    if (n_rows == 0)
+        return;
+
+    // Claim the range before writing, so writes outside a reservation or a second write of one never land
+    size_t i;
+    RowRange r;
+    {
+        SidecarLock lock(side_fd);
+        i = find_range(side_fd, read_counters(side_fd), start);
+        r = read_range(side_fd, i);
+        if (r.n_rows != n_rows)
+            throw std::runtime_error("ConcurrentAppender: write of " + std::to_string(n_rows) + " rows at row " +
+                                     std::to_string(start) + " does not match its reservation of " +
+                                     std::to_string(r.n_rows));
+        if (r.state != range_free)
+            throw std::runtime_error("ConcurrentAppender: rows from " + std::to_string(start) + " are already written");
+        r.state = range_writing;
+        write_range(side_fd, i, r);
+    }
+
+    const size_t row_bytes = cols * word_size;
+    try {
+        _pwrite_all(data_fd, data, n_rows * row_bytes, data_offset + start * row_bytes);
+    } catch (...) {
+        SidecarLock lock(side_fd);
+        r.state = range_free;
+        write_range(side_fd, i, r);
+        throw;
+    }
+
+    SidecarLock lock(side_fd);
+    RowCounters c = read_counters(side_fd);
+    r.state = range_committed;
+    write_range(side_fd, i, r);
+    c.committed += n_rows;
+    write_counters(side_fd, c);
+}
+
+void npy::concurrent_create(const std::string& fname, const std::string& descr, const size_t cols)
+{
+    const std::string header = _npy_header(descr, false, {0, cols}, growable_header_size);
+    {
+        file_ptr fp = _open_file(fname, "wb");
+        if (!fp)
+            throw std::runtime_error("concurrent_create: Unable to open file " + fname);
+        if (fwrite(header.data(), 1, header.size(), fp.get()) != header.size())
+            throw std::runtime_error("concurrent_create: failed fwrite");
+    }
+
+    const int fd = open(sidecar_name(fname).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("concurrent_create: Unable to create sidecar for " + fname);
+    try {
+        write_counters(fd, RowCounters{0, 0, 0});
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+
+auto npy::concurrent_finalize(const std::string& fname) -> size_t
+{
+    const std::string side = sidecar_name(fname);
+    const int side_fd = open(side.c_str(), O_RDWR);
+    if (side_fd < 0)
+        throw std::runtime_error("concurrent_finalize: no sidecar for " + fname);
+
+    size_t rows;
+    try {
+        SidecarLock lock(side_fd);
+        const RowCounters c = read_counters(side_fd);
+        if (c.committed != c.reserved)
+            throw std::runtime_error("concurrent_finalize: " + std::to_string(c.reserved - c.committed) +
+                                     " reserved rows of " + fname + " are not written yet");
+        rows = c.reserved;
+
+        const NpyHeader h = npy_read_header(fname);
+        const std::string header = _npy_header(h.descr, false, {rows, h.shape[1]}, h.data_offset);
+        if (header.size() != h.data_offset)
+            throw std::runtime_error("concurrent_finalize: new header of " + fname + " does not fit");
+
+        const int data_fd = open(fname.c_str(), O_WRONLY);
+        if (data_fd < 0)
+            throw std::runtime_error("concurrent_finalize: Unable to open file " + fname);
+        try {
+            _pwrite_all(data_fd, header.data(), header.size(), 0);
+            if (ftruncate(data_fd, static_cast<off_t>(h.data_offset + rows * h.shape[1] * h.word_size)) != 0)
+                throw std::runtime_error("concurrent_finalize: failed ftruncate");
+            fsync(data_fd);
+        } catch (...) {
+            close(data_fd);
+            throw;
+        }
+        close(data_fd);
+        unlink(side.c_str());
+    } catch (...) {
+        close(side_fd);
+        throw;
+    }
+    close(side_fd);
+    return rows;
+}
@@ -0,0 +1,77 @@
+#ifndef NPY_CONCURRENT_H_
+#define NPY_CONCURRENT_H_
+
+#include "npy_utils.hpp"
+
+namespace npy {
+
+    // Multi-process append to a single 2D C-order npy file.
+    //
+    // concurrent_create writes the file with a header large enough to hold any final shape and a sidecar
+    // "<file>.rows" holding the rows reserved and committed and the list of reserved ranges. Each writer
+    // process opens its own ConcurrentAppender, reserves a row range under an advisory lock on the sidecar
+    // and pwrites its rows without further coordination. Every range is written exactly once as a whole, so
+    // the committed count reaches the reserved count only when no holes remain. concurrent_finalize patches
+    // the header shape once every reserved row has been committed and removes the sidecar.
+    class ConcurrentAppender {
+    public:
+        explicit ConcurrentAppender(const std::string& fname);
+        ~ConcurrentAppender();
+
+        ConcurrentAppender(const ConcurrentAppender&) = delete;
+        ConcurrentAppender& operator=(const ConcurrentAppender&) = delete;
+
+        // Atomically reserve n_rows rows, returns the index of the first reserved row
+        size_t reserve(size_t n_rows);
+
+        // Write the n_rows rows of the range reserve(n_rows) returned `start` for and mark them committed;
+        // throws before writing anything if that range was not reserved or has already been written
+        void write_rows(size_t start, const void* data, size_t n_rows);
+
+        template<typename T>
+        size_t append(const T* data, size_t n_rows)
+        {
+            if (sizeof(T) != word_size)
+                throw std::runtime_error("ConcurrentAppender: word size mismatch for " + filename);
+            const size_t start = reserve(n_rows);
+            write_rows(start, data, n_rows);
+            return start;
+        }
+
+        template<typename T>
+        size_t append(const Eigen::Matrix<T, -1, -1, Eigen::RowMajor>& block)
+        {
+            if (static_cast<size_t>(block.cols()) != cols)
+                throw std::runtime_error("ConcurrentAppender: column count mismatch for " + filename);
+            return append(block.data(), static_cast<size_t>(block.rows()));
+        }
+
+        [[nodiscard]] size_t num_cols() const { return cols; }
+
+    private:
+        std::string filename;
+        int data_fd = -1;
+        int side_fd = -1;
+        size_t cols = 0;
+        size_t word_size = 0;
+        size_t data_offset = 0;
+    };
+
+    // Create an empty (0, cols) array ready for concurrent appends
+    template<typename T>
+    void concurrent_create(const std::string& fname, size_t cols);
+    void concurrent_create(const std::string& fname, const std::string& descr, size_t cols);
+
+    // Set the header shape to the number of rows written and remove the sidecar, returns the final row count.
+    // Throws if some reserved rows have not been committed yet.
+    auto concurrent_finalize(const std::string& fname) -> size_t;
+
+    template<typename T>
+    void concurrent_create(const std::string& fname, const size_t cols)
+    {
+        concurrent_create(fname, _npy_descr<T>(), cols);
+    }
+
+} // namespace npy
+
+#endif
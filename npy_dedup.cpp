@@ -0,0 +1,233 @@
+#include "npy_dedup.hpp"
+#include "npy_parallel.hpp"
+#include "npy_partition.hpp"
+#include "npy_writer.hpp"
+
+#include <cstring>
+
+namespace {
+
+    constexpr uint64_t prime1 = 0x9e3779b185ebca87ULL;
+    constexpr uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
+
+    // Each spill partition holds an open file, so tiny budgets stop splitting here instead of running out of
+    // descriptors; partitions then exceed the budget and are processed one at a time
+    constexpr size_t max_spill_parts = 1024;
+
+    inline uint64_t rotl(const uint64_t x, const int r) { return (x << r) | (x >> (64 - r)); }
+
+    inline uint64_t load64(const unsigned char* p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    // Bytes per row and access to them for C-order arrays and 2D Fortran-order arrays
+    class RowView {
+    public:
+        explicit RowView(const npy::MappedNpy& src) : src(src)
+        {
+            if (src.shape().empty())
+                throw std::runtime_error("unique_row_mask: scalar arrays have no rows");
+            if (src.fortran_order() && src.shape().size() > 2)
+                throw std::runtime_error("unique_row_mask: Fortran order is only supported for 1D and 2D arrays");
+            n_rows = src.shape()[0];
+            row_size = n_rows > 0 ? src.num_bytes() / n_rows : 0;
+            strided = src.fortran_order() && src.shape().size() == 2 && src.shape()[1] > 1;
+        }
+
+        // Pointer to the bytes of row r, gathered into scratch when the row is not contiguous
+        const unsigned char* row(const size_t r, std::vector<unsigned char>& scratch) const
+        {
+            const auto base = src.data<unsigned char>();
+            if (!strided)
+                return base + r * row_size;
+            const size_t ws = src.word_size();
+            scratch.resize(row_size);
+            for (size_t c = 0; c < row_size / ws; ++c)
+                std::memcpy(&scratch[c * ws], base + (c * n_rows + r) * ws, ws);
+            return scratch.data();
+        }
+
+        bool equal(const size_t a, const size_t b, std::vector<unsigned char>& scratch_a,
+                   std::vector<unsigned char>& scratch_b) const
+        {
+            return std::memcmp(row(a, scratch_a), row(b, scratch_b), row_size) == 0;
+        }
+
+        size_t n_rows = 0;
+        size_t row_size = 0;
+
+    private:
+        const npy::MappedNpy& src;
+        bool strided = false;
+    };
+
+    struct HashedRow {
+        uint64_t hash;
+        uint64_t row;
+    };
+
+    // Mark the first occurrence of every distinct row among `rows`, which must be in ascending row order
+    void mark_partition(const RowView& view, const std::vector<HashedRow>& rows, std::vector<std::atomic<uint64_t>>& keep)
+    {
+        size_t cap = 16;
+        while (cap < 2 * rows.size())
+            cap *= 2;
+        const size_t mask = cap - 1;
+        std::vector<HashedRow> table(cap, HashedRow{0, UINT64_MAX});
+        std::vector<unsigned char> scratch_a, scratch_b;
+        for (const HashedRow& hr: rows) {
+            size_t i = hr.hash & mask;
+            bool duplicate = false;
+            for (; table[i].row != UINT64_MAX; i = (i + 1) & mask)
+                if (table[i].hash == hr.hash && view.equal(table[i].row, hr.row, scratch_a, scratch_b)) {
+                    duplicate = true;
+                    break;
+                }
+            if (duplicate)
+                continue;
+            table[i] = hr;
+            keep[hr.row / 64].fetch_or(uint64_t{1} << (hr.row % 64), std::memory_order_relaxed);
+        }
+    }
+
+} // namespace
+
+uint64_t npy::hash_bytes(const void* data, const size_t n, const uint64_t seed)
+{
+    const auto p = static_cast<const unsigned char*>(data);
+    size_t i = 0;
+    uint64_t h;
+    if (n >= 32) {
+        uint64_t lane[4] = {seed + prime1 + prime2, seed + prime2, seed, seed - prime1};
+        for (; i + 32 <= n; i += 32)
+            for (int l = 0; l < 4; ++l)
+                lane[l] = rotl(lane[l] + load64(p + i + 8 * l) * prime2, 31) * prime1;
+        h = rotl(lane[0], 1) + rotl(lane[1], 7) + rotl(lane[2], 12) + rotl(lane[3], 18);
+    } else {
+        h = seed + prime1;
+    }
+    h += n;
+    for (; i + 8 <= n; i += 8)
+        h = rotl(h ^ (load64(p + i) * prime2), 27) * prime1;
+    for (; i < n; ++i)
+        h = rotl(h ^ (p[i] * prime1), 11) * prime2;
+    return _mix64(h);
+}
+
+auto npy::unique_row_mask(const MappedNpy& src, const DedupOptions& opt) -> std::vector<uint64_t>
+{
+    const RowView view(src);
+    const size_t n = view.n_rows;
+    std::vector<std::atomic<uint64_t>> keep((n + 63) / 64);
+    for (auto& w: keep)
+        w = 0;
+
+    const size_t chunk_rows = std::max<size_t>(opt.chunk_rows, 1);
+    const size_t n_chunks = (n + chunk_rows - 1) / chunk_rows;
+    const size_t workers = num_workers(n_chunks, opt.n_threads);
+    const size_t n_parts = 4 * _resolve_threads(opt.n_threads);
+
+    if (n * 2 * sizeof(HashedRow) <= opt.memory_budget) {
+        // Hash every row, then counting-sort (hash, row) pairs into partitions by hash, stable in row order
+        std::vector<uint64_t> hashes(n);
+        std::vector<std::vector<size_t>> counts(n_chunks, std::vector<size_t>(n_parts));
+        const auto part_of = [&](const uint64_t h) { return static_cast<size_t>((h >> 32) % n_parts); };
+        parallel_for(n_chunks, opt.n_threads, [&](const size_t c) {
+            std::vector<unsigned char> scratch;
+            for (size_t r = c * chunk_rows; r < std::min(n, (c + 1) * chunk_rows); ++r) {
+                hashes[r] = hash_bytes(view.row(r, scratch), view.row_size);
+                ++counts[c][part_of(hashes[r])];
+            }
+        });
+        std::vector<size_t> part_begin(n_parts + 1);
+        for (size_t p = 0, at = 0; p < n_parts; ++p) {
+            part_begin[p] = at;
+            for (size_t c = 0; c < n_chunks; ++c) {
+                const size_t count = counts[c][p];
+                counts[c][p] = at;
+                at += count;
+            }
+        }
+        part_begin[n_parts] = n;
+        std::vector<HashedRow> sorted(n);
+        parallel_for(n_chunks, opt.n_threads, [&](const size_t c) {
+            for (size_t r = c * chunk_rows; r < std::min(n, (c + 1) * chunk_rows); ++r)
+                sorted[counts[c][part_of(hashes[r])]++] = HashedRow{hashes[r], r};
+        });
+        hashes = std::vector<uint64_t>();
+        parallel_for(n_parts, opt.n_threads, [&](const size_t p) {
+            const std::vector<HashedRow> rows(sorted.begin() + static_cast<std::ptrdiff_t>(part_begin[p]),
+                                              sorted.begin() + static_cast<std::ptrdiff_t>(part_begin[p + 1]));
+            mark_partition(view, rows, keep);
+        });
+    } else {
+        // Spill (hash, row) pairs by hash; partitions are then processed a few at a time within the budget
+        const size_t spill_parts = std::min(
+                max_spill_parts, std::max<size_t>(n_parts, n * 2 * sizeof(HashedRow) / opt.memory_budget + 1));
+        RowPartitions parts(opt.spill_dir, spill_parts, sizeof(uint64_t), workers, opt.memory_budget);
+        parallel_for_worker(n_chunks, opt.n_threads, [&](const size_t worker, const size_t c) {
+            std::vector<unsigned char> scratch;
+            for (size_t r = c * chunk_rows; r < std::min(n, (c + 1) * chunk_rows); ++r) {
+                const uint64_t h = hash_bytes(view.row(r, scratch), view.row_size);
+                const uint64_t row = r;
+                std::memcpy(parts.record(worker, static_cast<int64_t>(h)), &row, sizeof(row));
+            }
+        });
+        parts.flush_all();
+        const size_t part_threads = std::max<size_t>(
+                1, std::min(_resolve_threads(opt.n_threads),
+                            opt.memory_budget * parts.size() / std::max<size_t>(n * 2 * sizeof(HashedRow), 1)));
+        parallel_for(parts.size(), part_threads, [&](const size_t p) {
+            const std::vector<char> records = parts.read(p);
+            std::vector<HashedRow> rows(records.size() / sizeof(HashedRow));
+            std::memcpy(rows.data(), records.data(), rows.size() * sizeof(HashedRow));
+            std::sort(rows.begin(), rows.end(), [](const HashedRow& a, const HashedRow& b) { return a.row < b.row; });
+            mark_partition(view, rows, keep);
+        });
+    }
+
+    std::vector<uint64_t> mask(keep.size());
+    for (size_t i = 0; i < keep.size(); ++i)
+        mask[i] = keep[i].load(std::memory_order_relaxed);
+    return mask;
+}
+
+size_t npy::count_unique_rows(const std::string& in_file, const DedupOptions& opt)
+{
+    const MappedNpy src(in_file);
+    size_t count = 0;
+    for (const uint64_t w: unique_row_mask(src, opt))
+        count += static_cast<size_t>(__builtin_popcountll(w));
+    return count;
+}
+
+size_t npy::drop_duplicate_rows(const std::string& in_file, const std::string& out_file, const DedupOptions& opt)
+{
+    const MappedNpy src(in_file);
+    const std::vector<uint64_t> mask = unique_row_mask(src, opt);
+    const RowView view(src);
+    const std::vector<size_t> row_shape(src.shape().begin() + 1, src.shape().end());
+
+    NpyStreamWriter writer(out_file, src.header().descr, row_shape);
+    OrderedChunkSink sink(writer);
+    const size_t chunk_rows = std::max<size_t>(opt.chunk_rows, 1);
+    const size_t n_chunks = (view.n_rows + chunk_rows - 1) / chunk_rows;
+    parallel_for(n_chunks, opt.n_threads, [&](const size_t c) {
+        std::vector<char> bytes;
+        std::vector<unsigned char> scratch;
+        size_t kept = 0;
+        for (size_t r = c * chunk_rows; r < std::min(view.n_rows, (c + 1) * chunk_rows); ++r) {
+            if (!(mask[r / 64] >> (r % 64) & 1))
+                continue;
+            const auto row = reinterpret_cast<const char*>(view.row(r, scratch));
+            bytes.insert(bytes.end(), row, row + view.row_size);
+            ++kept;
+        }
+        sink.put(c, std::move(bytes), kept);
+    });
+    writer.close();
+    return writer.rows();
+}
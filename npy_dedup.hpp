@@ -0,0 +1,37 @@
+#ifndef NPY_DEDUP_H_
+#define NPY_DEDUP_H_
+
+#include "npy_mmap.hpp"
+
+namespace npy {
+
+    struct DedupOptions {
+        // Bytes the in-memory row hashes and partition lists may use before they are spilled to disk
+        size_t memory_budget = size_t{1} << 30;
+        std::string spill_dir = ".";
+        size_t chunk_rows = 1 << 14;
+        size_t n_threads = 0;
+    };
+
+    // xxHash64-style hash of n bytes: four independent 64-bit lanes over 32-byte stripes, which the compiler
+    // can keep in vector registers, folded and finalized with _mix64
+    uint64_t hash_bytes(const void* data, size_t n, uint64_t seed = 0);
+
+    // Rows (first-axis slices) of an npy array that are not a byte-for-byte repeat of an earlier row, as a
+    // bitmap of ceil(rows / 64) words. Rows are hashed in parallel chunks and radix-partitioned by hash; each
+    // partition resolves hash collisions by comparing row bytes. When the hashes would exceed the memory
+    // budget, (hash, row) pairs are spilled to temporary partition files instead. Fortran order is supported
+    // for 1D and 2D arrays.
+    auto unique_row_mask(const MappedNpy& src, const DedupOptions& opt = DedupOptions()) -> std::vector<uint64_t>;
+
+    // Number of distinct rows in in_file
+    size_t count_unique_rows(const std::string& in_file, const DedupOptions& opt = DedupOptions());
+
+    // Write the distinct rows of in_file to out_file (C order) keeping the order of their first occurrence,
+    // returns the number of rows written
+    size_t drop_duplicate_rows(const std::string& in_file, const std::string& out_file,
+                               const DedupOptions& opt = DedupOptions());
+
+} // namespace npy
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef NPY_EXPR_H_
+#define NPY_EXPR_H_
+
+#include "npy_mmap.hpp"
+#include "npy_parallel.hpp"
+
+#include <unistd.h>
+
+namespace npy {
+namespace expr {
+
+    // Lazy elementwise expressions whose leaves are mapped npy arrays, e.g.
+    //
+    //     auto a = expr::file<double>("a.npy"), b = expr::file<double>("b.npy"), c = expr::file<double>("c.npy");
+    //     expr::evaluate(a * 2.0 + b / c, "out.npy");
+    //
+    // Every node produces an Eigen array expression for a chunk of the flattened payload, so the whole tree
+    // is fused into one vectorised Eigen loop per chunk. evaluate() runs chunks across threads and pwrites
+    // each result into the output file; each input byte is read once straight from the mapping.
+
+    template<typename T>
+    using Col = Eigen::Array<T, -1, 1>;
+
+    template<typename Derived>
+    struct Node {
+        const Derived& self() const { return static_cast<const Derived&>(*this); }
+    };
+
+    template<typename T>
+    struct Leaf : Node<Leaf<T>> {
+        using Scalar = T;
+
+        explicit Leaf(MappedNpy a) : arr(std::move(a))
+        {
+            if (arr.word_size() != sizeof(T))
+                throw std::runtime_error("expr::Leaf: word size does not match the requested type");
+        }
+
+        auto chunk(const size_t begin, const size_t n) const { return Eigen::Map<const Col<T>>(arr.data<T>() + begin, n); }
+        void collect(std::vector<const MappedNpy*>& leaves) const { leaves.push_back(&arr); }
+
+        MappedNpy arr;
+    };
+
+    template<typename T>
+    struct Constant : Node<Constant<T>> {
+        using Scalar = T;
+
+        explicit Constant(const T v) : value(v) {}
+
+        auto chunk(size_t, const size_t n) const { return Col<T>::Constant(n, value); }
+        void collect(std::vector<const MappedNpy*>&) const {}
+
+        T value;
+    };
+
+    template<typename A, typename Op>
+    struct Unary : Node<Unary<A, Op>> {
+        using Scalar = typename A::Scalar;
+
+        explicit Unary(const A& a) : a(a) {}
+
+        auto chunk(const size_t begin, const size_t n) const { return Op::apply(a.chunk(begin, n)); }
+        void collect(std::vector<const MappedNpy*>& leaves) const { a.collect(leaves); }
+
+        A a;
+    };
+
+    template<typename L, typename R, typename Op>
+    struct Binary : Node<Binary<L, R, Op>> {
+        using Scalar = typename L::Scalar;
+        static_assert(std::is_same<typename L::Scalar, typename R::Scalar>::value,
+                      "expr: operands must have the same scalar type");
+
+        Binary(const L& l, const R& r) : l(l), r(r) {}
+
+        auto chunk(const size_t begin, const size_t n) const { return Op::apply(l.chunk(begin, n), r.chunk(begin, n)); }
+        void collect(std::vector<const MappedNpy*>& leaves) const
+        {
+            l.collect(leaves);
+            r.collect(leaves);
+        }
+
+        L l;
+        R r;
+    };
+
+#define NPY_EXPR_BINARY_OP(NAME, EXPR)                                                                                 \
+    struct NAME {                                                                                                      \
+        template<typename X, typename Y>                                                                               \
+        static auto apply(const X& x, const Y& y)                                                                      \
+        {                                                                                                              \
+            return EXPR;                                                                                               \
+        }                                                                                                              \
+    };
+#define NPY_EXPR_UNARY_OP(NAME, EXPR)                                                                                  \
+    struct NAME {                                                                                                      \
+        template<typename X>                                                                                           \
+        static auto apply(const X& x)                                                                                  \
+        {                                                                                                              \
+            return EXPR;                                                                                               \
+        }                                                                                                              \
+    };
+
+    NPY_EXPR_BINARY_OP(Add, x + y)
+    NPY_EXPR_BINARY_OP(Sub, x - y)
+    NPY_EXPR_BINARY_OP(Mul, x * y)
+    NPY_EXPR_BINARY_OP(Div, x / y)
+    NPY_EXPR_BINARY_OP(Min, x.min(y))
+    NPY_EXPR_BINARY_OP(Max, x.max(y))
+    NPY_EXPR_UNARY_OP(Neg, -x)
+    NPY_EXPR_UNARY_OP(Abs, x.abs())
+    NPY_EXPR_UNARY_OP(Sqrt, x.sqrt())
+    NPY_EXPR_UNARY_OP(Exp, x.exp())
+    NPY_EXPR_UNARY_OP(Log, x.log())
+
+#undef NPY_EXPR_BINARY_OP
+#undef NPY_EXPR_UNARY_OP
+
+    template<typename T>
+    auto file(const std::string& fname) -> Leaf<T>
+    {
+        return Leaf<T>(MappedNpy(fname));
+    }
+
+    template<typename T>
+    auto array(const MappedNpy& arr) -> Leaf<T>
+    {
+        return Leaf<T>(arr);
+    }
+
+#define NPY_EXPR_OPERATOR(OP, NAME)                                                                                    \
+    template<typename A, typename B>                                                                                   \
+    auto operator OP(const Node<A>& a, const Node<B>& b)                                                               \
+    {                                                                                                                  \
+        return Binary<A, B, NAME>(a.self(), b.self());                                                                 \
+    }                                                                                                                  \
+    template<typename A>                                                                                               \
+    auto operator OP(const Node<A>& a, const typename A::Scalar s)                                                     \
+    {                                                                                                                  \
+        return Binary<A, Constant<typename A::Scalar>, NAME>(a.self(), Constant<typename A::Scalar>(s));               \
+    }                                                                                                                  \
+    template<typename A>                                                                                               \
+    auto operator OP(const typename A::Scalar s, const Node<A>& a)                                                     \
+    {                                                                                                                  \
+        return Binary<Constant<typename A::Scalar>, A, NAME>(Constant<typename A::Scalar>(s), a.self());               \
+    }
+
+    NPY_EXPR_OPERATOR(+, Add)
+    NPY_EXPR_OPERATOR(-, Sub)
+    NPY_EXPR_OPERATOR(*, Mul)
+    NPY_EXPR_OPERATOR(/, Div)
+
+#undef NPY_EXPR_OPERATOR
+
+    template<typename A>
+    auto operator-(const Node<A>& a) { return Unary<A, Neg>(a.self()); }
+    template<typename A>
+    auto abs(const Node<A>& a) { return Unary<A, Abs>(a.self()); }
+    template<typename A>
+    auto sqrt(const Node<A>& a) { return Unary<A, Sqrt>(a.self()); }
+    template<typename A>
+    auto exp(const Node<A>& a) { return Unary<A, Exp>(a.self()); }
+    template<typename A>
+    auto log(const Node<A>& a) { return Unary<A, Log>(a.self()); }
+    template<typename A, typename B>
+    auto min(const Node<A>& a, const Node<B>& b) { return Binary<A, B, Min>(a.self(), b.self()); }
+    template<typename A, typename B>
+    auto max(const Node<A>& a, const Node<B>& b) { return Binary<A, B, Max>(a.self(), b.self()); }
+
+    // Evaluate e chunk by chunk into out_file, which gets the shape and order of the leaves
+    template<typename E>
+    void evaluate(const Node<E>& e, const std::string& out_file, const size_t chunk_elems = 1 << 16,
+                  const size_t n_threads = 0)
+    {
+        using T = typename E::Scalar;
+
+        std::vector<const MappedNpy*> leaves;
+        e.self().collect(leaves);
+        if (leaves.empty())
+            throw std::runtime_error("expr::evaluate: expression has no array operand");
+        for (const MappedNpy* leaf: leaves)
+            if (leaf->shape() != leaves[0]->shape() || leaf->fortran_order() != leaves[0]->fortran_order())
+                throw std::runtime_error("expr::evaluate: operands differ in shape or order");
+        if (chunk_elems == 0)
+            throw std::runtime_error("expr::evaluate: chunk_elems must be positive");
+
+        const size_t total = leaves[0]->num_vals();
+        size_t data_offset;
+        const int fd = _create_npy_file(out_file, _npy_descr<T>(), leaves[0]->fortran_order(), leaves[0]->shape(),
+                                        data_offset);
+
+        const size_t n_chunks = (total + chunk_elems - 1) / chunk_elems;
+        std::vector<Col<T>> buffers(num_workers(n_chunks, n_threads));
+        try {
+            parallel_for_worker(n_chunks, n_threads, [&](const size_t worker, const size_t c) {
+                const size_t begin = c * chunk_elems;
+                const size_t n = std::min(chunk_elems, total - begin);
+                Col<T>& buf = buffers[worker];
+                buf.resize(static_cast<Eigen::Index>(n));
+                buf = e.self().chunk(begin, n);
+                _pwrite_all(fd, buf.data(), n * sizeof(T), data_offset + begin * sizeof(T));
+            });
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        close(fd);
+    }
+
+} // namespace expr
+} // namespace npy
+
+#endif
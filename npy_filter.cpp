@@ -0,0 +1,65 @@
+#include "npy_filter.hpp"
+
+npy::RowPredicate::RowPredicate(const Kind kind, RowPredicate lhs, RowPredicate rhs) :
+    kind(kind), lhs(std::make_shared<const RowPredicate>(std::move(lhs))),
+    rhs(std::make_shared<const RowPredicate>(std::move(rhs)))
+{}
+
+npy::RowPredicate::RowPredicate(const Kind kind, RowPredicate operand) :
+    kind(kind), lhs(std::make_shared<const RowPredicate>(std::move(operand)))
+{}
+
+auto npy::operator&(const RowPredicate& lhs, const RowPredicate& rhs) -> RowPredicate
+{
+    return RowPredicate(RowPredicate::Kind::And, lhs, rhs);
+}
+
+auto npy::operator|(const RowPredicate& lhs, const RowPredicate& rhs) -> RowPredicate
+{
+    return RowPredicate(RowPredicate::Kind::Or, lhs, rhs);
+}
+
+auto npy::operator!(const RowPredicate& operand) -> RowPredicate
+{
+    return RowPredicate(RowPredicate::Kind::Not, operand);
+}
+
+auto npy::pred::less(const size_t col, const double v) -> RowPredicate
+{
+    return RowPredicate(RowPredicate::Kind::Less, col, v);
+}
+
+auto npy::pred::less_equal(const size_t col, const double v) -> RowPredicate
+{
+    return RowPredicate(RowPredicate::Kind::LessEqual, col, v);
+}
+
+auto npy::pred::greater(const size_t col, const double v) -> RowPredicate
+{
+    return RowPredicate(RowPredicate::Kind::Greater, col, v);
+}
+
+auto npy::pred::greater_equal(const size_t col, const double v) -> RowPredicate
+{
+    return RowPredicate(RowPredicate::Kind::GreaterEqual, col, v);
+}
+
+auto npy::pred::equal(const size_t col, const double v) -> RowPredicate
+{
+    return RowPredicate(RowPredicate::Kind::Equal, col, v);
+}
+
+auto npy::pred::not_equal(const size_t col, const double v) -> RowPredicate
+{
+    return RowPredicate(RowPredicate::Kind::NotEqual, col, v);
+}
+
+auto npy::pred::between(const size_t col, const double lo, const double hi) -> RowPredicate
+{
+    return RowPredicate(RowPredicate::Kind::Between, col, lo, hi);
+}
+
+auto npy::pred::is_nan(const size_t col) -> RowPredicate
+{
+    return RowPredicate(RowPredicate::Kind::IsNan, col, 0);
+}
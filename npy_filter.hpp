@@ -0,0 +1,138 @@
+#ifndef NPY_FILTER_H_
+#define NPY_FILTER_H_
+
+#include "npy_chunks.hpp"
+#include "npy_writer.hpp"
+
+#include <cstring>
+
+namespace npy {
+
+    // Boolean condition on the columns of a row, built from comparisons and combined with & (AND), | (OR)
+    // and ! (NOT), e.g. `pred::greater(0, 0.5) & !pred::is_nan(2)`. Values are compared as double.
+    class RowPredicate {
+    public:
+        enum class Kind { Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual, Between, IsNan, And, Or, Not };
+
+        RowPredicate(Kind kind, size_t col, double a, double b = 0) : kind(kind), col(col), a(a), b(b) {}
+        RowPredicate(Kind kind, RowPredicate lhs, RowPredicate rhs);
+        RowPredicate(Kind kind, RowPredicate operand);
+
+        // Evaluate the predicate for every row of a block; comparisons run as vectorised Eigen array
+        // operations over one column at a time
+        template<typename Block>
+        auto eval(const Block& block) const -> Eigen::Array<bool, -1, 1>
+        {
+            switch (kind) {
+                case Kind::And: return lhs->eval(block) && rhs->eval(block);
+                case Kind::Or: return lhs->eval(block) || rhs->eval(block);
+                case Kind::Not: return !lhs->eval(block);
+                default: break;
+            }
+
+            if (col >= static_cast<size_t>(block.cols()))
+                throw std::runtime_error("RowPredicate: column index out of range");
+            const Eigen::Array<double, -1, 1> x = block.col(static_cast<Eigen::Index>(col)).template cast<double>();
+            switch (kind) {
+                case Kind::Less: return x < a;
+                case Kind::LessEqual: return x <= a;
+                case Kind::Greater: return x > a;
+                case Kind::GreaterEqual: return x >= a;
+                case Kind::Equal: return x == a;
+                case Kind::NotEqual: return x != a;
+                case Kind::Between: return x >= a && x <= b;
+                case Kind::IsNan: return x.isNaN();
+                default: throw std::runtime_error("RowPredicate: invalid predicate");
+            }
+        }
+
+    private:
+        Kind kind;
+        size_t col = 0;
+        double a = 0;
+        double b = 0;
+        std::shared_ptr<const RowPredicate> lhs;
+        std::shared_ptr<const RowPredicate> rhs;
+    };
+
+    auto operator&(const RowPredicate& lhs, const RowPredicate& rhs) -> RowPredicate;
+    auto operator|(const RowPredicate& lhs, const RowPredicate& rhs) -> RowPredicate;
+    auto operator!(const RowPredicate& operand) -> RowPredicate;
+
+    namespace pred {
+        auto less(size_t col, double v) -> RowPredicate;
+        auto less_equal(size_t col, double v) -> RowPredicate;
+        auto greater(size_t col, double v) -> RowPredicate;
+        auto greater_equal(size_t col, double v) -> RowPredicate;
+        auto equal(size_t col, double v) -> RowPredicate;
+        auto not_equal(size_t col, double v) -> RowPredicate;
+        // lo <= x <= hi
+        auto between(size_t col, double lo, double hi) -> RowPredicate;
+        auto is_nan(size_t col) -> RowPredicate;
+    } // namespace pred
+
+    // Copy the rows of in_file matching pred, in their original order, into a new C-order npy out_file.
+    // Chunks are filtered and compacted in parallel and appended through a streaming writer whose header
+    // is patched at the end. If index_file is given, the int64 indices of the matching rows are written
+    // there as a 1D array. Returns the number of matching rows.
+    template<typename T>
+    auto filter_rows(const std::string& in_file, const RowPredicate& pred, const std::string& out_file,
+                     const std::string& index_file = "", const size_t chunk_rows = 1 << 14, const size_t n_threads = 0)
+            -> size_t
+    {
+        const MappedNpy arr(in_file);
+        const size_t cols = _num_cols(arr);
+        const size_t row_bytes = cols * sizeof(T);
+
+        NpyStreamWriter writer(out_file, _npy_descr<T>(), {cols});
+        OrderedChunkSink sink(writer);
+        std::unique_ptr<NpyStreamWriter> index_writer;
+        std::unique_ptr<OrderedChunkSink> index_sink;
+        if (!index_file.empty()) {
+            index_writer.reset(new NpyStreamWriter(index_file, "<i8", {}));
+            index_sink.reset(new OrderedChunkSink(*index_writer));
+        }
+
+        for_each_row_chunk<T>(
+                arr, chunk_rows,
+                [&](const size_t offset, const auto& block) {
+                    const Eigen::Array<bool, -1, 1> mask = pred.eval(block);
+                    const auto n = static_cast<size_t>(mask.count());
+
+                    std::vector<char> rows(n * row_bytes);
+                    auto dst = reinterpret_cast<T*>(rows.data());
+                    std::vector<int64_t> idx;
+                    idx.reserve(index_sink ? n : 0);
+                    for (Eigen::Index i = 0; i < block.rows(); ++i) {
+                        if (!mask[i])
+                            continue;
+                        if (std::decay_t<decltype(block)>::IsRowMajor) {
+                            std::memcpy(dst, block.data() + i * block.outerStride(), row_bytes);
+                        } else {
+                            for (size_t j = 0; j < cols; ++j)
+                                dst[j] = block(i, static_cast<Eigen::Index>(j));
+                        }
+                        dst += cols;
+                        if (index_sink)
+                            idx.push_back(static_cast<int64_t>(offset + static_cast<size_t>(i)));
+                    }
+
+                    const size_t chunk = offset / chunk_rows;
+                    sink.put(chunk, std::move(rows), n);
+                    if (index_sink) {
+                        std::vector<char> bytes(n * sizeof(int64_t));
+                        std::memcpy(bytes.data(), idx.data(), bytes.size());
+                        index_sink->put(chunk, std::move(bytes), n);
+                    }
+                },
+                n_threads);
+
+        writer.close();
+        if (index_writer)
+            index_writer->close();
+        return writer.rows();
+    }
+
+} // namespace npy
+
+#endif
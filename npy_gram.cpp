@@ -0,0 +1,37 @@
+#include "npy_gram.hpp"
+
+void npy::CoMoments::add_rows(const Eigen::MatrixXd& panel)
+{
+    if (panel.rows() == 0)
+        return;
+    CoMoments c(panel.cols());
+    c.count = panel.rows();
+    c.mean = panel.colwise().mean().transpose();
+    const Eigen::MatrixXd centered = panel.rowwise() - c.mean.transpose();
+    c.comoment.selfadjointView<Eigen::Lower>().rankUpdate(centered.transpose());
+    merge(c);
+}
+
+void npy::CoMoments::merge(const CoMoments& other)
+{
+    if (other.count == 0)
+        return;
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+    const auto n_a = static_cast<double>(count);
+    const auto n_b = static_cast<double>(other.count);
+    const double n = n_a + n_b;
+    const Eigen::VectorXd delta = other.mean - mean;
+    comoment += other.comoment;
+    comoment.selfadjointView<Eigen::Lower>().rankUpdate(delta, n_a * n_b / n);
+    mean += delta * (n_b / n);
+    count += other.count;
+}
+
+auto npy::CoMoments::covariance(const double ddof) const -> Eigen::MatrixXd
+{
+    const Eigen::MatrixXd full = comoment.selfadjointView<Eigen::Lower>();
+    return full / std::max(1.0, static_cast<double>(count) - ddof);
+}
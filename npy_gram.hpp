@@ -0,0 +1,103 @@
+#ifndef NPY_GRAM_H_
+#define NPY_GRAM_H_
+
+#include "npy_chunks.hpp"
+
+namespace npy {
+
+    // Mergeable column mean and co-moment matrix sum((x - mean)(x - mean)^T). Only the lower triangle of
+    // comoment is maintained; covariance() mirrors it into the full symmetric matrix.
+    struct CoMoments {
+        explicit CoMoments(const Eigen::Index cols = 0) :
+            mean(Eigen::VectorXd::Zero(cols)), comoment(Eigen::MatrixXd::Zero(cols, cols))
+        {}
+
+        // Add a panel of rows; the panel is centered on its own mean first, then merged pairwise
+        void add_rows(const Eigen::MatrixXd& panel);
+        void merge(const CoMoments& other);
+        // Sample covariance with the given delta degrees of freedom (1 = unbiased, as numpy.cov)
+        [[nodiscard]] auto covariance(double ddof = 1) const -> Eigen::MatrixXd;
+
+        Eigen::Index count = 0;
+        Eigen::VectorXd mean;
+        Eigen::MatrixXd comoment;
+    };
+
+    // X^T X of a MappedNpy or VirtualArray (e.g. a shard folder) without stacking it. Every thread
+    // accumulates the lower triangle of its row panels with a symmetric rank-k update; memory is O(cols^2)
+    // per thread.
+    template<typename T, typename Source>
+    auto gram_matrix(const Source& src, const size_t chunk_rows = 1 << 14, const size_t n_threads = 0)
+            -> Eigen::MatrixXd
+    {
+        const auto cols = static_cast<Eigen::Index>(_num_cols(src));
+        std::vector<Eigen::MatrixXd> acc(_resolve_threads(n_threads));
+        for_each_row_chunk_worker<T>(
+                src, chunk_rows,
+                [&](const size_t worker, size_t, const auto& block) {
+                    if (acc[worker].size() == 0)
+                        acc[worker] = Eigen::MatrixXd::Zero(cols, cols);
+                    const Eigen::MatrixXd panel = block.template cast<double>();
+                    acc[worker].template selfadjointView<Eigen::Lower>().rankUpdate(panel.transpose());
+                },
+                n_threads);
+
+        Eigen::MatrixXd G = Eigen::MatrixXd::Zero(cols, cols);
+        for (const auto& a: acc)
+            if (a.size())
+                G += a;
+        return G.selfadjointView<Eigen::Lower>();
+    }
+
+    // Column covariance of a MappedNpy or VirtualArray. Per-thread co-moments of mean-centered panels are
+    // combined with the pairwise (Chan et al.) update, which avoids the cancellation of X^T X - n mu mu^T.
+    template<typename T, typename Source>
+    auto covariance_matrix(const Source& src, const double ddof = 1, const size_t chunk_rows = 1 << 14,
+                           const size_t n_threads = 0) -> Eigen::MatrixXd
+    {
+        const auto cols = static_cast<Eigen::Index>(_num_cols(src));
+        std::vector<std::unique_ptr<CoMoments>> partial(_resolve_threads(n_threads));
+        for_each_row_chunk_worker<T>(
+                src, chunk_rows,
+                [&](const size_t worker, size_t, const auto& block) {
+                    if (!partial[worker])
+                        partial[worker].reset(new CoMoments(cols));
+                    partial[worker]->add_rows(block.template cast<double>());
+                },
+                n_threads);
+
+        CoMoments m(cols);
+        for (const auto& p: partial)
+            if (p)
+                m.merge(*p);
+        return m.covariance(ddof);
+    }
+
+    // File-to-file helpers: the (cols, cols) float64 result is written to out_file
+    template<typename T>
+    void gram_to_npy(const std::string& in_file, const std::string& out_file, const size_t n_threads = 0)
+    {
+        const Eigen::MatrixXd G = gram_matrix<T>(MappedNpy(in_file), 1 << 14, n_threads);
+        save_arr_as_matrix(out_file, G.data(), G.rows(), G.cols());
+    }
+
+    template<typename T>
+    void covariance_to_npy(const std::string& in_file, const std::string& out_file, const size_t n_threads = 0)
+    {
+        const Eigen::MatrixXd C = covariance_matrix<T>(MappedNpy(in_file), 1, 1 << 14, n_threads);
+        save_arr_as_matrix(out_file, C.data(), C.rows(), C.cols());
+    }
+
+    // Covariance across a folder of prefix{i}suffix shards, read through a VirtualArray
+    template<typename T>
+    void folder_covariance_to_npy(const std::string& folder_name, const std::string& prefix, const int start_i,
+                                  const std::string& suffix, const std::string& out_file, const size_t n_threads = 0)
+    {
+        const VirtualArray arr(folder_name, prefix, start_i, suffix);
+        const Eigen::MatrixXd C = covariance_matrix<T>(arr, 1, 1 << 14, n_threads);
+        save_arr_as_matrix(out_file, C.data(), C.rows(), C.cols());
+    }
+
+} // namespace npy
+
+#endif
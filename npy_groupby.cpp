@@ -0,0 +1,161 @@
+#include "npy_groupby.hpp"
+
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+    // Largest piece of a spilled partition read at once
+    constexpr size_t max_read_bytes = 4 << 20;
+    // Re-partitioning depth after which a partition is aggregated even if its table exceeds the budget
+    constexpr unsigned max_spill_levels = 4;
+
+} // namespace
+
+npy::GroupTable::GroupTable(const size_t n_values, size_t initial_capacity) :
+    n_values(n_values), stride(1 + 3 * n_values)
+{
+    size_t cap = 16;
+    while (cap < initial_capacity)
+        cap *= 2;
+    keys.resize(cap);
+    used.assign(cap, 0);
+    acc.resize(cap * stride);
+}
+
+double* npy::GroupTable::find_or_insert(const int64_t key)
+{
+    if (2 * (n_groups + 1) > keys.size())
+        grow();
+    const size_t mask = keys.size() - 1;
+    size_t i = _mix64(static_cast<uint64_t>(key)) & mask;
+    while (used[i]) {
+        if (keys[i] == key)
+            return acc.data() + i * stride;
+        i = (i + 1) & mask;
+    }
+
+    used[i] = 1;
+    keys[i] = key;
+    ++n_groups;
+    double* a = acc.data() + i * stride;
+    a[0] = 0;
+    for (size_t v = 0; v < n_values; ++v) {
+        a[1 + 3 * v] = 0;
+        a[2 + 3 * v] = std::numeric_limits<double>::infinity();
+        a[3 + 3 * v] = -std::numeric_limits<double>::infinity();
+    }
+    return a;
+}
+
+void npy::GroupTable::grow()
+{
+    GroupTable bigger(n_values, keys.size() * 2);
+    bigger.merge(*this);
+    *this = std::move(bigger);
+}
+
+void npy::GroupTable::merge(const GroupTable& other)
+{
+    if (other.n_values != n_values)
+        throw std::runtime_error("GroupTable: cannot merge tables with different value counts");
+    for (size_t i = 0; i < other.keys.size(); ++i) {
+        if (!other.used[i])
+            continue;
+        const double* b = other.acc.data() + i * stride;
+        double* a = find_or_insert(other.keys[i]);
+        a[0] += b[0];
+        for (size_t v = 0; v < n_values; ++v) {
+            a[1 + 3 * v] += b[1 + 3 * v];
+            a[2 + 3 * v] = std::min(a[2 + 3 * v], b[2 + 3 * v]);
+            a[3 + 3 * v] = std::max(a[3 + 3 * v], b[3 + 3 * v]);
+        }
+    }
+}
+
+auto npy::GroupTable::results(const std::vector<Agg>& aggs, const bool sorted) const
+        -> Eigen::Matrix<double, -1, -1, Eigen::RowMajor>
+{
+    std::vector<size_t> slots;
+    slots.reserve(n_groups);
+    for (size_t i = 0; i < keys.size(); ++i)
+        if (used[i])
+            slots.push_back(i);
+    if (sorted)
+        std::sort(slots.begin(), slots.end(), [this](const size_t a, const size_t b) { return keys[a] < keys[b]; });
+
+    Eigen::Matrix<double, -1, -1, Eigen::RowMajor> out(slots.size(), 1 + n_values * aggs.size());
+    for (size_t r = 0; r < slots.size(); ++r) {
+        const double* a = acc.data() + slots[r] * stride;
+        out(r, 0) = static_cast<double>(keys[slots[r]]);
+        size_t c = 1;
+        for (size_t v = 0; v < n_values; ++v) {
+            for (const Agg agg: aggs) {
+                switch (agg) {
+                    case Agg::Count: out(r, c) = a[0]; break;
+                    case Agg::Sum: out(r, c) = a[1 + 3 * v]; break;
+                    case Agg::Mean: out(r, c) = a[1 + 3 * v] / a[0]; break;
+                    case Agg::Min: out(r, c) = a[2 + 3 * v]; break;
+                    case Agg::Max: out(r, c) = a[3 + 3 * v]; break;
+                }
+                ++c;
+            }
+        }
+    }
+    return out;
+}
+
+size_t npy::_aggregate_partition(const RowPartitions& parts, const size_t p, const size_t n_values,
+                                 const std::vector<Agg>& aggs, const size_t table_budget, const std::string& spill_dir,
+                                 std::vector<char>& out)
+{
+    const size_t rec = parts.record_size();
+    const size_t size = parts.bytes(p);
+    const size_t piece = std::max(rec, std::min(table_budget / 4, max_read_bytes));
+    // Past the last level (or with nothing to split into) the partition is aggregated whatever its size
+    const bool can_split = parts.level() < max_spill_levels && parts.size() > 1;
+
+    {
+        GroupTable table(n_values);
+        std::vector<double> values(n_values);
+        bool fits = true;
+        for (size_t offset = 0; fits && offset < size;) {
+            const std::vector<char> records = parts.read(p, offset, piece);
+            offset += records.size();
+            for (size_t r = 0; r < records.size(); r += rec) {
+                int64_t key;
+                std::memcpy(&key, &records[r], sizeof(key));
+                std::memcpy(values.data(), &records[r + sizeof(key)], n_values * sizeof(double));
+                table.add(key, values.data());
+                if (can_split && table.bytes() > table_budget) {
+                    fits = false;
+                    break;
+                }
+            }
+        }
+        if (fits) {
+            const auto rows = table.results(aggs, true);
+            const auto bytes = reinterpret_cast<const char*>(rows.data());
+            out.insert(out.end(), bytes, bytes + rows.size() * sizeof(double));
+            return table.size();
+        }
+    }
+
+    // The table is gone by now; the sub-partition buffers take half of its budget, the read pieces a quarter
+    RowPartitions sub(spill_dir, parts.size(), rec - sizeof(int64_t), 1, table_budget / 2, parts.level() + 1);
+    for (size_t offset = 0; offset < size;) {
+        const std::vector<char> records = parts.read(p, offset, piece);
+        offset += records.size();
+        for (size_t r = 0; r < records.size(); r += rec) {
+            int64_t key;
+            std::memcpy(&key, &records[r], sizeof(key));
+            std::memcpy(sub.record(0, key), &records[r + sizeof(key)], rec - sizeof(key));
+        }
+    }
+    sub.flush_all();
+    size_t n_groups = 0;
+    for (size_t q = 0; q < sub.size(); ++q)
+        n_groups += _aggregate_partition(sub, q, n_values, aggs, table_budget, spill_dir, out);
+    return n_groups;
+}
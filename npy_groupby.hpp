@@ -0,0 +1,167 @@
+#ifndef NPY_GROUPBY_H_
+#define NPY_GROUPBY_H_
+
+#include "npy_chunks.hpp"
+#include "npy_partition.hpp"
+#include "npy_writer.hpp"
+
+#include <cstring>
+
+namespace npy {
+
+    enum class Agg { Count, Sum, Mean, Min, Max };
+
+    struct GroupByOptions {
+        size_t chunk_rows = 1 << 14;
+        size_t n_threads = 0;
+        // Bytes of in-memory hash tables (all threads together) before switching to the spilling path
+        size_t memory_budget = size_t{1} << 30;
+        std::string spill_dir = ".";
+        // Number of on-disk hash partitions used by the spilling path, rounded up to a power of two
+        size_t partitions = 64;
+    };
+
+    // Open-addressing (linear probing) table from an int64 key to the accumulators of its group:
+    // the row count followed by sum, min and max of every value column
+    class GroupTable {
+    public:
+        explicit GroupTable(size_t n_values, size_t initial_capacity = 1024);
+
+        void add(int64_t key, const double* values)
+        {
+            double* acc = find_or_insert(key);
+            acc[0] += 1;
+            for (size_t v = 0; v < n_values; ++v) {
+                double* a = acc + 1 + 3 * v;
+                a[0] += values[v];
+                a[1] = std::min(a[1], values[v]);
+                a[2] = std::max(a[2], values[v]);
+            }
+        }
+
+        void merge(const GroupTable& other);
+
+        // One row per group: key followed by the requested aggregates of every value column
+        [[nodiscard]] auto results(const std::vector<Agg>& aggs, bool sorted) const
+                -> Eigen::Matrix<double, -1, -1, Eigen::RowMajor>;
+        [[nodiscard]] size_t size() const { return n_groups; }
+        [[nodiscard]] size_t bytes() const { return keys.size() * (sizeof(int64_t) + 1 + stride * sizeof(double)); }
+
+    private:
+        double* find_or_insert(int64_t key);
+        void grow();
+
+        size_t n_values;
+        size_t stride;
+        size_t n_groups = 0;
+        std::vector<int64_t> keys;
+        std::vector<uint8_t> used;
+        std::vector<double> acc;
+    };
+
+    // Aggregate partition p of parts (records: int64 key + n_values float64) and append the bytes of its
+    // float64 rows, sorted by key, to out; returns the number of groups. A partition whose table outgrows
+    // table_budget is scattered over a RowPartitions of the next hash level whose partitions are then
+    // aggregated one after another.
+    size_t _aggregate_partition(const RowPartitions& parts, size_t p, size_t n_values, const std::vector<Agg>& aggs,
+                                size_t table_budget, const std::string& spill_dir, std::vector<char>& out);
+
+    struct _GroupBySpill {};
+
+    // Group the rows of a 2D npy file by the integer value of column key_col and write one float64 row per
+    // group to out_file: the key followed by each of `aggs` for every other column, column-major over aggs.
+    // Each thread aggregates into its own hash table. When the tables outgrow the memory budget the pass is
+    // restarted on the spilling path: rows are radix-partitioned by key hash into temporary files, whose write
+    // buffers share the budget, and every thread aggregates one partition at a time within its share of the
+    // budget, re-partitioning partitions that do not fit. The order of the output rows is unspecified and
+    // differs between the two paths; sort on the key column when it matters. Keys beyond 2^53 lose precision
+    // in the float64 output.
+    template<typename T>
+    auto group_by(const std::string& in_file, const size_t key_col, const std::vector<Agg>& aggs,
+                  const std::string& out_file, const GroupByOptions& opt = GroupByOptions()) -> size_t
+    {
+        const MappedNpy arr(in_file);
+        const size_t cols = _num_cols(arr);
+        if (key_col >= cols)
+            throw std::runtime_error("group_by: key column out of range for " + in_file);
+        std::vector<size_t> value_cols;
+        for (size_t j = 0; j < cols; ++j)
+            if (j != key_col)
+                value_cols.push_back(j);
+        const size_t n_values = value_cols.size();
+
+        const size_t workers = _resolve_threads(opt.n_threads);
+        const size_t worker_budget = opt.memory_budget / workers;
+        std::vector<std::unique_ptr<GroupTable>> tables(workers);
+        std::vector<std::vector<double>> values(workers, std::vector<double>(n_values));
+
+        bool spill = false;
+        try {
+            for_each_row_chunk_worker<T>(
+                    arr, opt.chunk_rows,
+                    [&](const size_t worker, size_t, const auto& block) {
+                        if (!tables[worker])
+                            tables[worker].reset(new GroupTable(n_values));
+                        GroupTable& t = *tables[worker];
+                        double* v = values[worker].data();
+                        for (Eigen::Index i = 0; i < block.rows(); ++i) {
+                            for (size_t k = 0; k < n_values; ++k)
+                                v[k] = static_cast<double>(block(i, value_cols[k]));
+                            t.add(static_cast<int64_t>(block(i, key_col)), v);
+                        }
+                        if (t.bytes() > worker_budget)
+                            throw _GroupBySpill();
+                    },
+                    opt.n_threads);
+        } catch (const _GroupBySpill&) {
+            spill = true;
+        }
+
+        NpyStreamWriter writer(out_file, "<f8", {1 + n_values * aggs.size()});
+        if (!spill) {
+            GroupTable merged(n_values);
+            for (const auto& t: tables)
+                if (t)
+                    merged.merge(*t);
+            writer.append(merged.results(aggs, true));
+            writer.close();
+            return merged.size();
+        }
+        tables.clear();
+
+        RowPartitions parts(opt.spill_dir, opt.partitions, n_values * sizeof(double), workers, opt.memory_budget);
+        for_each_row_chunk_worker<T>(
+                arr, opt.chunk_rows,
+                [&](const size_t worker, size_t, const auto& block) {
+                    for (Eigen::Index i = 0; i < block.rows(); ++i) {
+                        char* dst = parts.record(worker, static_cast<int64_t>(block(i, key_col)));
+                        for (size_t k = 0; k < n_values; ++k) {
+                            const auto v = static_cast<double>(block(i, value_cols[k]));
+                            std::memcpy(dst + k * sizeof(double), &v, sizeof(double));
+                        }
+                    }
+                },
+                opt.n_threads);
+        parts.flush_all();
+
+        // Workers run at most `workers` partitions ahead of the next one written, bounding the rows held back
+        std::atomic<size_t> n_groups{0};
+        OrderedChunkSink sink(writer, workers);
+        parallel_for(parts.size(), opt.n_threads, [&](const size_t p) {
+            try {
+                std::vector<char> rows;
+                const size_t n = _aggregate_partition(parts, p, n_values, aggs, worker_budget, opt.spill_dir, rows);
+                sink.put(p, std::move(rows), n);
+                n_groups += n;
+            } catch (...) {
+                sink.abort();
+                throw;
+            }
+        });
+        writer.close();
+        return n_groups;
+    }
+
+} // namespace npy
+
+#endif
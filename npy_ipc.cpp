@@ -0,0 +1,242 @@
+#include "npy_ipc.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+    constexpr size_t max_ndim = 8;
+
+    // Fixed-size reply sent along with the descriptor
+    struct Reply {
+        int32_t status;
+        uint32_t ndim;
+        uint64_t shape[max_ndim];
+        uint64_t word_size;
+        uint64_t data_offset;
+        uint8_t fortran_order;
+        char descr[8];
+        char error[128];
+    };
+
+    auto socket_address(const std::string& path) -> sockaddr_un
+    {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path))
+            throw std::runtime_error("npy_ipc: socket path too long: " + path);
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        return addr;
+    }
+
+    void send_all(const int fd, const void* data, size_t n)
+    {
+        auto p = static_cast<const char*>(data);
+        while (n > 0) {
+            const ssize_t k = send(fd, p, n, MSG_NOSIGNAL);
+            if (k <= 0)
+                throw std::runtime_error("npy_ipc: failed send");
+            p += k;
+            n -= static_cast<size_t>(k);
+        }
+    }
+
+    void recv_all(const int fd, void* data, size_t n)
+    {
+        auto p = static_cast<char*>(data);
+        while (n > 0) {
+            const ssize_t k = recv(fd, p, n, 0);
+            if (k <= 0)
+                throw std::runtime_error("npy_ipc: failed recv");
+            p += k;
+            n -= static_cast<size_t>(k);
+        }
+    }
+
+    // Send the reply, attaching fd as ancillary data when it is valid
+    void send_reply(const int sock, const Reply& reply, const int fd)
+    {
+        iovec iov{const_cast<Reply*>(&reply), sizeof(reply)};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+
+        char control[CMSG_SPACE(sizeof(int))] = {};
+        if (fd >= 0) {
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+        }
+        if (sendmsg(sock, &msg, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(reply)))
+            throw std::runtime_error("npy_ipc: failed sendmsg");
+    }
+
+    auto recv_reply(const int sock, Reply& reply) -> int
+    {
+        iovec iov{&reply, sizeof(reply)};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        char control[CMSG_SPACE(sizeof(int))] = {};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(sock, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC) != static_cast<ssize_t>(sizeof(reply)))
+            throw std::runtime_error("npy_ipc: failed recvmsg");
+
+        int fd = -1;
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+                std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        return fd;
+    }
+
+} // namespace
+
+npy::ArraySocketServer::ArraySocketServer(const std::string& socket_path, const std::string& root_dir) :
+    socket_path(socket_path), root_dir(root_dir)
+{
+    const sockaddr_un addr = socket_address(socket_path);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+        throw std::runtime_error("ArraySocketServer: failed to create socket");
+    unlink(socket_path.c_str());
+    if (bind(listen_fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listen_fd, 64) != 0) {
+        close(listen_fd);
+        throw std::runtime_error("ArraySocketServer: failed to listen on " + socket_path);
+    }
+}
+
+npy::ArraySocketServer::~ArraySocketServer()
+{
+    for (auto& kv: cache)
+        close(kv.second.fd);
+    if (listen_fd >= 0)
+        close(listen_fd);
+    unlink(socket_path.c_str());
+}
+
+void npy::ArraySocketServer::serve()
+{
+    running = true;
+    while (running) {
+        const int client = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        try {
+            handle(client);
+        } catch (const std::exception& e) {
+            std::cerr << "ArraySocketServer: " << e.what() << std::endl;
+        }
+        close(client);
+    }
+}
+
+void npy::ArraySocketServer::stop()
+{
+    running = false;
+    // Wake up a blocked accept()
+    shutdown(listen_fd, SHUT_RDWR);
+}
+
+auto npy::ArraySocketServer::lookup(const std::string& name) -> const Entry&
+{
+    const auto it = cache.find(name);
+    if (it != cache.end())
+        return it->second;
+
+    if (name.empty() || name[0] == '/' || name.find("..") != std::string::npos)
+        throw std::runtime_error("invalid array name: " + name);
+
+    const std::string fname = root_dir + "/" + name;
+    Entry entry{-1, npy_read_header(fname)};
+    if (entry.header.shape.size() > max_ndim || entry.header.descr.size() >= sizeof(Reply::descr))
+        throw std::runtime_error("unsupported header in " + fname);
+    entry.fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+    if (entry.fd < 0)
+        throw std::runtime_error("Unable to open file " + fname);
+    return cache.emplace(name, entry).first->second;
+}
+
+void npy::ArraySocketServer::handle(const int client_fd)
+{
+    uint32_t len = 0;
+    recv_all(client_fd, &len, sizeof(len));
+    if (len > 4096)
+        throw std::runtime_error("request name too long");
+    std::string name(len, '\0');
+    recv_all(client_fd, &name[0], len);
+
+    Reply reply{};
+    int fd = -1;
+    try {
+        const Entry& e = lookup(name);
+        reply.ndim = static_cast<uint32_t>(e.header.shape.size());
+        for (size_t i = 0; i < e.header.shape.size(); ++i)
+            reply.shape[i] = e.header.shape[i];
+        reply.word_size = e.header.word_size;
+        reply.data_offset = e.header.data_offset;
+        reply.fortran_order = e.header.fortran_order;
+        std::strncpy(reply.descr, e.header.descr.c_str(), sizeof(reply.descr) - 1);
+        fd = e.fd;
+    } catch (const std::exception& ex) {
+        reply.status = -1;
+        std::strncpy(reply.error, ex.what(), sizeof(reply.error) - 1);
+    }
+    send_reply(client_fd, reply, fd);
+}
+
+auto npy::ipc_load(const std::string& socket_path, const std::string& name) -> MappedNpy
+{
+    const sockaddr_un addr = socket_address(socket_path);
+    const int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        throw std::runtime_error("ipc_load: failed to create socket");
+
+    Reply reply{};
+    int fd = -1;
+    try {
+        if (connect(sock, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0)
+            throw std::runtime_error("ipc_load: Unable to connect to " + socket_path);
+        const auto len = static_cast<uint32_t>(name.size());
+        send_all(sock, &len, sizeof(len));
+        send_all(sock, name.data(), name.size());
+        fd = recv_reply(sock, reply);
+    } catch (...) {
+        close(sock);
+        throw;
+    }
+    close(sock);
+
+    if (reply.status != 0 || fd < 0) {
+        if (fd >= 0)
+            close(fd);
+        throw std::runtime_error("ipc_load: server refused " + name + ": " + std::string(reply.error));
+    }
+
+    NpyHeader h;
+    h.shape.assign(reply.shape, reply.shape + reply.ndim);
+    h.word_size = reply.word_size;
+    h.data_offset = reply.data_offset;
+    h.fortran_order = reply.fortran_order != 0;
+    h.descr = reply.descr;
+    try {
+        MappedNpy arr(fd, h);
+        close(fd);
+        return arr;
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef NPY_IPC_H_
+#define NPY_IPC_H_
+
+#include "npy_mmap.hpp"
+
+#include <atomic>
+
+namespace npy {
+
+    // Local array server: opens each npy file under root_dir once and hands its descriptor plus the parsed
+    // header to clients over a Unix domain socket (SCM_RIGHTS). Clients map the descriptor themselves, so
+    // every process shares the same page cache pages and no payload byte crosses the socket.
+    class ArraySocketServer {
+    public:
+        ArraySocketServer(const std::string& socket_path, const std::string& root_dir);
+        ~ArraySocketServer();
+
+        ArraySocketServer(const ArraySocketServer&) = delete;
+        ArraySocketServer& operator=(const ArraySocketServer&) = delete;
+
+        // Accept and answer requests until stop() is called
+        void serve();
+        void stop();
+
+    private:
+        struct Entry {
+            int fd;
+            NpyHeader header;
+        };
+
+        auto lookup(const std::string& name) -> const Entry&;
+        void handle(int client_fd);
+
+        std::string socket_path;
+        std::string root_dir;
+        int listen_fd = -1;
+        std::atomic<bool> running{false};
+        std::map<std::string, Entry> cache;
+    };
+
+    // Ask the server at socket_path for `name` (relative to its root) and map the received descriptor
+    auto ipc_load(const std::string& socket_path, const std::string& name) -> MappedNpy;
+
+} // namespace npy
+
+#endif
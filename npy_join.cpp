@@ -0,0 +1,21 @@
+#include "npy_join.hpp"
+
+npy::JoinIndex::JoinIndex(const std::vector<int64_t>& keys) : next(keys.size(), -1)
+{
+    size_t cap = 16;
+    while (cap < 2 * keys.size())
+        cap *= 2;
+    table_keys.resize(cap);
+    heads.assign(cap, -1);
+
+    // Insert in reverse so every chain lists its rows in ascending order
+    const size_t mask = cap - 1;
+    for (size_t r = keys.size(); r-- > 0;) {
+        size_t i = _mix64(static_cast<uint64_t>(keys[r])) & mask;
+        while (heads[i] >= 0 && table_keys[i] != keys[r])
+            i = (i + 1) & mask;
+        table_keys[i] = keys[r];
+        next[r] = heads[i];
+        heads[i] = static_cast<int64_t>(r);
+    }
+}
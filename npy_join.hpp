@@ -0,0 +1,337 @@
+#ifndef NPY_JOIN_H_
+#define NPY_JOIN_H_
+
+#include "npy_chunks.hpp"
+#include "npy_partition.hpp"
+#include "npy_writer.hpp"
+
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+namespace npy {
+
+    enum class JoinType { Inner, Left };
+
+    struct JoinOptions {
+        JoinType type = JoinType::Inner;
+        // Columns copied from each side into the output (left ones first); empty = every non-key column
+        std::vector<size_t> left_cols;
+        std::vector<size_t> right_cols;
+        // Value of the right-hand columns for unmatched rows of a left join; must be set to a representable
+        // integer for left joins of integer tables
+        double fill = std::numeric_limits<double>::quiet_NaN();
+        // Bytes the in-memory hash index may use before both sides are radix-partitioned to disk
+        size_t memory_budget = size_t{1} << 30;
+        std::string spill_dir = ".";
+        // Minimum number of on-disk partitions; raised so that each thread's partition pair fits its share of
+        // the memory budget
+        size_t partitions = 64;
+        size_t chunk_rows = 1 << 14;
+        size_t n_threads = 0;
+    };
+
+    // Hash index from int64 key to the rows holding it: open-addressing table of distinct keys whose slots
+    // head a chain of rows in ascending order
+    class JoinIndex {
+    public:
+        explicit JoinIndex(const std::vector<int64_t>& keys);
+
+        template<typename F>
+        void for_each_match(const int64_t key, F&& f) const
+        {
+            const size_t mask = table_keys.size() - 1;
+            for (size_t i = _mix64(static_cast<uint64_t>(key)) & mask; heads[i] >= 0; i = (i + 1) & mask) {
+                if (table_keys[i] != key)
+                    continue;
+                for (int64_t r = heads[i]; r >= 0; r = next[static_cast<size_t>(r)])
+                    f(static_cast<size_t>(r));
+                return;
+            }
+        }
+
+        // Approximate bytes used per indexed row
+        static constexpr size_t bytes_per_row = 48;
+
+    private:
+        std::vector<int64_t> table_keys;
+        std::vector<int64_t> heads;
+        std::vector<int64_t> next;
+    };
+
+    template<typename T>
+    T _element(const MappedNpy& arr, const size_t row, const size_t col)
+    {
+        const size_t rows = arr.shape()[0];
+        const size_t cols = arr.shape()[1];
+        return arr.fortran_order() ? arr.data<T>()[col * rows + row] : arr.data<T>()[row * cols + col];
+    }
+
+    // fill converted to T; NaN or out-of-range fills are only accepted when they can never be written
+    template<typename T>
+    T _join_fill(const JoinOptions& opt)
+    {
+        if (std::is_floating_point<T>::value)
+            return static_cast<T>(opt.fill);
+        const double lo = static_cast<double>(std::numeric_limits<T>::lowest());
+        const double hi = static_cast<double>(std::numeric_limits<T>::max()) + 1.0;
+        if (opt.fill >= lo && opt.fill < hi)
+            return static_cast<T>(opt.fill);
+        if (opt.type == JoinType::Left)
+            throw std::runtime_error("hash_join: left joins of integer tables need an integer fill value");
+        return T{};
+    }
+
+    template<typename T>
+    auto _key_column(const MappedNpy& arr, const size_t key_col, const size_t n_threads) -> std::vector<int64_t>
+    {
+        std::vector<int64_t> keys(_num_rows(arr));
+        for_each_row_chunk<T>(
+                arr, 1 << 16,
+                [&](const size_t offset, const auto& block) {
+                    for (Eigen::Index i = 0; i < block.rows(); ++i)
+                        keys[offset + static_cast<size_t>(i)] = static_cast<int64_t>(block(i, key_col));
+                },
+                n_threads);
+        return keys;
+    }
+
+    // Join of one pair of radix partitions. Records hold the int64 key, the uint64 row number in its table and
+    // the selected columns of one side. A pair whose right side, with its hash index, would exceed budget is
+    // scattered again over partitions of the next hash level, which are joined one after another.
+    template<typename T>
+    struct _PartitionJoin {
+        size_t nl = 0, nr = 0;
+        bool left_join = false;
+        T fill{};
+        size_t budget = 0;
+        std::string spill_dir;
+
+        // Append the bytes of the output rows to out, ordered by left row and, for each left row, by right
+        // row; returns their number
+        size_t run(const RowPartitions& lp, const RowPartitions& rp, const size_t p, std::vector<char>& out) const
+        {
+            // Largest piece of a left partition read at once, and the re-partitioning depth after which a pair
+            // is joined in memory whatever its size
+            constexpr size_t max_read_bytes = 4 << 20;
+            constexpr unsigned max_levels = 4;
+            const size_t l_rec = lp.record_size(), r_rec = rp.record_size();
+            const size_t n_right = rp.bytes(p) / r_rec;
+            const size_t need = n_right * (r_rec + JoinIndex::bytes_per_row);
+            const size_t piece = std::max(l_rec, std::min(budget / 4, max_read_bytes));
+            if (need > budget && n_right > 1 && rp.level() < max_levels) {
+                // No more sub-partitions than needed to fit, nor than there are records to spread
+                const size_t fanout = std::min({rp.size(), n_right, 2 * need / budget + 1});
+                RowPartitions lsub(spill_dir, fanout, l_rec - sizeof(int64_t), 1, budget / 2, lp.level() + 1);
+                RowPartitions rsub(spill_dir, fanout, r_rec - sizeof(int64_t), 1, budget / 2, rp.level() + 1);
+                split(lp, p, lsub, piece);
+                split(rp, p, rsub, piece);
+                size_t n = 0;
+                for (size_t q = 0; q < lsub.size(); ++q)
+                    n += run(lsub, rsub, q, out);
+                return n;
+            }
+
+            // Index the right records in row order, so every key's matches come out by ascending right row
+            const std::vector<char> rrecs = rp.read(p);
+            std::vector<std::pair<uint64_t, size_t>> by_row(n_right);
+            for (size_t r = 0; r < n_right; ++r) {
+                std::memcpy(&by_row[r].first, &rrecs[r * r_rec + sizeof(int64_t)], sizeof(uint64_t));
+                by_row[r].second = r;
+            }
+            std::sort(by_row.begin(), by_row.end());
+            std::vector<int64_t> rkeys(n_right);
+            for (size_t r = 0; r < n_right; ++r)
+                std::memcpy(&rkeys[r], &rrecs[by_row[r].second * r_rec], sizeof(int64_t));
+            const JoinIndex index(rkeys);
+            rkeys = std::vector<int64_t>();
+
+            // Probe with the left records in pieces; the output is put in left row order at the end
+            const size_t out_cols = nl + nr;
+            std::vector<T> rows;
+            std::vector<std::pair<uint64_t, size_t>> order; // (left row, output row)
+            const size_t size = lp.bytes(p);
+            for (size_t offset = 0; offset < size;) {
+                const std::vector<char> lrecs = lp.read(p, offset, piece);
+                offset += lrecs.size();
+                for (size_t at = 0; at < lrecs.size(); at += l_rec) {
+                    const char* lrow = &lrecs[at];
+                    int64_t key;
+                    uint64_t row;
+                    std::memcpy(&key, lrow, sizeof(key));
+                    std::memcpy(&row, lrow + sizeof(key), sizeof(row));
+                    const auto emit = [&](const char* rrow) {
+                        order.emplace_back(row, order.size());
+                        const size_t o = rows.size();
+                        rows.resize(o + out_cols, fill);
+                        std::memcpy(&rows[o], lrow + 2 * sizeof(uint64_t), nl * sizeof(T));
+                        if (rrow)
+                            std::memcpy(&rows[o + nl], rrow + 2 * sizeof(uint64_t), nr * sizeof(T));
+                    };
+                    const size_t before = order.size();
+                    index.for_each_match(key, [&](const size_t r) { emit(&rrecs[by_row[r].second * r_rec]); });
+                    if (order.size() == before && left_join)
+                        emit(nullptr);
+                }
+            }
+            // Stable, so the matches of one left row keep their right row order
+            std::stable_sort(order.begin(), order.end(),
+                             [](const auto& a, const auto& b) { return a.first < b.first; });
+            const size_t row_bytes = out_cols * sizeof(T);
+            const size_t at = out.size();
+            out.resize(at + order.size() * row_bytes);
+            for (size_t i = 0; i < order.size(); ++i)
+                std::memcpy(&out[at + i * row_bytes], &rows[order[i].second * out_cols], row_bytes);
+            return order.size();
+        }
+
+        static void split(const RowPartitions& from, const size_t p, RowPartitions& to, const size_t piece)
+        {
+            const size_t rec = from.record_size();
+            const size_t size = from.bytes(p);
+            for (size_t offset = 0; offset < size;) {
+                const std::vector<char> records = from.read(p, offset, piece);
+                offset += records.size();
+                for (size_t r = 0; r < records.size(); r += rec) {
+                    int64_t key;
+                    std::memcpy(&key, &records[r], sizeof(key));
+                    std::memcpy(to.record(0, key), &records[r + sizeof(key)], rec - sizeof(key));
+                }
+            }
+            to.flush_all();
+        }
+    };
+
+    // Join two 2D npy tables of element type T on integer key columns and write the selected left columns
+    // followed by the selected right columns of every matching pair to out_file (T, C order).
+    // The hash index is built on the smaller side for inner joins and on the right side for left joins; the
+    // other side is probed in parallel row chunks and the output keeps the probe side's row order. When the
+    // index would exceed the memory budget, both sides are radix-partitioned by key hash into temporary
+    // files, enough partitions for every thread to join one pair within its share of the budget, and each
+    // pair is joined in memory. The output then comes partition by partition, in partition order, and within
+    // a partition by left row and then right row; the partitioning depends on the budget and thread count,
+    // so the same settings always give the same file.
+    // Returns the number of output rows.
+    template<typename T>
+    auto hash_join(const std::string& left_file, const size_t left_key, const std::string& right_file,
+                   const size_t right_key, const std::string& out_file, JoinOptions opt = JoinOptions()) -> size_t
+    {
+        const MappedNpy left(left_file), right(right_file);
+        if (left.header().descr != _npy_descr<T>() || right.header().descr != _npy_descr<T>())
+            throw std::runtime_error("hash_join: tables hold " + left.header().descr + " and " +
+                                     right.header().descr + ", expected " + _npy_descr<T>());
+        if (left_key >= _num_cols(left) || right_key >= _num_cols(right))
+            throw std::runtime_error("hash_join: key column out of range");
+        const auto all_but = [](const size_t cols, const size_t key) {
+            std::vector<size_t> v;
+            for (size_t j = 0; j < cols; ++j)
+                if (j != key)
+                    v.push_back(j);
+            return v;
+        };
+        if (opt.left_cols.empty())
+            opt.left_cols = all_but(_num_cols(left), left_key);
+        if (opt.right_cols.empty())
+            opt.right_cols = all_but(_num_cols(right), right_key);
+        const size_t nl = opt.left_cols.size();
+        const size_t nr = opt.right_cols.size();
+        const size_t out_cols = nl + nr;
+        const T fill = _join_fill<T>(opt);
+
+        NpyStreamWriter writer(out_file, _npy_descr<T>(), {out_cols});
+        const bool build_left = opt.type == JoinType::Inner && _num_rows(left) < _num_rows(right);
+        const MappedNpy& build = build_left ? left : right;
+        const MappedNpy& probe = build_left ? right : left;
+        const size_t build_key = build_left ? left_key : right_key;
+        const size_t probe_key = build_left ? right_key : left_key;
+
+        if (_num_rows(build) * JoinIndex::bytes_per_row <= opt.memory_budget) {
+            const JoinIndex index(_key_column<T>(build, build_key, opt.n_threads));
+            OrderedChunkSink sink(writer);
+            for_each_row_chunk<T>(
+                    probe, opt.chunk_rows,
+                    [&](const size_t offset, const auto& block) {
+                        std::vector<T> out;
+                        size_t n = 0;
+                        const auto emit = [&](const Eigen::Index i, const size_t b) {
+                            // i: probe row within the block, b: build row (or SIZE_MAX when unmatched)
+                            for (size_t c = 0; c < nl; ++c)
+                                out.push_back(build_left ? _element<T>(build, b, opt.left_cols[c])
+                                                         : block(i, opt.left_cols[c]));
+                            for (size_t c = 0; c < nr; ++c)
+                                out.push_back(build_left ? block(i, opt.right_cols[c])
+                                                         : b == SIZE_MAX ? fill
+                                                                         : _element<T>(build, b, opt.right_cols[c]));
+                            ++n;
+                        };
+                        for (Eigen::Index i = 0; i < block.rows(); ++i) {
+                            const size_t before = n;
+                            index.for_each_match(static_cast<int64_t>(block(i, probe_key)),
+                                                 [&](const size_t b) { emit(i, b); });
+                            if (n == before && opt.type == JoinType::Left)
+                                emit(i, SIZE_MAX);
+                        }
+                        std::vector<char> bytes(out.size() * sizeof(T));
+                        std::memcpy(bytes.data(), out.data(), bytes.size());
+                        sink.put(offset / opt.chunk_rows, std::move(bytes), n);
+                    },
+                    opt.n_threads);
+            writer.close();
+            return writer.rows();
+        }
+
+        // Radix-partitioned path: records are key, row number and the selected columns of one side
+        const size_t workers = _resolve_threads(opt.n_threads);
+        constexpr size_t max_partitions = 256;
+        _PartitionJoin<T> job;
+        job.nl = nl;
+        job.nr = nr;
+        job.left_join = opt.type == JoinType::Left;
+        job.fill = fill;
+        job.budget = std::max<size_t>(opt.memory_budget / workers, 1);
+        job.spill_dir = opt.spill_dir;
+        const size_t r_rec = 2 * sizeof(uint64_t) + nr * sizeof(T);
+        const size_t right_bytes = _num_rows(right) * (r_rec + JoinIndex::bytes_per_row);
+        const size_t n_parts = std::min(max_partitions, std::max(opt.partitions, 2 * right_bytes / job.budget + 1));
+        RowPartitions lp(opt.spill_dir, n_parts, sizeof(uint64_t) + nl * sizeof(T), workers, opt.memory_budget);
+        RowPartitions rp(opt.spill_dir, n_parts, sizeof(uint64_t) + nr * sizeof(T), workers, opt.memory_budget);
+        const auto scatter = [&](const MappedNpy& arr, const size_t key, const std::vector<size_t>& cols,
+                                 RowPartitions& parts) {
+            for_each_row_chunk_worker<T>(
+                    arr, opt.chunk_rows,
+                    [&](const size_t worker, const size_t offset, const auto& block) {
+                        for (Eigen::Index i = 0; i < block.rows(); ++i) {
+                            char* dst = parts.record(worker, static_cast<int64_t>(block(i, key)));
+                            const uint64_t row = offset + static_cast<size_t>(i);
+                            std::memcpy(dst, &row, sizeof(row));
+                            for (size_t c = 0; c < cols.size(); ++c) {
+                                const T v = block(i, cols[c]);
+                                std::memcpy(dst + sizeof(row) + c * sizeof(T), &v, sizeof(T));
+                            }
+                        }
+                    },
+                    opt.n_threads);
+            parts.flush_all();
+        };
+        scatter(left, left_key, opt.left_cols, lp);
+        scatter(right, right_key, opt.right_cols, rp);
+
+        // Workers run at most `workers` partitions ahead of the next one written, bounding the rows held back
+        OrderedChunkSink sink(writer, workers);
+        parallel_for(lp.size(), opt.n_threads, [&](const size_t p) {
+            try {
+                std::vector<char> rows;
+                const size_t n = job.run(lp, rp, p, rows);
+                sink.put(p, std::move(rows), n);
+            } catch (...) {
+                sink.abort();
+                throw;
+            }
+        });
+        writer.close();
+        return writer.rows();
+    }
+
+} // namespace npy
+
+#endif
@@ -0,0 +1,344 @@
+#include "npy_lossy.hpp"
+
+#include <fcntl.h>
+#include <queue>
+#include <unistd.h>
+
+namespace {
+
+    constexpr char lossy_magic[8] = {'N', 'P', 'Y', 'L', 'O', 'S', 'S', 'Y'};
+    constexpr uint32_t lossy_version = 1;
+    // magic, version, descr, ndim, shape, block, error bound, block count
+    constexpr size_t lossy_header_size = 8 + 4 + 4 + 4 + 3 * 8 + 3 * 8 + 8 + 8;
+    // Huffman codes up to this length are decoded with a single table lookup
+    constexpr unsigned lookup_bits = 11;
+
+    struct CodeEntry {
+        uint16_t symbol;
+        uint8_t length;
+    };
+
+    // Canonical order: by code length, then symbol
+    void sort_canonical(std::vector<CodeEntry>& entries)
+    {
+        std::sort(entries.begin(), entries.end(), [](const CodeEntry& a, const CodeEntry& b) {
+            return a.length != b.length ? a.length < b.length : a.symbol < b.symbol;
+        });
+    }
+
+    template<typename V>
+    void put(std::vector<char>& out, const V v)
+    {
+        const size_t at = out.size();
+        out.resize(at + sizeof(V));
+        std::memcpy(&out[at], &v, sizeof(V));
+    }
+
+    template<typename V>
+    V get(const char*& p, const char* end)
+    {
+        if (end - p < static_cast<std::ptrdiff_t>(sizeof(V)))
+            throw std::runtime_error("_huffman_decode: truncated stream");
+        V v;
+        std::memcpy(&v, p, sizeof(V));
+        p += sizeof(V);
+        return v;
+    }
+
+} // namespace
+
+void npy::_huffman_encode(const std::vector<uint16_t>& symbols, std::vector<char>& out)
+{
+    // Symbol frequencies, and the rank of every position's symbol among the distinct symbols: sorting
+    // (symbol, position) keys yields both
+    std::vector<uint64_t> keyed(symbols.size());
+    for (size_t i = 0; i < symbols.size(); ++i)
+        keyed[i] = uint64_t{symbols[i]} << 32 | i;
+    std::sort(keyed.begin(), keyed.end());
+    std::vector<std::pair<uint16_t, size_t>> freq;
+    std::vector<uint32_t> rank(symbols.size());
+    for (const uint64_t k: keyed) {
+        const auto s = static_cast<uint16_t>(k >> 32);
+        if (freq.empty() || freq.back().first != s)
+            freq.emplace_back(s, 0);
+        ++freq.back().second;
+        rank[static_cast<uint32_t>(k)] = static_cast<uint32_t>(freq.size() - 1);
+    }
+    keyed = std::vector<uint64_t>();
+
+    // Code lengths from the Huffman tree: nodes 0..m-1 are leaves, parents are appended as they are merged
+    const size_t m = freq.size();
+    std::vector<CodeEntry> entries(m);
+    if (m == 1) {
+        entries[0] = {freq[0].first, 1};
+    } else if (m > 1) {
+        std::vector<size_t> parent(2 * m - 1, 0);
+        using Item = std::pair<size_t, size_t>; // (weight, node)
+        std::priority_queue<Item, std::vector<Item>, std::greater<Item>> heap;
+        for (size_t i = 0; i < m; ++i)
+            heap.emplace(freq[i].second, i);
+        for (size_t next = m; heap.size() > 1; ++next) {
+            const Item a = heap.top();
+            heap.pop();
+            const Item b = heap.top();
+            heap.pop();
+            parent[a.second] = parent[b.second] = next;
+            heap.emplace(a.first + b.first, next);
+        }
+        const size_t root = 2 * m - 2;
+        std::vector<uint8_t> depth(2 * m - 1, 0);
+        for (size_t node = root; node-- > 0;)
+            depth[node] = static_cast<uint8_t>(depth[parent[node]] + 1);
+        for (size_t i = 0; i < m; ++i) {
+            if (depth[i] > 32)
+                throw std::runtime_error("_huffman_encode: code length exceeds 32 bits");
+            entries[i] = {freq[i].first, depth[i]};
+        }
+    }
+    sort_canonical(entries);
+
+    put<uint32_t>(out, static_cast<uint32_t>(m));
+    for (const CodeEntry& e: entries) {
+        put<uint16_t>(out, e.symbol);
+        put<uint8_t>(out, e.length);
+    }
+
+    // Canonical codes, indexed by rank (freq is ordered by symbol)
+    std::vector<uint32_t> code(m), length(m);
+    uint32_t c = 0;
+    for (size_t i = 0; i < m; ++i) {
+        if (i > 0)
+            c = (c + 1) << (entries[i].length - entries[i - 1].length);
+        const auto r = static_cast<size_t>(
+                std::lower_bound(freq.begin(), freq.end(), std::make_pair(entries[i].symbol, size_t{0})) -
+                freq.begin());
+        code[r] = c;
+        length[r] = entries[i].length;
+    }
+
+    // MSB-first bit stream, prefixed by its length in bytes
+    const size_t size_at = out.size();
+    put<uint64_t>(out, 0);
+    uint64_t acc = 0;
+    size_t n_bits = 0;
+    for (const uint32_t r: rank) {
+        acc = acc << length[r] | code[r];
+        n_bits += length[r];
+        while (n_bits >= 8) {
+            n_bits -= 8;
+            out.push_back(static_cast<char>(acc >> n_bits));
+        }
+    }
+    if (n_bits > 0)
+        out.push_back(static_cast<char>(acc << (8 - n_bits)));
+    const uint64_t n_bytes = out.size() - size_at - sizeof(uint64_t);
+    std::memcpy(&out[size_at], &n_bytes, sizeof(n_bytes));
+}
+
+void npy::_huffman_decode(const char*& p, const char* end, const size_t n, uint16_t* symbols)
+{
+    const auto m = get<uint32_t>(p, end);
+    std::vector<CodeEntry> entries(m);
+    for (CodeEntry& e: entries) {
+        e.symbol = get<uint16_t>(p, end);
+        e.length = get<uint8_t>(p, end);
+        if (e.length == 0 || e.length > 32)
+            throw std::runtime_error("_huffman_decode: invalid code length");
+    }
+    sort_canonical(entries);
+
+    // First canonical code and first entry of every length
+    uint32_t first_code[34] = {}, first_entry[34] = {}, count[34] = {};
+    for (const CodeEntry& e: entries)
+        ++count[e.length];
+    uint32_t c = 0, at = 0;
+    for (size_t len = 1; len <= 32; ++len) {
+        first_code[len] = c;
+        first_entry[len] = at;
+        c = (c + count[len]) << 1;
+        at += count[len];
+    }
+
+    // Codes of up to `lookup` bits are resolved with one table lookup on the next `lookup` bits: every
+    // slot starting with a code holds its symbol and length; zero slots fall back to a search of the longer
+    // lengths
+    const unsigned lookup = entries.empty() ? 1 : std::min<unsigned>(entries.back().length, lookup_bits);
+    std::vector<uint32_t> table(size_t{1} << lookup, 0);
+    for (uint32_t i = 0; i < m && entries[i].length <= lookup; ++i) {
+        const unsigned len = entries[i].length;
+        const uint32_t code = first_code[len] + (i - first_entry[len]);
+        const uint32_t slot = uint32_t{entries[i].symbol} << 8 | len;
+        std::fill(table.begin() + (static_cast<std::ptrdiff_t>(code) << (lookup - len)),
+                  table.begin() + (static_cast<std::ptrdiff_t>(code + 1) << (lookup - len)), slot);
+    }
+
+    const auto n_bytes = get<uint64_t>(p, end);
+    if (static_cast<uint64_t>(end - p) < n_bytes)
+        throw std::runtime_error("_huffman_decode: truncated stream");
+    const auto bytes = reinterpret_cast<const unsigned char*>(p);
+    // MSB-aligned window of the next `avail` bits; bits past the stream read as zero
+    uint64_t window = 0;
+    unsigned avail = 0;
+    size_t next = 0;
+    for (size_t i = 0; i < n; ++i) {
+        for (; avail <= 56 && next < n_bytes; avail += 8)
+            window |= uint64_t{bytes[next++]} << (56 - avail);
+        unsigned len = 0;
+        const uint32_t slot = table[window >> (64 - lookup)];
+        if (slot != 0) {
+            len = slot & 0xff;
+            symbols[i] = static_cast<uint16_t>(slot >> 8);
+        } else {
+            for (len = lookup + 1; len <= 32; ++len) {
+                const auto code = static_cast<uint32_t>(window >> (64 - len));
+                if (code - first_code[len] < count[len]) {
+                    symbols[i] = entries[first_entry[len] + code - first_code[len]].symbol;
+                    break;
+                }
+            }
+        }
+        if (len > 32 || len > avail)
+            throw std::runtime_error("_huffman_decode: corrupt stream");
+        window <<= len;
+        avail -= len;
+    }
+    p += n_bytes;
+}
+
+void npy::LossyLayout::block_box(const size_t b, std::array<size_t, 3>& origin, std::array<size_t, 3>& extent) const
+{
+    const auto g = grid();
+    const size_t idx[3] = {b / (g[1] * g[2]), b / g[2] % g[1], b % g[2]};
+    for (size_t d = 0; d < 3; ++d) {
+        origin[d] = idx[d] * block[d];
+        extent[d] = std::min(block[d], shape[d] - origin[d]);
+    }
+}
+
+auto npy::_lossy_layout(const std::string& descr, const std::vector<size_t>& shape, const double error_bound)
+        -> LossyLayout
+{
+    if (shape.empty() || shape.size() > 3)
+        throw std::runtime_error("_lossy_layout: only 1D, 2D and 3D arrays are supported");
+    LossyLayout layout;
+    layout.descr = descr;
+    layout.ndim = shape.size();
+    layout.error_bound = error_bound;
+    layout.shape = {1, 1, 1};
+    std::copy(shape.begin(), shape.end(), layout.shape.begin() + static_cast<std::ptrdiff_t>(3 - shape.size()));
+    // About 4096 values per block whatever the rank
+    const size_t edge[3] = {4096, 64, 16};
+    for (size_t d = 0; d < 3; ++d)
+        layout.block[d] = d < 3 - shape.size() ? 1 : edge[shape.size() - 1];
+    return layout;
+}
+
+void npy::_write_lossy(const std::string& fname, const LossyLayout& layout,
+                       const std::vector<std::vector<char>>& blocks)
+{
+    std::vector<char> header(lossy_magic, lossy_magic + sizeof(lossy_magic));
+    put<uint32_t>(header, lossy_version);
+    char descr[4] = {};
+    std::memcpy(descr, layout.descr.data(), std::min<size_t>(layout.descr.size(), sizeof(descr)));
+    header.insert(header.end(), descr, descr + sizeof(descr));
+    put<uint32_t>(header, static_cast<uint32_t>(layout.ndim));
+    for (const size_t s: layout.shape)
+        put<uint64_t>(header, s);
+    for (const size_t s: layout.block)
+        put<uint64_t>(header, s);
+    put<double>(header, layout.error_bound);
+    put<uint64_t>(header, blocks.size());
+    uint64_t end = 0;
+    for (const auto& b: blocks)
+        put<uint64_t>(header, end += b.size());
+
+    const file_ptr fp = _open_file(fname, "wb");
+    if (!fp)
+        throw std::runtime_error("_write_lossy: Unable to open file " + fname);
+    if (fwrite(header.data(), 1, header.size(), fp.get()) != header.size())
+        throw std::runtime_error("_write_lossy: failed fwrite on " + fname);
+    for (const auto& b: blocks)
+        if (fwrite(b.data(), 1, b.size(), fp.get()) != b.size())
+            throw std::runtime_error("_write_lossy: failed fwrite on " + fname);
+}
+
+void npy::compress_npy_lossy(const std::string& in_file, const std::string& out_file, const LossyOptions& opt)
+{
+    const MappedNpy src(in_file);
+    if (src.fortran_order() && src.shape().size() > 1)
+        throw std::runtime_error("compress_npy_lossy: Fortran order is not supported");
+    if (src.header().descr == _npy_descr<float>())
+        save_lossy(out_file, src.data<float>(), src.shape(), opt);
+    else if (src.header().descr == _npy_descr<double>())
+        save_lossy(out_file, src.data<double>(), src.shape(), opt);
+    else
+        throw std::runtime_error("compress_npy_lossy: only float32 and float64 arrays, got " + src.header().descr);
+}
+
+npy::LossyReader::LossyReader(const std::string& fname) : filename(fname)
+{
+    fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("LossyReader: Unable to open file " + fname);
+    try {
+        std::vector<char> header(lossy_header_size);
+        _pread_all(fd, header.data(), header.size(), 0);
+        if (std::memcmp(header.data(), lossy_magic, sizeof(lossy_magic)) != 0)
+            throw std::runtime_error("LossyReader: " + fname + " is not a lossy npy file");
+        const char* p = header.data() + sizeof(lossy_magic);
+        const char* end = header.data() + header.size();
+        if (get<uint32_t>(p, end) != lossy_version)
+            throw std::runtime_error("LossyReader: unsupported version in " + fname);
+        lay.descr = std::string(p, strnlen(p, 4));
+        p += 4;
+        lay.ndim = get<uint32_t>(p, end);
+        for (size_t& s: lay.shape)
+            s = get<uint64_t>(p, end);
+        for (size_t& s: lay.block)
+            s = get<uint64_t>(p, end);
+        lay.error_bound = get<double>(p, end);
+        const auto n_blocks = get<uint64_t>(p, end);
+        if (lay.ndim < 1 || lay.ndim > 3 || n_blocks != lay.num_blocks())
+            throw std::runtime_error("LossyReader: corrupt header in " + fname);
+
+        block_end.resize(n_blocks);
+        _pread_all(fd, block_end.data(), n_blocks * sizeof(uint64_t), lossy_header_size);
+        payload_offset = lossy_header_size + n_blocks * sizeof(uint64_t);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+}
+
+npy::LossyReader::~LossyReader()
+{
+    close(fd);
+}
+
+auto npy::LossyReader::shape() const -> std::vector<size_t>
+{
+    return std::vector<size_t>(lay.shape.end() - static_cast<std::ptrdiff_t>(lay.ndim), lay.shape.end());
+}
+
+void npy::LossyReader::region3(const std::vector<size_t>& begin, const std::vector<size_t>& extent,
+                               std::array<size_t, 3>& b0, std::array<size_t, 3>& ext) const
+{
+    if (begin.size() != lay.ndim || extent.size() != lay.ndim)
+        throw std::runtime_error("LossyReader: region rank does not match " + filename);
+    b0 = {0, 0, 0};
+    ext = {1, 1, 1};
+    const size_t pad = 3 - lay.ndim;
+    for (size_t d = 0; d < lay.ndim; ++d) {
+        b0[pad + d] = begin[d];
+        ext[pad + d] = extent[d];
+        if (begin[d] + extent[d] > lay.shape[pad + d])
+            throw std::runtime_error("LossyReader: region out of bounds in " + filename);
+    }
+}
+
+void npy::LossyReader::read_block(const size_t b, std::vector<char>& bytes) const
+{
+    const uint64_t begin = b == 0 ? 0 : block_end[b - 1];
+    bytes.resize(block_end[b] - begin);
+    _pread_all(fd, bytes.data(), bytes.size(), payload_offset + begin);
+}
@@ -0,0 +1,275 @@
+#ifndef NPY_LOSSY_H_
+#define NPY_LOSSY_H_
+
+#include "npy_mmap.hpp"
+#include "npy_parallel.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace npy {
+
+    // Error-bounded lossy container for 1D-3D float32/float64 arrays (SZ-style):
+    //   "NPYLOSSY" | u32 version | char descr[4] | u32 ndim | u64 shape[3] | u64 block[3] | f64 error_bound |
+    //   u64 n_blocks | u64 block_end[n_blocks] | block payloads
+    // Arrays are padded to 3D with leading size-1 axes and cut into independent blocks (64x64 tiles in 2D,
+    // 16^3 cubes in 3D). Every value is predicted from already reconstructed neighbours in its block
+    // (Lorenzo predictor), the residual is quantized in steps of 2 * error_bound and the codes are Huffman
+    // coded; values that cannot be predicted within the bound are stored verbatim. Each reconstructed value is
+    // within error_bound of the original, and NaN/inf are kept exactly.
+    struct LossyOptions {
+        double error_bound = 1e-4;
+        size_t n_threads = 0;
+    };
+
+    // Quantization codes are 1 .. 2 * lossy_radius - 1; code 0 marks a value stored verbatim
+    constexpr int64_t lossy_radius = 32768;
+
+    // Canonical Huffman coding of a stream of 16-bit symbols, appended to out / read back from p (advanced
+    // past the stream). decode needs n, the number of symbols encoded.
+    void _huffman_encode(const std::vector<uint16_t>& symbols, std::vector<char>& out);
+    void _huffman_decode(const char*& p, const char* end, size_t n, uint16_t* symbols);
+
+    struct LossyLayout {
+        std::string descr;
+        size_t ndim = 0;
+        std::array<size_t, 3> shape{};
+        std::array<size_t, 3> block{};
+        double error_bound = 0;
+
+        [[nodiscard]] std::array<size_t, 3> grid() const
+        {
+            return {(shape[0] + block[0] - 1) / block[0], (shape[1] + block[1] - 1) / block[1],
+                    (shape[2] + block[2] - 1) / block[2]};
+        }
+        [[nodiscard]] size_t num_blocks() const
+        {
+            const auto g = grid();
+            return g[0] * g[1] * g[2];
+        }
+        // Origin and extent of block b, clipped to the array
+        void block_box(size_t b, std::array<size_t, 3>& origin, std::array<size_t, 3>& extent) const;
+    };
+
+    auto _lossy_layout(const std::string& descr, const std::vector<size_t>& shape, double error_bound)
+            -> LossyLayout;
+    void _write_lossy(const std::string& fname, const LossyLayout& layout,
+                      const std::vector<std::vector<char>>& blocks);
+
+    // Lorenzo prediction of the value at (i, j, k) of a block from the reconstructed values r (block extent e)
+    template<typename T>
+    double _lorenzo(const T* r, const std::array<size_t, 3>& e, const size_t i, const size_t j, const size_t k)
+    {
+        const auto at = [&](const size_t a, const size_t b, const size_t c, const bool valid) {
+            return valid ? static_cast<double>(r[(a * e[1] + b) * e[2] + c]) : 0.0;
+        };
+        const bool di = i > 0, dj = j > 0, dk = k > 0;
+        return at(i - di, j, k, di) + at(i, j - dj, k, dj) + at(i, j, k - dk, dk) - at(i - di, j - dj, k, di && dj) -
+               at(i - di, j, k - dk, di && dk) - at(i, j - dj, k - dk, dj && dk) +
+               at(i - di, j - dj, k - dk, di && dj && dk);
+    }
+
+    // Encode one block whose values are gathered into x (C order, extent e)
+    template<typename T>
+    auto _encode_lossy_block(const T* x, const std::array<size_t, 3>& e, const double eb) -> std::vector<char>
+    {
+        const size_t n = e[0] * e[1] * e[2];
+        std::vector<T> recon(n), verbatim;
+        std::vector<uint16_t> codes(n);
+        for (size_t i = 0, at = 0; i < e[0]; ++i)
+            for (size_t j = 0; j < e[1]; ++j)
+                for (size_t k = 0; k < e[2]; ++k, ++at) {
+                    const double v = static_cast<double>(x[at]);
+                    const double pred = _lorenzo(recon.data(), e, i, j, k);
+                    const double q = std::nearbyint((v - pred) / (2 * eb));
+                    if (std::isfinite(v) && std::abs(q) < lossy_radius) {
+                        const T r = static_cast<T>(pred + 2 * eb * q);
+                        if (std::abs(static_cast<double>(r) - v) <= eb) {
+                            codes[at] = static_cast<uint16_t>(static_cast<int64_t>(q) + lossy_radius);
+                            recon[at] = r;
+                            continue;
+                        }
+                    }
+                    codes[at] = 0;
+                    recon[at] = x[at];
+                    verbatim.push_back(x[at]);
+                }
+
+        std::vector<char> out(sizeof(uint64_t) + verbatim.size() * sizeof(T));
+        const uint64_t n_verbatim = verbatim.size();
+        std::memcpy(out.data(), &n_verbatim, sizeof(n_verbatim));
+        std::memcpy(out.data() + sizeof(n_verbatim), verbatim.data(), verbatim.size() * sizeof(T));
+        _huffman_encode(codes, out);
+        return out;
+    }
+
+    template<typename T>
+    void _decode_lossy_block(const char* p, const char* end, const std::array<size_t, 3>& e, const double eb, T* r)
+    {
+        const size_t n = e[0] * e[1] * e[2];
+        uint64_t n_verbatim;
+        if (end - p < static_cast<std::ptrdiff_t>(sizeof(n_verbatim)))
+            throw std::runtime_error("_decode_lossy_block: truncated block");
+        std::memcpy(&n_verbatim, p, sizeof(n_verbatim));
+        const char* verbatim = p + sizeof(n_verbatim);
+        p = verbatim + n_verbatim * sizeof(T);
+        if (p > end)
+            throw std::runtime_error("_decode_lossy_block: truncated block");
+        std::vector<uint16_t> codes(n);
+        _huffman_decode(p, end, n, codes.data());
+
+        size_t v = 0;
+        for (size_t i = 0, at = 0; i < e[0]; ++i)
+            for (size_t j = 0; j < e[1]; ++j)
+                for (size_t k = 0; k < e[2]; ++k, ++at) {
+                    if (codes[at] == 0) {
+                        if (v == n_verbatim)
+                            throw std::runtime_error("_decode_lossy_block: corrupt block");
+                        std::memcpy(&r[at], verbatim + v++ * sizeof(T), sizeof(T));
+                    } else {
+                        const double q = static_cast<double>(static_cast<int64_t>(codes[at]) - lossy_radius);
+                        r[at] = static_cast<T>(_lorenzo(r, e, i, j, k) + 2 * eb * q);
+                    }
+                }
+    }
+
+    // Compress a C-order float/double array of 1-3 dims to fname, encoding blocks in parallel
+    template<typename T>
+    void save_lossy(const std::string& fname, const T* data, const std::vector<size_t>& shape,
+                    const LossyOptions& opt = LossyOptions())
+    {
+        static_assert(std::is_floating_point<T>::value, "save_lossy: only float and double arrays");
+        if (!(opt.error_bound > 0))
+            throw std::runtime_error("save_lossy: error_bound must be positive");
+        const LossyLayout layout = _lossy_layout(_npy_descr<T>(), shape, opt.error_bound);
+        std::vector<std::vector<char>> blocks(layout.num_blocks());
+        parallel_for(blocks.size(), opt.n_threads, [&](const size_t b) {
+            std::array<size_t, 3> o{}, e{};
+            layout.block_box(b, o, e);
+            std::vector<T> x(e[0] * e[1] * e[2]);
+            for (size_t i = 0, at = 0; i < e[0]; ++i)
+                for (size_t j = 0; j < e[1]; ++j, at += e[2])
+                    std::memcpy(&x[at], data + ((o[0] + i) * layout.shape[1] + o[1] + j) * layout.shape[2] + o[2],
+                                e[2] * sizeof(T));
+            blocks[b] = _encode_lossy_block(x.data(), e, opt.error_bound);
+        });
+        _write_lossy(fname, layout, blocks);
+    }
+
+    template<typename T>
+    void save_lossy(const std::string& fname, const Eigen::Matrix<T, -1, -1, Eigen::RowMajor>& mat,
+                    const LossyOptions& opt = LossyOptions())
+    {
+        save_lossy(fname, mat.data(), {static_cast<size_t>(mat.rows()), static_cast<size_t>(mat.cols())}, opt);
+    }
+
+    // Compress a float/double npy file of 1-3 dims (Fortran order is not supported)
+    void compress_npy_lossy(const std::string& in_file, const std::string& out_file,
+                            const LossyOptions& opt = LossyOptions());
+
+    // Random access to a lossy file: only the blocks overlapping a requested region are read and decoded
+    class LossyReader {
+    public:
+        explicit LossyReader(const std::string& fname);
+        ~LossyReader();
+
+        LossyReader(const LossyReader&) = delete;
+        LossyReader& operator=(const LossyReader&) = delete;
+
+        [[nodiscard]] const LossyLayout& layout() const { return lay; }
+        // Shape as saved (1-3 dims)
+        [[nodiscard]] std::vector<size_t> shape() const;
+
+        // Decode the box [begin, begin + extent) (in saved dims) into out, C order, blocks in parallel
+        template<typename T>
+        void read_region(const std::vector<size_t>& begin, const std::vector<size_t>& extent, T* out,
+                         const size_t n_threads = 0) const
+        {
+            if (lay.descr != _npy_descr<T>())
+                throw std::runtime_error("LossyReader: file holds " + lay.descr);
+            std::array<size_t, 3> b0{}, ext{};
+            region3(begin, extent, b0, ext);
+            if (ext[0] * ext[1] * ext[2] == 0)
+                return;
+            const auto g = lay.grid();
+            std::array<size_t, 3> g0{}, gn{};
+            for (size_t d = 0; d < 3; ++d) {
+                g0[d] = b0[d] / lay.block[d];
+                gn[d] = (b0[d] + ext[d] - 1) / lay.block[d] - g0[d] + 1;
+            }
+            parallel_for(gn[0] * gn[1] * gn[2], n_threads, [&](const size_t t) {
+                const size_t b = ((g0[0] + t / (gn[1] * gn[2])) * g[1] + g0[1] + t / gn[2] % gn[1]) * g[2] + g0[2] +
+                                 t % gn[2];
+                std::array<size_t, 3> o{}, e{};
+                lay.block_box(b, o, e);
+                std::vector<char> bytes;
+                read_block(b, bytes);
+                std::vector<T> r(e[0] * e[1] * e[2]);
+                _decode_lossy_block(bytes.data(), bytes.data() + bytes.size(), e, lay.error_bound, r.data());
+
+                // Copy the part of the block inside the region
+                std::array<size_t, 3> lo{}, hi{};
+                for (size_t d = 0; d < 3; ++d) {
+                    lo[d] = std::max(o[d], b0[d]);
+                    hi[d] = std::min(o[d] + e[d], b0[d] + ext[d]);
+                }
+                for (size_t i = lo[0]; i < hi[0]; ++i)
+                    for (size_t j = lo[1]; j < hi[1]; ++j)
+                        std::memcpy(out + ((i - b0[0]) * ext[1] + j - b0[1]) * ext[2] + lo[2] - b0[2],
+                                    &r[((i - o[0]) * e[1] + j - o[1]) * e[2] + lo[2] - o[2]],
+                                    (hi[2] - lo[2]) * sizeof(T));
+            });
+        }
+
+        template<typename T>
+        auto read_all(const size_t n_threads = 0) const -> std::vector<T>
+        {
+            std::vector<T> out(lay.shape[0] * lay.shape[1] * lay.shape[2]);
+            read_region(std::vector<size_t>(lay.ndim, 0), shape(), out.data(), n_threads);
+            return out;
+        }
+
+    private:
+        void region3(const std::vector<size_t>& begin, const std::vector<size_t>& extent,
+                     std::array<size_t, 3>& b0, std::array<size_t, 3>& ext) const;
+        void read_block(size_t b, std::vector<char>& bytes) const;
+
+        std::string filename;
+        int fd = -1;
+        LossyLayout lay;
+        size_t payload_offset = 0;
+        std::vector<uint64_t> block_end;
+    };
+
+    // Decompress a 2D lossy file into an Eigen matrix, decoding blocks in parallel
+    template<typename T, int ORDER = Eigen::RowMajor>
+    auto load_lossy_mat(const std::string& fname, const size_t n_threads = 0) -> Eigen::Matrix<T, -1, -1, ORDER>
+    {
+        const LossyReader reader(fname);
+        if (reader.layout().ndim != 2)
+            throw std::runtime_error("load_lossy_mat: Only 2D arrays can be converted to Eigen matrices.");
+        const auto rows = static_cast<Eigen::Index>(reader.layout().shape[1]);
+        const auto cols = static_cast<Eigen::Index>(reader.layout().shape[2]);
+        Eigen::Matrix<T, -1, -1, Eigen::RowMajor> m(rows, cols);
+        reader.read_region<T>({0, 0}, {static_cast<size_t>(rows), static_cast<size_t>(cols)}, m.data(), n_threads);
+        return m;
+    }
+
+    // Decompress a block-aligned or arbitrary sub-matrix of a 2D lossy file
+    template<typename T>
+    auto load_lossy_block(const std::string& fname, const size_t row, const size_t col, const size_t n_rows,
+                          const size_t n_cols, const size_t n_threads = 0)
+            -> Eigen::Matrix<T, -1, -1, Eigen::RowMajor>
+    {
+        const LossyReader reader(fname);
+        if (reader.layout().ndim != 2)
+            throw std::runtime_error("load_lossy_block: expected a 2D array in " + fname);
+        Eigen::Matrix<T, -1, -1, Eigen::RowMajor> m(n_rows, n_cols);
+        reader.read_region<T>({row, col}, {n_rows, n_cols}, m.data(), n_threads);
+        return m;
+    }
+
+} // namespace npy
+
+#endif
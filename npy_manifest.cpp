@@ -0,0 +1,198 @@
+#include "npy_manifest.hpp"
+#include "npy_utils.hpp"
+
+#include <fcntl.h>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+    constexpr char manifest_magic[] = "# npy_manifest v1";
+
+    auto join_shape(const std::vector<size_t>& shape) -> std::string
+    {
+        std::string out;
+        for (size_t i = 0; i < shape.size(); ++i)
+            out += (i ? "," : "") + std::to_string(shape[i]);
+        return out;
+    }
+
+    auto split_shape(const std::string& str) -> std::vector<size_t>
+    {
+        std::vector<size_t> shape;
+        std::stringstream ss(str);
+        std::string item;
+        while (std::getline(ss, item, ','))
+            shape.push_back(std::stoull(item));
+        return shape;
+    }
+
+    // Validate shard shapes and assign global row offsets
+    void finish_manifest(npy::Manifest& m)
+    {
+        m.rows = 0;
+        for (size_t i = 0; i < m.shards.size(); ++i) {
+            npy::ShardInfo& s = m.shards[i];
+            if (s.shape.size() != 2)
+                throw std::runtime_error("manifest: " + s.path + " is not a 2D array");
+            if (i == 0)
+                m.cols = s.shape[1];
+            else if (s.shape[1] != m.cols || s.descr != m.shards[0].descr ||
+                     s.fortran_order != m.shards[0].fortran_order)
+                throw std::runtime_error("manifest: " + s.path + " does not match the first shard");
+            s.row_offset = m.rows;
+            m.rows += s.shape[0];
+        }
+    }
+
+} // namespace
+
+auto npy::_fnv1a(const char* data, const size_t n, uint64_t h) -> uint64_t
+{
+    for (size_t i = 0; i < n; ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void npy::_read_shard(const ShardInfo& s, const std::vector<_PayloadRun>& runs)
+{
+    const int fd = open(s.path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("_read_shard: Unable to open file " + s.path);
+    uint64_t hash = 14695981039346656037ULL;
+    size_t offset = s.data_offset;
+    try {
+        for (const _PayloadRun& r: runs) {
+            _pread_all(fd, r.dst, r.n, offset);
+            if (s.checksum != 0)
+                hash = _fnv1a(static_cast<const char*>(r.dst), r.n, hash);
+            offset += r.n;
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+    if (s.checksum != 0 && hash != s.checksum)
+        throw std::runtime_error("_read_shard: checksum mismatch in " + s.path);
+}
+
+auto npy::build_manifest(const std::string& folder_name, const std::string& prefix, const int start_i,
+                         const std::string& suffix, const size_t n_threads, const bool with_checksum) -> Manifest
+{
+    Manifest m;
+    struct stat st{};
+    for (int i = start_i;; ++i) {
+        std::string file_name = folder_name + "/" + prefix + std::to_string(i) + suffix;
+        if (stat(file_name.c_str(), &st) != 0)
+            break;
+        ShardInfo s;
+        s.path = std::move(file_name);
+        s.file_size = static_cast<size_t>(st.st_size);
+        s.mtime = static_cast<int64_t>(st.st_mtime);
+        m.shards.push_back(std::move(s));
+    }
+
+    parallel_for(m.shards.size(), n_threads, [&](const size_t i) {
+        ShardInfo& s = m.shards[i];
+        const NpyHeader h = npy_read_header(s.path);
+        s.descr = h.descr;
+        s.shape = h.shape;
+        s.fortran_order = h.fortran_order;
+        s.word_size = h.word_size;
+        s.data_offset = h.data_offset;
+        if (!with_checksum)
+            return;
+
+        file_ptr fp = _open_file(s.path, "rb");
+        if (!fp)
+            throw std::runtime_error("build_manifest: Unable to open file " + s.path);
+        fseek(fp.get(), static_cast<long>(s.data_offset), SEEK_SET);
+        std::vector<char> buffer(1 << 20);
+        uint64_t hash = 14695981039346656037ULL;
+        size_t left = s.word_size;
+        for (const size_t d: s.shape)
+            left *= d;
+        while (left > 0) {
+            const size_t n = fread(buffer.data(), 1, std::min(left, buffer.size()), fp.get());
+            if (n == 0)
+                throw std::runtime_error("build_manifest: " + s.path + " is shorter than its header says");
+            hash = _fnv1a(buffer.data(), n, hash);
+            left -= n;
+        }
+        s.checksum = hash;
+    });
+
+    finish_manifest(m);
+    return m;
+}
+
+void npy::save_manifest(const Manifest& manifest, const std::string& fname)
+{
+    std::ofstream outfile(fname);
+    if (!outfile.is_open())
+        throw std::runtime_error("save_manifest: Unable to open file " + fname);
+
+    outfile << manifest_magic << '\n';
+    for (const ShardInfo& s: manifest.shards) {
+        outfile << s.path << '\t' << s.descr << '\t' << (s.fortran_order ? 1 : 0) << '\t' << join_shape(s.shape) << '\t'
+                << s.word_size << '\t' << s.data_offset << '\t' << s.file_size << '\t' << s.mtime << '\t' << std::hex
+                << s.checksum << std::dec << '\n';
+    }
+    if (!outfile)
+        throw std::runtime_error("save_manifest: failed to write " + fname);
+}
+
+auto npy::load_manifest(const std::string& fname) -> Manifest
+{
+    std::ifstream infile(fname);
+    if (!infile.is_open())
+        throw std::runtime_error("load_manifest: Unable to open file " + fname);
+
+    std::string line;
+    if (!std::getline(infile, line) || line != manifest_magic)
+        throw std::runtime_error("load_manifest: " + fname + " is not an npy manifest");
+
+    Manifest m;
+    while (std::getline(infile, line)) {
+        if (line.empty())
+            continue;
+        std::stringstream ss(line);
+        ShardInfo s;
+        std::string shape;
+        int fortran;
+        std::getline(ss, s.path, '\t');
+        std::getline(ss, s.descr, '\t');
+        ss >> fortran >> shape >> s.word_size >> s.data_offset >> s.file_size >> s.mtime >> std::hex >> s.checksum;
+        if (!ss)
+            throw std::runtime_error("load_manifest: malformed line in " + fname + ": " + line);
+        s.fortran_order = fortran != 0;
+        s.shape = split_shape(shape);
+        m.shards.push_back(std::move(s));
+    }
+
+    finish_manifest(m);
+    return m;
+}
+
+auto npy::manifest_path(const std::string& folder_name, const std::string& prefix, const std::string& suffix)
+        -> std::string
+{
+    return folder_name + "/" + prefix + suffix + ".manifest";
+}
+
+auto npy::stale_shards(const Manifest& manifest) -> std::vector<size_t>
+{
+    std::vector<size_t> stale;
+    struct stat st{};
+    for (size_t i = 0; i < manifest.shards.size(); ++i) {
+        const ShardInfo& s = manifest.shards[i];
+        if (stat(s.path.c_str(), &st) != 0 || static_cast<size_t>(st.st_size) != s.file_size ||
+            static_cast<int64_t>(st.st_mtime) != s.mtime)
+            stale.push_back(i);
+    }
+    return stale;
+}
@@ -0,0 +1,90 @@
+#ifndef NPY_MANIFEST_H_
+#define NPY_MANIFEST_H_
+
+#include "npy_parallel.hpp"
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace npy {
+
+    // Everything needed to read one shard's payload without opening it to parse its header
+    struct ShardInfo {
+        std::string path;
+        std::string descr;
+        std::vector<size_t> shape;
+        bool fortran_order = false;
+        size_t word_size = 0;
+        size_t data_offset = 0;
+        size_t file_size = 0;
+        int64_t mtime = 0;
+        uint64_t checksum = 0; // FNV-1a of the payload, 0 when not computed; verified by manifest2mat
+        size_t row_offset = 0; // first row of this shard in the stacked array
+    };
+
+    // Index of a folder of prefix{i}suffix shards, saved as a small text file next to them
+    struct Manifest {
+        std::vector<ShardInfo> shards;
+        size_t rows = 0;
+        size_t cols = 0;
+    };
+
+    // Discover prefix{i}suffix shards from start_i and scan their headers in parallel
+    auto build_manifest(const std::string& folder_name, const std::string& prefix, int start_i, const std::string& suffix,
+                        size_t n_threads = 0, bool with_checksum = false) -> Manifest;
+    void save_manifest(const Manifest& manifest, const std::string& fname);
+    auto load_manifest(const std::string& fname) -> Manifest;
+    // Where npy_folder2mat looks for the manifest of a folder's prefix{i}suffix shards:
+    // folder_name/{prefix}{suffix}.manifest
+    auto manifest_path(const std::string& folder_name, const std::string& prefix, const std::string& suffix)
+            -> std::string;
+    // Indices of shards whose size or mtime no longer match the manifest
+    auto stale_shards(const Manifest& manifest) -> std::vector<size_t>;
+
+    auto _fnv1a(const char* data, size_t n, uint64_t h = 14695981039346656037ULL) -> uint64_t;
+    // Destination and length of one contiguous run of a shard payload
+    struct _PayloadRun {
+        void* dst;
+        size_t n;
+    };
+    // Open the shard once and pread its payload from data_offset on as consecutive runs; when the shard has a
+    // checksum, the runs must cover the whole payload and their FNV-1a must match it
+    void _read_shard(const ShardInfo& s, const std::vector<_PayloadRun>& runs);
+
+    // Stack every shard of the manifest into one matrix. Reads go straight to each shard's payload offset
+    // and are spread over n_threads threads; C-order shards stack into RowMajor, Fortran-order into ColMajor.
+    // Shards with a checksum in the manifest are verified as they are read.
+    template<typename T, int FORTRAN_ORDER>
+    auto manifest2mat(const Manifest& manifest, const size_t n_threads = 0) -> Eigen::Matrix<T, -1, -1, FORTRAN_ORDER>
+    {
+        Eigen::Matrix<T, -1, -1, FORTRAN_ORDER> eigen_matrix(manifest.rows, manifest.cols);
+        T* data_ptr = eigen_matrix.data();
+
+        for (const ShardInfo& s: manifest.shards) {
+            if (s.fortran_order != (FORTRAN_ORDER == Eigen::ColMajor))
+                throw std::runtime_error("manifest2mat: Matrix order mismatch in " + s.path);
+            if (s.word_size != sizeof(T))
+                throw std::runtime_error("manifest2mat: word size mismatch in " + s.path);
+        }
+
+        parallel_for(manifest.shards.size(), n_threads, [&](const size_t i) {
+            const ShardInfo& s = manifest.shards[i];
+            const size_t rows = s.shape[0];
+            std::vector<_PayloadRun> runs;
+            if (FORTRAN_ORDER == Eigen::RowMajor) {
+                runs.push_back({data_ptr + s.row_offset * manifest.cols, rows * manifest.cols * sizeof(T)});
+            } else {
+                // Each shard column is one contiguous run that lands in the matching column of the result
+                for (size_t j = 0; j < manifest.cols; ++j)
+                    runs.push_back({data_ptr + j * manifest.rows + s.row_offset, rows * sizeof(T)});
+            }
+            _read_shard(s, runs);
+        });
+        return eigen_matrix;
+    }
+
+} // namespace npy
+
+#endif
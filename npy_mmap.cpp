@@ -0,0 +1,172 @@
+#include "npy_mmap.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+    uint64_t le(const unsigned char* p, const size_t n)
+    {
+        uint64_t v = 0;
+        for (size_t i = n; i-- > 0;)
+            v = v << 8 | p[i];
+        return v;
+    }
+
+    struct ZipMember {
+        std::string name;
+        uint64_t method;
+        uint64_t size;
+        uint64_t local_offset;
+    };
+
+    // Central directory of a zip archive, including zip64 sizes and offsets
+    auto zip_members(const int fd, const size_t file_size, const std::string& fname) -> std::vector<ZipMember>
+    {
+        const auto read = [&](const size_t offset, const size_t n) {
+            if (offset + n > file_size)
+                throw std::runtime_error("map_npz: truncated archive " + fname);
+            std::vector<unsigned char> buf(n);
+            npy::_pread_all(fd, buf.data(), n, offset);
+            return buf;
+        };
+
+        // End of central directory record: 22 bytes plus a comment of up to 64 KiB at the end of the file
+        const size_t tail_size = std::min<size_t>(file_size, 22 + 0xffff);
+        const std::vector<unsigned char> tail = read(file_size - tail_size, tail_size);
+        size_t eocd = tail_size < 22 ? SIZE_MAX : tail_size - 22;
+        while (eocd != SIZE_MAX && le(&tail[eocd], 4) != 0x06054b50)
+            eocd = eocd == 0 ? SIZE_MAX : eocd - 1;
+        if (eocd == SIZE_MAX)
+            throw std::runtime_error("map_npz: " + fname + " is not a zip archive");
+        uint64_t n_entries = le(&tail[eocd + 10], 2);
+        uint64_t cd_offset = le(&tail[eocd + 16], 4);
+        if (eocd >= 20 && le(&tail[eocd - 20], 4) == 0x07064b50) { // zip64 end of central directory locator
+            const std::vector<unsigned char> rec = read(le(&tail[eocd - 12], 8), 56);
+            if (le(rec.data(), 4) != 0x06064b50)
+                throw std::runtime_error("map_npz: corrupt zip64 directory in " + fname);
+            n_entries = le(&rec[32], 8);
+            cd_offset = le(&rec[48], 8);
+        }
+
+        std::vector<ZipMember> members;
+        size_t at = cd_offset;
+        for (uint64_t e = 0; e < n_entries; ++e) {
+            const std::vector<unsigned char> h = read(at, 46);
+            if (le(h.data(), 4) != 0x02014b50)
+                throw std::runtime_error("map_npz: corrupt central directory in " + fname);
+            const size_t name_len = le(&h[28], 2), extra_len = le(&h[30], 2), comment_len = le(&h[32], 2);
+            const std::vector<unsigned char> var = read(at + 46, name_len + extra_len);
+            ZipMember m{std::string(var.begin(), var.begin() + static_cast<std::ptrdiff_t>(name_len)), le(&h[10], 2),
+                        le(&h[20], 4), le(&h[42], 4)};
+            const uint64_t uncompressed = le(&h[24], 4);
+            // Fields saturated at 0xffffffff are stored, in order, in the zip64 extra field (id 1)
+            for (size_t x = name_len; x + 4 <= var.size();) {
+                const size_t id = le(&var[x], 2), len = le(&var[x + 2], 2);
+                if (id == 1) {
+                    size_t f = x + 4;
+                    if (uncompressed == 0xffffffff)
+                        f += 8;
+                    if (m.size == 0xffffffff) {
+                        m.size = le(&var[f], 8);
+                        f += 8;
+                    }
+                    if (m.local_offset == 0xffffffff)
+                        m.local_offset = le(&var[f], 8);
+                }
+                x += 4 + len;
+            }
+            members.push_back(m);
+            at += 46 + name_len + extra_len + comment_len;
+        }
+        return members;
+    }
+
+} // namespace
+
+npy::MappedNpy::MappedNpy(const std::string& fname) : hdr(npy_read_header(fname))
+{
+    const int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("MappedNpy: Unable to open file " + fname);
+    try {
+        map_fd(fd, fname);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+
+npy::MappedNpy::MappedNpy(const int fd, const NpyHeader& header) : hdr(header)
+{
+    map_fd(fd, "descriptor " + std::to_string(fd));
+}
+
+void npy::MappedNpy::prefetch(const size_t byte_offset, size_t n_bytes) const
+{
+    if (!payload || byte_offset >= num_bytes())
+        return;
+    n_bytes = std::min(n_bytes, num_bytes() - byte_offset);
+    const auto page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const auto begin = reinterpret_cast<uintptr_t>(payload + byte_offset) / page * page;
+    const auto end = reinterpret_cast<uintptr_t>(payload + byte_offset + n_bytes);
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+}
+
+void npy::MappedNpy::map_fd(const int fd, const std::string& what)
+{
+    num_values = 1;
+    for (const size_t s: hdr.shape)
+        num_values *= s;
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0)
+        throw std::runtime_error("MappedNpy: failed fstat on " + what);
+    const auto file_size = static_cast<size_t>(st.st_size);
+    if (file_size < hdr.data_offset + num_bytes())
+        throw std::runtime_error("MappedNpy: " + what + " is shorter than its header claims");
+
+    void* base = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+        throw std::runtime_error("MappedNpy: failed mmap on " + what);
+    region = std::shared_ptr<void>(base, [file_size](void* p) { munmap(p, file_size); });
+    payload = static_cast<const char*>(base) + hdr.data_offset;
+}
+
+auto npy::map_npz(const std::string& fname) -> std::map<std::string, MappedNpy>
+{
+    file_ptr fp = _open_file(fname, "rb");
+    if (!fp)
+        throw std::runtime_error("map_npz: Unable to open file " + fname);
+    const int fd = fileno(fp.get());
+    struct stat st{};
+    if (fstat(fd, &st) != 0)
+        throw std::runtime_error("map_npz: failed fstat on " + fname);
+
+    std::map<std::string, MappedNpy> arrays;
+    for (const ZipMember& m: zip_members(fd, static_cast<size_t>(st.st_size), fname)) {
+        std::string name = m.name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".npy") == 0)
+            name.resize(name.size() - 4);
+        if (m.method != 0)
+            throw std::runtime_error("map_npz: member " + name + " of " + fname + " is compressed");
+
+        unsigned char local[30];
+        _pread_all(fd, local, sizeof(local), m.local_offset);
+        if (le(local, 4) != 0x04034b50)
+            throw std::runtime_error("map_npz: corrupt local header in " + fname);
+        const size_t start = m.local_offset + 30 + le(&local[26], 2) + le(&local[28], 2);
+
+        // The member is a plain npy file; its payload offset is relative to the start of the archive
+        NpyHeader h;
+        if (fseek(fp.get(), static_cast<long>(start), SEEK_SET) != 0)
+            throw std::runtime_error("map_npz: failed fseek on " + fname);
+        parse_npy_header(fp.get(), h.word_size, h.shape, h.fortran_order, h.descr);
+        h.data_offset = static_cast<size_t>(ftell(fp.get()));
+        arrays.emplace(name, MappedNpy(fd, h));
+    }
+    return arrays;
+}
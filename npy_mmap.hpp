@@ -0,0 +1,60 @@
+#ifndef NPY_MMAP_H_
+#define NPY_MMAP_H_
+
+#include "npy_utils.hpp"
+
+namespace npy {
+
+    // Read-only memory mapping of a whole npy file. Copies share the mapping, which is released with the last copy.
+    class MappedNpy {
+    public:
+        MappedNpy() = default;
+        explicit MappedNpy(const std::string& fname);
+        // Map an already open descriptor whose header has been parsed; fd stays owned by the caller
+        MappedNpy(int fd, const NpyHeader& header);
+
+        [[nodiscard]] const NpyHeader& header() const { return hdr; }
+        [[nodiscard]] const std::vector<size_t>& shape() const { return hdr.shape; }
+        [[nodiscard]] size_t word_size() const { return hdr.word_size; }
+        [[nodiscard]] bool fortran_order() const { return hdr.fortran_order; }
+        [[nodiscard]] size_t num_vals() const { return num_values; }
+        [[nodiscard]] size_t num_bytes() const { return num_values * hdr.word_size; }
+
+        template<typename T>
+        const T* data() const
+        {
+            return reinterpret_cast<const T*>(payload);
+        }
+
+        // Hint the kernel to start reading n_bytes of payload from byte_offset (madvise WILLNEED)
+        void prefetch(size_t byte_offset, size_t n_bytes) const;
+
+        // Zero-copy Eigen view of a 2D array; ORDER must match the storage order of the file
+        template<typename T, int ORDER = Eigen::RowMajor>
+        auto mat() const -> Eigen::Map<const Eigen::Matrix<T, -1, -1, ORDER>>
+        {
+            if (hdr.shape.size() != 2)
+                throw std::runtime_error("MappedNpy: Only 2D arrays can be viewed as Eigen matrices.");
+            if (hdr.word_size != sizeof(T))
+                throw std::runtime_error("MappedNpy: word size does not match the requested type");
+            if (hdr.fortran_order != (ORDER == Eigen::ColMajor))
+                throw std::runtime_error("MappedNpy: requested storage order does not match the file order");
+            return Eigen::Map<const Eigen::Matrix<T, -1, -1, ORDER>>(data<T>(), hdr.shape[0], hdr.shape[1]);
+        }
+
+    private:
+        void map_fd(int fd, const std::string& what);
+
+        std::shared_ptr<void> region;
+        const char* payload = nullptr;
+        NpyHeader hdr;
+        size_t num_values = 0;
+    };
+
+    // Map every member of an uncompressed npz archive (np.savez, scipy.sparse.save_npz(compressed=False)) in
+    // place, keyed by member name without the ".npy" suffix. Compressed members cannot be mapped and throw.
+    auto map_npz(const std::string& fname) -> std::map<std::string, MappedNpy>;
+
+} // namespace npy
+
+#endif
@@ -0,0 +1,44 @@
+#include "npy_normalize.hpp"
+
+void npy::ColumnMoments::merge(const ColumnMoments& other)
+{
+    if (other.count == 0)
+        return;
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+    const auto n_a = static_cast<double>(count);
+    const auto n_b = static_cast<double>(other.count);
+    const double n = n_a + n_b;
+    const Eigen::ArrayXd delta = other.mean - mean;
+    mean += delta * (n_b / n);
+    m2 += other.m2 + delta.square() * (n_a * n_b / n);
+    min = min.min(other.min);
+    max = max.max(other.max);
+    count += other.count;
+}
+
+auto npy::ColumnMoments::variance() const -> Eigen::ArrayXd
+{
+    // Population variance, as numpy.std with ddof=0
+    return count > 0 ? Eigen::ArrayXd(m2 / static_cast<double>(count)) : Eigen::ArrayXd::Zero(m2.size());
+}
+
+void npy::save_normalize_params(const NormalizeParams& p, const std::string& params_prefix)
+{
+    save_arr(params_prefix + "_shift.npy", p.shift.data(), static_cast<size_t>(p.shift.size()));
+    save_arr(params_prefix + "_scale.npy", p.scale.data(), static_cast<size_t>(p.scale.size()));
+}
+
+auto npy::load_normalize_params(const std::string& params_prefix) -> NormalizeParams
+{
+    NormalizeParams p;
+    const NpyArray shift = npy_load(params_prefix + "_shift.npy");
+    const NpyArray scale = npy_load(params_prefix + "_scale.npy");
+    if (shift.word_size != sizeof(double) || scale.word_size != sizeof(double) || shift.num_vals != scale.num_vals)
+        throw std::runtime_error("load_normalize_params: invalid parameter files for " + params_prefix);
+    p.shift = Eigen::Map<const Eigen::VectorXd>(shift.data<double>(), static_cast<Eigen::Index>(shift.num_vals));
+    p.scale = Eigen::Map<const Eigen::VectorXd>(scale.data<double>(), static_cast<Eigen::Index>(scale.num_vals));
+    return p;
+}
@@ -0,0 +1,203 @@
+#ifndef NPY_NORMALIZE_H_
+#define NPY_NORMALIZE_H_
+
+#include "npy_sketch.hpp"
+
+#include <unistd.h>
+
+namespace npy {
+
+    enum class NormalizeMode {
+        ZScore, // (x - mean) / std
+        MinMax, // (x - min) / (max - min)
+        Robust  // (x - median) / IQR, quantiles from per-column KLL sketches
+    };
+
+    // Per-column affine parameters: out = (x - shift) / scale. Columns with zero spread get scale 1.
+    struct NormalizeParams {
+        Eigen::VectorXd shift;
+        Eigen::VectorXd scale;
+    };
+
+    void save_normalize_params(const NormalizeParams& p, const std::string& params_prefix);
+    auto load_normalize_params(const std::string& params_prefix) -> NormalizeParams;
+
+    // Rows of one column converted to double at a time when a Fortran-order column block is processed
+    constexpr Eigen::Index _column_piece_rows = 1 << 16;
+
+    // Mergeable per-column moments (Welford / Chan et al. pairwise update) plus min and max
+    struct ColumnMoments {
+        explicit ColumnMoments(const size_t cols = 0) :
+            mean(Eigen::ArrayXd::Zero(cols)), m2(Eigen::ArrayXd::Zero(cols)),
+            min(Eigen::ArrayXd::Constant(cols, HUGE_VAL)), max(Eigen::ArrayXd::Constant(cols, -HUGE_VAL))
+        {}
+
+        // Add a block of rows (any Eigen matrix expression with one column per array column)
+        template<typename Block>
+        void add_rows(const Block& block)
+        {
+            if (block.rows() == 0)
+                return;
+            const Eigen::ArrayXXd x = block.template cast<double>().array();
+            ColumnMoments c(static_cast<size_t>(x.cols()));
+            c.count = x.rows();
+            c.mean = x.colwise().mean().transpose();
+            c.m2 = (x.rowwise() - c.mean.transpose()).square().colwise().sum().transpose();
+            c.min = x.colwise().minCoeff().transpose();
+            c.max = x.colwise().maxCoeff().transpose();
+            merge(c);
+        }
+
+        // Set whole columns starting at column col0 from a block holding every row of them (Fortran-order
+        // column blocks); disjoint column ranges may be set from different threads, count is left to the caller.
+        // Each column is read in pieces of _column_piece_rows rows folded with merge(), so memory does not
+        // grow with the row count.
+        template<typename Block>
+        void add_columns(const size_t col0, const Block& block)
+        {
+            for (Eigen::Index j = 0; j < block.cols(); ++j) {
+                ColumnMoments col(1);
+                for (Eigen::Index r0 = 0; r0 < block.rows(); r0 += _column_piece_rows)
+                    col.add_rows(block.col(j).segment(r0, std::min(_column_piece_rows, block.rows() - r0)));
+                const auto c = static_cast<Eigen::Index>(col0) + j;
+                mean[c] = col.mean[0];
+                m2[c] = col.m2[0];
+                min[c] = col.min[0];
+                max[c] = col.max[0];
+            }
+        }
+
+        void merge(const ColumnMoments& other);
+        [[nodiscard]] auto variance() const -> Eigen::ArrayXd;
+
+        Eigen::Index count = 0;
+        Eigen::ArrayXd mean;
+        Eigen::ArrayXd m2;
+        Eigen::ArrayXd min;
+        Eigen::ArrayXd max;
+    };
+
+    // Pass 1: per-column statistics of a 2D npy file for the given mode, computed in parallel chunks
+    template<typename T>
+    auto fit_normalization(const std::string& in_file, const NormalizeMode mode, const size_t chunk_rows = 1 << 14,
+                           const size_t n_threads = 0) -> NormalizeParams
+    {
+        const MappedNpy arr(in_file);
+        const size_t cols = _num_cols(arr);
+        NormalizeParams p;
+
+        if (mode == NormalizeMode::Robust) {
+            HistogramSpec spec;
+            const ColumnSketches s = column_sketches<T>(arr, spec, 400, chunk_rows, n_threads);
+            p.shift.resize(static_cast<Eigen::Index>(cols));
+            p.scale.resize(static_cast<Eigen::Index>(cols));
+            for (size_t j = 0; j < cols; ++j) {
+                p.shift[j] = s.quantiles[j].quantile(0.5);
+                p.scale[j] = s.quantiles[j].quantile(0.75) - s.quantiles[j].quantile(0.25);
+            }
+        } else {
+            // C-order row blocks are folded into per-thread moments; Fortran-order column blocks each hold
+            // complete columns, so they fill disjoint segments of m directly
+            ColumnMoments m(cols);
+            std::vector<std::unique_ptr<ColumnMoments>> partial(_resolve_threads(n_threads));
+            for_each_chunk_worker<T>(
+                    arr, chunk_rows,
+                    [&](const size_t worker, const size_t offset, const auto& block) {
+                        if (!std::decay_t<decltype(block)>::IsRowMajor) {
+                            m.add_columns(offset, block);
+                            return;
+                        }
+                        if (!partial[worker])
+                            partial[worker].reset(new ColumnMoments(cols));
+                        partial[worker]->add_rows(block);
+                    },
+                    n_threads);
+            for (const auto& w: partial)
+                if (w)
+                    m.merge(*w);
+            if (arr.fortran_order())
+                m.count = static_cast<Eigen::Index>(_num_rows(arr));
+
+            if (mode == NormalizeMode::ZScore) {
+                p.shift = m.mean.matrix();
+                p.scale = m.variance().sqrt().matrix();
+            } else {
+                p.shift = m.min.matrix();
+                p.scale = (m.max - m.min).matrix();
+            }
+        }
+
+        for (Eigen::Index j = 0; j < p.scale.size(); ++j)
+            if (!(p.scale[j] > 0))
+                p.scale[j] = 1;
+        return p;
+    }
+
+    // Pass 2: write (x - shift) / scale for every element of in_file to out_file (same shape and order) as OUT,
+    // applied as vectorised Eigen row/column-wise operations over parallel chunks
+    template<typename T, typename OUT = T>
+    void apply_normalization(const std::string& in_file, const std::string& out_file, const NormalizeParams& p,
+                             const size_t chunk_rows = 1 << 14, const size_t n_threads = 0)
+    {
+        const MappedNpy arr(in_file);
+        const size_t cols = _num_cols(arr);
+        if (static_cast<size_t>(p.shift.size()) != cols || static_cast<size_t>(p.scale.size()) != cols)
+            throw std::runtime_error("apply_normalization: parameters do not match the columns of " + in_file);
+
+        const Eigen::ArrayXd shift = p.shift.array();
+        const Eigen::ArrayXd inv_scale = p.scale.array().inverse();
+        size_t data_offset;
+        const int fd = _create_npy_file(out_file, _npy_descr<OUT>(), arr.fortran_order(), arr.shape(), data_offset);
+        try {
+            for_each_chunk<T>(
+                    arr, chunk_rows,
+                    [&](const size_t offset, const auto& block) {
+                        const size_t first = static_cast<size_t>(block.data() - arr.data<T>());
+                        if (std::decay_t<decltype(block)>::IsRowMajor) {
+                            Eigen::Matrix<OUT, -1, -1, Eigen::RowMajor> out =
+                                    ((block.template cast<double>().array().rowwise() - shift.transpose()).rowwise() *
+                                     inv_scale.transpose())
+                                            .template cast<OUT>();
+                            _pwrite_all(fd, out.data(), out.size() * sizeof(OUT), data_offset + first * sizeof(OUT));
+                        } else {
+                            // Full-height column block: write each column in row-bounded pieces
+                            for (Eigen::Index j = 0; j < block.cols(); ++j) {
+                                const auto c = static_cast<Eigen::Index>(offset) + j;
+                                for (Eigen::Index r0 = 0; r0 < block.rows(); r0 += _column_piece_rows) {
+                                    const Eigen::Index n = std::min(_column_piece_rows, block.rows() - r0);
+                                    const Eigen::Matrix<OUT, -1, 1> out =
+                                            ((block.col(j).segment(r0, n).template cast<double>().array() - shift[c]) *
+                                             inv_scale[c])
+                                                    .template cast<OUT>();
+                                    const size_t at = first + static_cast<size_t>(j * block.rows() + r0);
+                                    _pwrite_all(fd, out.data(), static_cast<size_t>(n) * sizeof(OUT),
+                                                data_offset + at * sizeof(OUT));
+                                }
+                            }
+                        }
+                    },
+                    n_threads);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        close(fd);
+    }
+
+    // Fit on in_file, write the normalized array and, if params_prefix is not empty, save the parameters as
+    // float64 vectors params_prefix + "_shift.npy" and params_prefix + "_scale.npy" for reuse at inference
+    template<typename T, typename OUT = T>
+    auto normalize(const std::string& in_file, const std::string& out_file, const NormalizeMode mode,
+                   const std::string& params_prefix = "", const size_t chunk_rows = 1 << 14, const size_t n_threads = 0)
+            -> NormalizeParams
+    {
+        const NormalizeParams p = fit_normalization<T>(in_file, mode, chunk_rows, n_threads);
+        apply_normalization<T, OUT>(in_file, out_file, p, chunk_rows, n_threads);
+        if (!params_prefix.empty())
+            save_normalize_params(p, params_prefix);
+        return p;
+    }
+
+} // namespace npy
+
+#endif
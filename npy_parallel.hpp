@@ -0,0 +1,74 @@
+#ifndef NPY_PARALLEL_H_
+#define NPY_PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace npy {
+
+    inline size_t _resolve_threads(const size_t n_threads)
+    {
+        if (n_threads > 0)
+            return n_threads;
+        const unsigned hw = std::thread::hardware_concurrency();
+        return hw > 0 ? hw : 1;
+    }
+
+    // Number of worker threads parallel_for_worker will run for n items
+    inline size_t num_workers(const size_t n, const size_t n_threads)
+    {
+        return std::max<size_t>(1, std::min(_resolve_threads(n_threads), n));
+    }
+
+    // Call f(worker, i) for every i in [0, n) from up to n_threads threads (0 = hardware concurrency), where
+    // worker < num_workers(n, n_threads) identifies the calling thread so f can keep per-thread state.
+    // Work items are handed out dynamically; the first exception thrown by f is rethrown to the caller.
+    template<typename F>
+    void parallel_for_worker(const size_t n, const size_t n_threads, F&& f)
+    {
+        const size_t workers = num_workers(n, n_threads);
+        if (workers <= 1) {
+            for (size_t i = 0; i < n; ++i)
+                f(size_t{0}, i);
+            return;
+        }
+
+        std::atomic<size_t> next{0};
+        std::exception_ptr error;
+        std::mutex error_mutex;
+        auto work = [&](const size_t worker) {
+            try {
+                for (size_t i = next++; i < n; i = next++)
+                    f(worker, i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error)
+                    error = std::current_exception();
+                next = n;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < workers; ++t)
+            threads.emplace_back(work, t);
+        work(0);
+        for (auto& th: threads)
+            th.join();
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    // Call f(i) for every i in [0, n) from up to n_threads threads (0 = hardware concurrency)
+    template<typename F>
+    void parallel_for(const size_t n, const size_t n_threads, F&& f)
+    {
+        parallel_for_worker(n, n_threads, [&f](size_t, const size_t i) { f(i); });
+    }
+
+} // namespace npy
+
+#endif
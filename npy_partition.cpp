@@ -0,0 +1,106 @@
+#include "npy_partition.hpp"
+
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+
+    constexpr size_t max_buffer_bytes = 64 << 10;
+
+} // namespace
+
+npy::RowPartitions::RowPartitions(const std::string& dir, size_t partitions, const size_t payload_bytes,
+                                  const size_t workers, const size_t buffer_budget, const unsigned level) :
+    record_bytes(sizeof(int64_t) + payload_bytes), hash_level(level), seed(0x9e3779b97f4a7c15ULL * level)
+{
+    size_t bits = 0;
+    while ((size_t{1} << bits) < std::max<size_t>(partitions, 1))
+        ++bits;
+    partitions = size_t{1} << bits;
+    shift = 64 - bits;
+    const size_t share = buffer_budget / (std::max<size_t>(workers, 1) * partitions);
+    buffer_bytes = std::max(record_bytes, std::min(share, max_buffer_bytes) / record_bytes * record_bytes);
+
+    file_mutex = std::vector<std::mutex>(partitions);
+    buffers.assign(workers, std::vector<std::vector<char>>(partitions));
+    for (size_t p = 0; p < partitions; ++p) {
+        std::string path = dir + "/npy_part_XXXXXX";
+        const int fd = mkstemp(&path[0]);
+        FILE* fp = fd >= 0 ? fdopen(fd, "w+b") : nullptr;
+        if (!fp) {
+            if (fd >= 0)
+                close(fd);
+            throw std::runtime_error("RowPartitions: Unable to create spill file in " + dir);
+        }
+        paths.push_back(path);
+        files.push_back(fp);
+    }
+}
+
+npy::RowPartitions::~RowPartitions()
+{
+    for (size_t p = 0; p < files.size(); ++p) {
+        fclose(files[p]);
+        unlink(paths[p].c_str());
+    }
+}
+
+char* npy::RowPartitions::record(const size_t worker, const int64_t key)
+{
+    // Top bits of the hash pick the partition; hash tables built on a partition probe with the low bits
+    const size_t p = shift == 64 ? 0 : static_cast<size_t>(_mix64(static_cast<uint64_t>(key) ^ seed) >> shift);
+    std::vector<char>& buf = buffers[worker][p];
+    if (buf.capacity() == 0)
+        buf.reserve(buffer_bytes);
+    if (buf.size() + record_bytes > buffer_bytes)
+        flush(worker, p);
+    const size_t at = buf.size();
+    buf.resize(at + record_bytes);
+    std::memcpy(&buf[at], &key, sizeof(key));
+    return &buf[at + sizeof(key)];
+}
+
+void npy::RowPartitions::flush(const size_t worker, const size_t p)
+{
+    std::vector<char>& buf = buffers[worker][p];
+    if (buf.empty())
+        return;
+    std::lock_guard<std::mutex> lock(file_mutex[p]);
+    if (fwrite(buf.data(), 1, buf.size(), files[p]) != buf.size())
+        throw std::runtime_error("RowPartitions: failed fwrite on " + paths[p]);
+    buf.clear();
+}
+
+void npy::RowPartitions::flush_all()
+{
+    for (size_t w = 0; w < buffers.size(); ++w)
+        for (size_t p = 0; p < files.size(); ++p) {
+            flush(w, p);
+            buffers[w][p].shrink_to_fit();
+        }
+    for (FILE* fp: files)
+        fflush(fp);
+}
+
+size_t npy::RowPartitions::bytes(const size_t p) const
+{
+    const off_t size = lseek(fileno(files[p]), 0, SEEK_END);
+    if (size < 0)
+        throw std::runtime_error("RowPartitions: failed lseek on " + paths[p]);
+    return static_cast<size_t>(size);
+}
+
+auto npy::RowPartitions::read(const size_t p) const -> std::vector<char>
+{
+    return read(p, 0, bytes(p));
+}
+
+auto npy::RowPartitions::read(const size_t p, const size_t offset, const size_t max_bytes) const
+        -> std::vector<char>
+{
+    const size_t size = bytes(p);
+    const size_t n = offset >= size ? 0 : std::min(size - offset, max_bytes) / record_bytes * record_bytes;
+    std::vector<char> data(n);
+    _pread_all(fileno(files[p]), data.data(), n, offset);
+    return data;
+}
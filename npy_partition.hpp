@@ -0,0 +1,53 @@
+#ifndef NPY_PARTITION_H_
+#define NPY_PARTITION_H_
+
+#include "npy_utils.hpp"
+
+#include <mutex>
+
+namespace npy {
+
+    // Fixed-length records (int64 key + payload) scattered by key hash over temporary files, buffered per thread.
+    // The workers x partitions write buffers share buffer_budget bytes, each holding between one record and
+    // 64 KiB. Each level hashes keys with a different seed, so the records of one oversized partition can be
+    // scattered again over a RowPartitions of the next level.
+    class RowPartitions {
+    public:
+        RowPartitions(const std::string& dir, size_t partitions, size_t payload_bytes, size_t workers,
+                      size_t buffer_budget, unsigned level = 0);
+        ~RowPartitions();
+
+        RowPartitions(const RowPartitions&) = delete;
+        RowPartitions& operator=(const RowPartitions&) = delete;
+
+        // Payload slot of a new record with the given key, valid until this worker's next call
+        char* record(size_t worker, int64_t key);
+        // Write out and release every buffer
+        void flush_all();
+        // All records of partition p
+        auto read(size_t p) const -> std::vector<char>;
+        // Up to max_bytes of whole records of partition p starting at byte offset (empty at the end)
+        auto read(size_t p, size_t offset, size_t max_bytes) const -> std::vector<char>;
+        // Bytes of partition p on disk, valid after flush_all()
+        [[nodiscard]] size_t bytes(size_t p) const;
+        [[nodiscard]] size_t size() const { return files.size(); }
+        [[nodiscard]] size_t record_size() const { return record_bytes; }
+        [[nodiscard]] unsigned level() const { return hash_level; }
+
+    private:
+        void flush(size_t worker, size_t p);
+
+        size_t record_bytes;
+        size_t buffer_bytes;
+        size_t shift;
+        unsigned hash_level;
+        uint64_t seed;
+        std::vector<std::string> paths;
+        std::vector<FILE*> files;
+        std::vector<std::mutex> file_mutex;
+        std::vector<std::vector<std::vector<char>>> buffers; // [worker][partition]
+    };
+
+} // namespace npy
+
+#endif
@@ -0,0 +1,64 @@
+#include "npy_pca.hpp"
+
+#include <random>
+
+auto npy::_pca_start(const Eigen::Index cols, const size_t l, const uint64_t seed) -> Eigen::MatrixXd
+{
+    std::mt19937_64 rng(_mix64(seed));
+    std::normal_distribution<double> normal;
+    Eigen::MatrixXd omega(cols, static_cast<Eigen::Index>(l));
+    for (Eigen::Index j = 0; j < omega.cols(); ++j)
+        for (Eigen::Index i = 0; i < omega.rows(); ++i)
+            omega(i, j) = normal(rng);
+    return omega;
+}
+
+auto npy::_pca_orthonormalize(const Eigen::MatrixXd& Z) -> Eigen::MatrixXd
+{
+    const Eigen::HouseholderQR<Eigen::MatrixXd> qr(Z);
+    return qr.householderQ() * Eigen::MatrixXd::Identity(Z.rows(), Z.cols());
+}
+
+auto npy::_pca_finish(const Eigen::MatrixXd& Q, const Eigen::MatrixXd& GQ, const size_t k, const _PcaTotals& totals,
+                      const bool center) -> PcaResult
+{
+    // Rayleigh-Ritz on the subspace: Q^T G Q = W diag(lambda) W^T, so G ~ (Q W) diag(lambda) (Q W)^T
+    const Eigen::MatrixXd M = Q.transpose() * GQ;
+    const Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig(0.5 * (M + M.transpose()));
+    const auto kk = static_cast<Eigen::Index>(k);
+    const Eigen::Index l = M.rows();
+
+    PcaResult r;
+    r.components.resize(kk, Q.rows());
+    r.singular_values.resize(kk);
+    for (Eigen::Index i = 0; i < kk; ++i) {
+        // Eigenvalues come in increasing order
+        const Eigen::Index src = l - 1 - i;
+        Eigen::VectorXd v = Q * eig.eigenvectors().col(src);
+        Eigen::Index largest;
+        v.cwiseAbs().maxCoeff(&largest);
+        if (v[largest] < 0)
+            v = -v;
+        r.components.row(i) = v.transpose();
+        r.singular_values[i] = std::sqrt(std::max(0.0, eig.eigenvalues()[src]));
+    }
+
+    const auto m = static_cast<double>(totals.rows);
+    const double dof = std::max(1.0, m - 1);
+    r.mean = center && m > 0 ? Eigen::VectorXd(totals.sum / m) : Eigen::VectorXd::Zero(Q.rows());
+    const double total_var = (totals.sumsq.array() - m * r.mean.array().square()).sum() / dof;
+    r.explained_variance = r.singular_values.array().square() / dof;
+    r.explained_variance_ratio = r.explained_variance / (total_var > 0 ? total_var : 1.0);
+    return r;
+}
+
+void npy::save_pca(const PcaResult& pca, const std::string& prefix)
+{
+    const Eigen::Matrix<double, -1, -1, Eigen::RowMajor> components = pca.components;
+    save_arr_as_matrix(prefix + "_components.npy", components.data(), components.rows(), components.cols());
+    save_arr(prefix + "_singular_values.npy", pca.singular_values.data(), pca.singular_values.size());
+    save_arr(prefix + "_explained_variance.npy", pca.explained_variance.data(), pca.explained_variance.size());
+    save_arr(prefix + "_explained_variance_ratio.npy", pca.explained_variance_ratio.data(),
+             pca.explained_variance_ratio.size());
+    save_arr(prefix + "_mean.npy", pca.mean.data(), pca.mean.size());
+}
@@ -0,0 +1,122 @@
+#ifndef NPY_PCA_H_
+#define NPY_PCA_H_
+
+#include "npy_chunks.hpp"
+
+namespace npy {
+
+    struct PcaOptions {
+        size_t oversample = 10;
+        // Extra applications of A^T A before the final projection; more passes, sharper spectrum
+        size_t power_iters = 2;
+        bool center = true;
+        uint64_t seed = 0;
+        size_t chunk_rows = 1 << 14;
+        size_t n_threads = 0;
+    };
+
+    struct PcaResult {
+        Eigen::MatrixXd components;  // (k, cols), rows are principal axes
+        Eigen::VectorXd singular_values;
+        Eigen::VectorXd explained_variance;
+        Eigen::VectorXd explained_variance_ratio;
+        Eigen::VectorXd mean;         // column means (zero when not centering)
+    };
+
+    // Column sums and sums of squares gathered on the first pass
+    struct _PcaTotals {
+        Eigen::VectorXd sum;
+        Eigen::VectorXd sumsq;
+        size_t rows = 0;
+    };
+
+    // One streaming pass computing A^T (A X) over row panels with Eigen GEMM, one (cols, X.cols())
+    // accumulator per thread; optionally also collects column totals
+    template<typename T>
+    auto _gram_times(const MappedNpy& arr, const Eigen::MatrixXd& X, const PcaOptions& opt, _PcaTotals* totals)
+            -> Eigen::MatrixXd
+    {
+        const auto cols = static_cast<Eigen::Index>(_num_cols(arr));
+        const size_t workers = _resolve_threads(opt.n_threads);
+        std::vector<Eigen::MatrixXd> acc(workers);
+        std::vector<Eigen::VectorXd> sum(totals ? workers : 0), sumsq(totals ? workers : 0);
+
+        for_each_row_chunk_worker<T>(
+                arr, opt.chunk_rows,
+                [&](const size_t worker, size_t, const auto& block) {
+                    const Eigen::MatrixXd panel = block.template cast<double>();
+                    if (acc[worker].size() == 0)
+                        acc[worker] = Eigen::MatrixXd::Zero(cols, X.cols());
+                    acc[worker].noalias() += panel.transpose() * (panel * X);
+                    if (totals) {
+                        if (sum[worker].size() == 0) {
+                            sum[worker] = Eigen::VectorXd::Zero(cols);
+                            sumsq[worker] = Eigen::VectorXd::Zero(cols);
+                        }
+                        sum[worker] += panel.colwise().sum().transpose();
+                        sumsq[worker] += panel.array().square().colwise().sum().matrix().transpose();
+                    }
+                },
+                opt.n_threads);
+
+        Eigen::MatrixXd result = Eigen::MatrixXd::Zero(cols, X.cols());
+        for (const auto& a: acc)
+            if (a.size())
+                result += a;
+        if (totals) {
+            totals->sum = Eigen::VectorXd::Zero(cols);
+            totals->sumsq = Eigen::VectorXd::Zero(cols);
+            totals->rows = _num_rows(arr);
+            for (size_t w = 0; w < workers; ++w) {
+                if (sum[w].size() == 0)
+                    continue;
+                totals->sum += sum[w];
+                totals->sumsq += sumsq[w];
+            }
+        }
+        return result;
+    }
+
+    // Small dense steps of the randomized PCA, see randomized_pca
+    auto _pca_start(Eigen::Index cols, size_t l, uint64_t seed) -> Eigen::MatrixXd;
+    auto _pca_orthonormalize(const Eigen::MatrixXd& Z) -> Eigen::MatrixXd;
+    auto _pca_finish(const Eigen::MatrixXd& Q, const Eigen::MatrixXd& GQ, size_t k, const _PcaTotals& totals,
+                     bool center) -> PcaResult;
+
+    // Top-k principal components of a 2D npy matrix with far more rows than memory allows. Randomized
+    // subspace iteration on the (optionally centered) Gram matrix: every pass streams row panels and
+    // accumulates A^T (A X) for an (cols, k + oversample) block X, so memory is O(cols * (k + oversample))
+    // per thread regardless of the row count. Uses power_iters + 2 passes over the file.
+    template<typename T>
+    auto randomized_pca(const std::string& in_file, const size_t k, const PcaOptions& opt = PcaOptions()) -> PcaResult
+    {
+        const MappedNpy arr(in_file);
+        const auto cols = static_cast<Eigen::Index>(_num_cols(arr));
+        const size_t l = std::min<size_t>(k + opt.oversample, static_cast<size_t>(cols));
+        if (k == 0 || k > static_cast<size_t>(cols))
+            throw std::runtime_error("randomized_pca: k must lie in [1, cols]");
+
+        _PcaTotals totals;
+        // Centered Gram product: (A - 1 mu^T)^T (A - 1 mu^T) X = A^T A X - m mu (mu^T X)
+        const auto gram = [&](const Eigen::MatrixXd& X, _PcaTotals* t) -> Eigen::MatrixXd {
+            Eigen::MatrixXd G = _gram_times<T>(arr, X, opt, t);
+            if (opt.center) {
+                const Eigen::VectorXd mu = totals.sum / static_cast<double>(std::max<size_t>(1, totals.rows));
+                G -= static_cast<double>(totals.rows) * mu * (mu.transpose() * X);
+            }
+            return G;
+        };
+
+        Eigen::MatrixXd Q = _pca_orthonormalize(gram(_pca_start(cols, l, opt.seed), &totals));
+        for (size_t it = 0; it < opt.power_iters; ++it)
+            Q = _pca_orthonormalize(gram(Q, nullptr));
+        return _pca_finish(Q, gram(Q, nullptr), k, totals, opt.center);
+    }
+
+    // Save a PcaResult as <prefix>_components.npy, _singular_values.npy, _explained_variance.npy,
+    // _explained_variance_ratio.npy and _mean.npy (float64)
+    void save_pca(const PcaResult& pca, const std::string& prefix);
+
+} // namespace npy
+
+#endif
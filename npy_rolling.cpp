@@ -0,0 +1,37 @@
+#include "npy_rolling.hpp"
+
+auto npy::rolling_stat_name(const RollingStat stat) -> std::string
+{
+    switch (stat) {
+        case RollingStat::Mean:
+            return "mean";
+        case RollingStat::Std:
+            return "std";
+        case RollingStat::Min:
+            return "min";
+        case RollingStat::Max:
+            return "max";
+        case RollingStat::Sum:
+            return "sum";
+    }
+    throw std::runtime_error("rolling_stat_name: Unknown statistic");
+}
+
+double npy::RollingWindow::value(const RollingStat stat, const size_t ddof) const
+{
+    if (nans > 0 || count == 0)
+        return NAN;
+    switch (stat) {
+        case RollingStat::Mean:
+            return mean;
+        case RollingStat::Std:
+            return count > ddof ? std::sqrt(m2 / static_cast<double>(count - ddof)) : NAN;
+        case RollingStat::Min:
+            return min_q.front();
+        case RollingStat::Max:
+            return max_q.front();
+        case RollingStat::Sum:
+            return sum;
+    }
+    throw std::runtime_error("RollingWindow::value: Unknown statistic");
+}
@@ -0,0 +1,215 @@
+#ifndef NPY_ROLLING_H_
+#define NPY_ROLLING_H_
+
+#include "npy_mmap.hpp"
+#include "npy_parallel.hpp"
+
+#include <cmath>
+#include <unistd.h>
+
+namespace npy {
+
+    enum class RollingStat { Mean, Std, Min, Max, Sum };
+
+    // "mean", "std", "min", "max" or "sum"
+    auto rolling_stat_name(RollingStat stat) -> std::string;
+
+    struct RollingOptions {
+        size_t window = 1;
+        // Distance between the starts of consecutive windows
+        size_t step = 1;
+        // Delta degrees of freedom of Std
+        size_t ddof = 1;
+        // Input rows per task; neighbouring tasks re-read window - 1 rows of overlap
+        size_t chunk_rows = 1 << 16;
+        size_t n_threads = 0;
+    };
+
+    // Number of complete windows over n rows
+    inline size_t rolling_output_rows(const size_t n, const size_t window, const size_t step)
+    {
+        return n < window ? 0 : (n - window) / step + 1;
+    }
+
+    // Sliding window over one series with O(1) amortized push and pop: running sum, Welford mean / M2 with
+    // removal, and monotonic queues (ring buffers of at most `window` entries) for min and max.
+    // NaN values are counted but kept out of the statistics; any window holding one yields NaN.
+    class RollingWindow {
+    public:
+        explicit RollingWindow(const size_t window) : min_q(window), max_q(window) {}
+
+        void push(const double x)
+        {
+            const size_t i = pushed++;
+            if (std::isnan(x)) {
+                ++nans;
+                return;
+            }
+            ++count;
+            sum += x;
+            const double d = x - mean;
+            mean += d / static_cast<double>(count);
+            m2 += d * (x - mean);
+            min_q.push(i, x, [](const double a, const double b) { return a >= b; });
+            max_q.push(i, x, [](const double a, const double b) { return a <= b; });
+        }
+
+        // Drop the oldest value in the window, which must be x
+        void pop(const double x)
+        {
+            const size_t i = popped++;
+            if (std::isnan(x)) {
+                --nans;
+                return;
+            }
+            if (--count == 0) {
+                sum = mean = m2 = 0;
+            } else {
+                sum -= x;
+                const double d = x - mean;
+                mean -= d / static_cast<double>(count);
+                m2 = std::max(0.0, m2 - d * (x - mean));
+            }
+            min_q.expire(i);
+            max_q.expire(i);
+        }
+
+        [[nodiscard]] double value(RollingStat stat, size_t ddof) const;
+
+    private:
+        // Deque of (index, value) with values monotonic from front to back, front = current extreme
+        class MonotonicQueue {
+        public:
+            explicit MonotonicQueue(const size_t capacity) : buf(std::max<size_t>(capacity, 1)) {}
+
+            // Append (i, x) after dropping the back entries that `dominated(back, x)` says x makes redundant
+            template<typename Dominated>
+            void push(const size_t i, const double x, Dominated dominated)
+            {
+                while (size > 0 && dominated(back().second, x))
+                    --size;
+                buf[(head + size++) % buf.size()] = {i, x};
+            }
+
+            void expire(const size_t i)
+            {
+                if (size > 0 && buf[head].first == i) {
+                    head = (head + 1) % buf.size();
+                    --size;
+                }
+            }
+
+            [[nodiscard]] double front() const { return size > 0 ? buf[head].second : NAN; }
+
+        private:
+            std::pair<size_t, double>& back() { return buf[(head + size - 1) % buf.size()]; }
+
+            std::vector<std::pair<size_t, double>> buf;
+            size_t head = 0;
+            size_t size = 0;
+        };
+
+        size_t pushed = 0, popped = 0, count = 0, nans = 0;
+        double sum = 0, mean = 0, m2 = 0;
+        MonotonicQueue min_q, max_q;
+    };
+
+    // Rolling statistics of n_out windows over the series x[0], x[stride], ... written to out[k * out_stride]
+    // for every requested stat (out[s] is the output of stats[s])
+    template<typename T>
+    void _rolling_series(const T* x, const std::ptrdiff_t stride, const size_t n_out, const RollingOptions& opt,
+                         const std::vector<RollingStat>& stats, const std::vector<double*>& out,
+                         const std::ptrdiff_t out_stride)
+    {
+        RollingWindow w(opt.window);
+        const auto at = [&](const size_t i) { return static_cast<double>(x[static_cast<std::ptrdiff_t>(i) * stride]); };
+        size_t begin = 0, end = 0;
+        for (size_t k = 0; k < n_out; ++k) {
+            const size_t first = k * opt.step;
+            if (first >= end) { // windows do not overlap: restart
+                w = RollingWindow(opt.window);
+                begin = end = first;
+            }
+            for (; begin < first; ++begin)
+                w.pop(at(begin));
+            for (; end < first + opt.window; ++end)
+                w.push(at(end));
+            for (size_t s = 0; s < stats.size(); ++s)
+                out[s][static_cast<std::ptrdiff_t>(k) * out_stride] = w.value(stats[s], opt.ddof);
+        }
+    }
+
+    // Rolling statistics over every column of a 1D or 2D npy file (one time series per column), written as
+    // float64 arrays out_prefix + "_" + rolling_stat_name(stat) + ".npy" with one row per complete window of
+    // opt.window rows starting every opt.step rows. Outputs keep the input's memory order: Fortran inputs are
+    // processed column by column on contiguous data, C inputs row chunk by row chunk across all columns.
+    // Work is split into (column, window range) tasks whose inputs overlap by window - 1 rows of halo, and each
+    // task writes its results straight to their place in the preallocated output files.
+    template<typename T>
+    void rolling_stats(const std::string& in_file, const std::vector<RollingStat>& stats,
+                       const std::string& out_prefix, const RollingOptions& opt = RollingOptions())
+    {
+        if (opt.window == 0 || opt.step == 0)
+            throw std::runtime_error("rolling_stats: window and step must be positive");
+        const MappedNpy arr(in_file);
+        if (arr.shape().empty() || arr.shape().size() > 2)
+            throw std::runtime_error("rolling_stats: expected a 1D or 2D array in " + in_file);
+        if (arr.word_size() != sizeof(T))
+            throw std::runtime_error("rolling_stats: element size mismatch in " + in_file);
+        const size_t n = arr.shape()[0];
+        const size_t cols = arr.shape().size() == 2 ? arr.shape()[1] : 1;
+        const bool fortran = arr.fortran_order() && cols > 1;
+        const size_t n_out = rolling_output_rows(n, opt.window, opt.step);
+        std::vector<size_t> out_shape = arr.shape();
+        out_shape[0] = n_out;
+
+        std::vector<int> fds;
+        std::vector<size_t> offsets(stats.size());
+        const auto close_all = [&]() {
+            for (const int fd: fds)
+                close(fd);
+        };
+        try {
+            for (size_t s = 0; s < stats.size(); ++s)
+                fds.push_back(_create_npy_file(out_prefix + "_" + rolling_stat_name(stats[s]) + ".npy",
+                                               _npy_descr<double>(), fortran, out_shape, offsets[s]));
+
+            const size_t chunk_out = std::max<size_t>(1, opt.chunk_rows / opt.step);
+            const size_t n_chunks = (n_out + chunk_out - 1) / chunk_out;
+            // Fortran tasks cover one column, C tasks all columns of a window range
+            const size_t col_tasks = fortran ? cols : 1;
+            parallel_for(n_chunks * col_tasks, opt.n_threads, [&](const size_t task) {
+                const size_t chunk = task / col_tasks;
+                const size_t k0 = chunk * chunk_out;
+                const size_t m = std::min(n_out, k0 + chunk_out) - k0;
+                const size_t c0 = fortran ? task % col_tasks : 0;
+                const size_t nc = fortran ? 1 : cols;
+                const T* base = arr.data<T>() + (fortran ? c0 * n + k0 * opt.step : k0 * opt.step * cols);
+                const size_t span = (m - 1) * opt.step + opt.window;
+                arr.prefetch(static_cast<size_t>(base - arr.data<T>()) * sizeof(T),
+                             span * (fortran ? 1 : cols) * sizeof(T));
+
+                // Results in the output's layout: m rows by nc columns, column-contiguous for Fortran
+                std::vector<double> result(stats.size() * m * nc);
+                std::vector<double*> out(stats.size());
+                for (size_t c = 0; c < nc; ++c) {
+                    for (size_t s = 0; s < stats.size(); ++s)
+                        out[s] = result.data() + s * m * nc + (fortran ? 0 : c);
+                    _rolling_series<T>(base + (fortran ? 0 : c), fortran ? 1 : static_cast<std::ptrdiff_t>(cols), m,
+                                       opt, stats, out, fortran ? 1 : static_cast<std::ptrdiff_t>(cols));
+                }
+                const size_t first = fortran ? c0 * n_out + k0 : k0 * cols;
+                for (size_t s = 0; s < stats.size(); ++s)
+                    _pwrite_all(fds[s], result.data() + s * m * nc, m * nc * sizeof(double),
+                                offsets[s] + first * sizeof(double));
+            });
+        } catch (...) {
+            close_all();
+            throw;
+        }
+        close_all();
+    }
+
+} // namespace npy
+
+#endif
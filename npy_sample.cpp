@@ -0,0 +1,133 @@
+#include "npy_sample.hpp"
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <unordered_set>
+
+namespace {
+
+    // Upper bound on the bytes covered by one coalesced read
+    constexpr size_t max_run_bytes = size_t{8} << 20;
+
+} // namespace
+
+auto npy::sample_row_indices(const size_t n, const size_t k, const uint64_t seed) -> std::vector<size_t>
+{
+    if (k > n)
+        throw std::runtime_error("sample_row_indices: sample larger than population");
+
+    std::mt19937_64 rng(_mix64(seed));
+    std::vector<size_t> indices;
+    indices.reserve(k);
+
+    if (k > n / 16) {
+        // Selection sampling (Knuth's algorithm S): one pass over the indices, output already sorted
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        size_t needed = k;
+        for (size_t i = 0; i < n && needed > 0; ++i) {
+            if (uniform(rng) * static_cast<double>(n - i) < static_cast<double>(needed)) {
+                indices.push_back(i);
+                --needed;
+            }
+        }
+        return indices;
+    }
+
+    // Floyd's algorithm: exactly k draws
+    std::unordered_set<size_t> chosen;
+    chosen.reserve(k * 2);
+    for (size_t j = n - k; j < n; ++j) {
+        const size_t t = static_cast<size_t>(rng() % (j + 1));
+        chosen.insert(chosen.count(t) ? j : t);
+    }
+    indices.assign(chosen.begin(), chosen.end());
+    std::sort(indices.begin(), indices.end());
+    return indices;
+}
+
+void npy::fetch_rows(const std::string& in_file, const std::vector<size_t>& indices, const std::string& out_file,
+                     const size_t n_threads, const size_t max_gap_bytes)
+{
+    const NpyHeader h = npy_read_header(in_file);
+    if (h.shape.empty())
+        throw std::runtime_error("fetch_rows: " + in_file + " has no rows");
+    const size_t rows = h.shape[0];
+    size_t row_elems = 1;
+    for (size_t i = 1; i < h.shape.size(); ++i)
+        row_elems *= h.shape[i];
+    const size_t row_bytes = row_elems * h.word_size;
+    for (size_t i = 0; i < indices.size(); ++i)
+        if (indices[i] >= rows || (i > 0 && indices[i] <= indices[i - 1]))
+            throw std::runtime_error("fetch_rows: indices must be sorted, distinct and in range");
+
+    std::vector<size_t> shape = h.shape;
+    shape[0] = indices.size();
+    size_t out_offset;
+    const int out_fd = _create_npy_file(out_file, h.descr, h.fortran_order, shape, out_offset);
+    if (indices.empty() || row_bytes == 0) {
+        close(out_fd);
+        return;
+    }
+
+    try {
+        if (h.fortran_order) {
+            // Rows are scattered over every column: gather them from the mapping column by column
+            const MappedNpy arr(in_file);
+            const char* src = arr.data<char>();
+            std::vector<char> column(indices.size() * h.word_size);
+            for (size_t j = 0; j < row_elems; ++j) {
+                for (size_t i = 0; i < indices.size(); ++i)
+                    std::memcpy(&column[i * h.word_size], src + (j * rows + indices[i]) * h.word_size, h.word_size);
+                _pwrite_all(out_fd, column.data(), column.size(), out_offset + j * column.size());
+            }
+            close(out_fd);
+            return;
+        }
+
+        // Split the sorted indices into runs that are read with one pread each
+        std::vector<size_t> run_begin{0};
+        for (size_t i = 1; i < indices.size(); ++i) {
+            const size_t gap = (indices[i] - indices[i - 1] - 1) * row_bytes;
+            const size_t span = (indices[i] - indices[run_begin.back()] + 1) * row_bytes;
+            if (gap > max_gap_bytes || span > max_run_bytes)
+                run_begin.push_back(i);
+        }
+        run_begin.push_back(indices.size());
+
+        const int in_fd = open(in_file.c_str(), O_RDONLY);
+        if (in_fd < 0)
+            throw std::runtime_error("fetch_rows: Unable to open file " + in_file);
+        try {
+            parallel_for(run_begin.size() - 1, n_threads, [&](const size_t r) {
+                const size_t a = run_begin[r];
+                const size_t b = run_begin[r + 1];
+                const size_t first = indices[a];
+                std::vector<char> span((indices[b - 1] - first + 1) * row_bytes);
+                _pread_all(in_fd, span.data(), span.size(), h.data_offset + first * row_bytes);
+
+                std::vector<char> picked((b - a) * row_bytes);
+                for (size_t i = a; i < b; ++i)
+                    std::memcpy(&picked[(i - a) * row_bytes], &span[(indices[i] - first) * row_bytes], row_bytes);
+                _pwrite_all(out_fd, picked.data(), picked.size(), out_offset + a * row_bytes);
+            });
+        } catch (...) {
+            close(in_fd);
+            throw;
+        }
+        close(in_fd);
+    } catch (...) {
+        close(out_fd);
+        throw;
+    }
+    close(out_fd);
+}
+
+void npy::sample_rows(const std::string& in_file, const std::string& out_file, const size_t k, const uint64_t seed,
+                      const size_t n_threads)
+{
+    const NpyHeader h = npy_read_header(in_file);
+    if (h.shape.empty())
+        throw std::runtime_error("sample_rows: " + in_file + " has no rows");
+    fetch_rows(in_file, sample_row_indices(h.shape[0], k, seed), out_file, n_threads);
+}
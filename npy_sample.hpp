@@ -0,0 +1,77 @@
+#ifndef NPY_SAMPLE_H_
+#define NPY_SAMPLE_H_
+
+#include "npy_chunks.hpp"
+
+#include <random>
+#include <unordered_map>
+
+namespace npy {
+
+    // k distinct indices drawn uniformly from [0, n), sorted. Uses Floyd's algorithm (O(k) draws) for
+    // small samples and sequential selection sampling for large ones; deterministic for a given seed.
+    auto sample_row_indices(size_t n, size_t k, uint64_t seed) -> std::vector<size_t>;
+
+    // Write the rows of in_file at the sorted indices to out_file. For C-order files nearby rows are
+    // coalesced into single preads (runs whose gaps are at most max_gap_bytes), read in parallel, so only
+    // the sampled regions of the file are touched. Fortran-order files are gathered from a mapping.
+    void fetch_rows(const std::string& in_file, const std::vector<size_t>& indices, const std::string& out_file,
+                    size_t n_threads = 0, size_t max_gap_bytes = 64 << 10);
+
+    // Uniform sample of k rows without replacement, written to out_file in file order.
+    // Reads scale with the sample size, not with the file size.
+    void sample_rows(const std::string& in_file, const std::string& out_file, size_t k, uint64_t seed,
+                     size_t n_threads = 0);
+
+    // Stratified sample: from every distinct value of the integer label column label_col, round(fraction *
+    // stratum size) rows are selected uniformly. The label column is scanned twice (counts, then sequential
+    // selection sampling per stratum), after which only the selected rows are fetched. Returns the sample size.
+    template<typename T>
+    auto stratified_sample_rows(const std::string& in_file, const std::string& out_file, const size_t label_col,
+                                const double fraction, const uint64_t seed, const size_t n_threads = 0) -> size_t
+    {
+        if (fraction < 0 || fraction > 1)
+            throw std::runtime_error("stratified_sample_rows: fraction must lie in [0, 1]");
+
+        std::vector<int64_t> labels;
+        {
+            const MappedNpy arr(in_file);
+            if (label_col >= _num_cols(arr))
+                throw std::runtime_error("stratified_sample_rows: label column out of range for " + in_file);
+            labels.resize(_num_rows(arr));
+            for_each_row_chunk<T>(
+                    arr, 1 << 16,
+                    [&](const size_t offset, const auto& block) {
+                        for (Eigen::Index i = 0; i < block.rows(); ++i)
+                            labels[offset + static_cast<size_t>(i)] = static_cast<int64_t>(block(i, label_col));
+                    },
+                    n_threads);
+        }
+
+        // Per stratum: rows still to pick and rows not yet seen
+        std::unordered_map<int64_t, std::pair<size_t, size_t>> strata;
+        for (const int64_t l: labels)
+            ++strata[l].second;
+        for (auto& s: strata)
+            s.second.first = static_cast<size_t>(std::llround(fraction * static_cast<double>(s.second.second)));
+
+        std::mt19937_64 rng(_mix64(seed));
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        std::vector<size_t> indices;
+        for (size_t i = 0; i < labels.size(); ++i) {
+            auto& s = strata[labels[i]];
+            if (s.first > 0 && uniform(rng) * static_cast<double>(s.second) < static_cast<double>(s.first)) {
+                indices.push_back(i);
+                --s.first;
+            }
+            --s.second;
+        }
+        labels = std::vector<int64_t>();
+
+        fetch_rows(in_file, indices, out_file, n_threads);
+        return indices.size();
+    }
+
+} // namespace npy
+
+#endif
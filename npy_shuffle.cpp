@@ -0,0 +1,167 @@
+#include "npy_shuffle.hpp"
+#include "npy_mmap.hpp"
+#include "npy_parallel.hpp"
+
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <unistd.h>
+
+namespace {
+
+    // Bounds the number of temporary files open at once; beyond this buckets grow instead
+    constexpr size_t max_buckets = 512;
+
+    struct TempFile {
+        explicit TempFile(const std::string& dir)
+        {
+            path = dir + "/npy_shuffle_XXXXXX";
+            const int fd = mkstemp(&path[0]);
+            fp = fd >= 0 ? fdopen(fd, "w+b") : nullptr;
+            if (!fp) {
+                if (fd >= 0)
+                    close(fd);
+                throw std::runtime_error("shuffle_rows: Unable to create temporary file in " + dir);
+            }
+        }
+        ~TempFile()
+        {
+            fclose(fp);
+            unlink(path.c_str());
+        }
+        TempFile(const TempFile&) = delete;
+        TempFile& operator=(const TempFile&) = delete;
+
+        std::string path;
+        FILE* fp;
+    };
+
+    // Closes the output descriptors on every exit path
+    struct Descriptors {
+        ~Descriptors()
+        {
+            for (const int fd: fds)
+                close(fd);
+        }
+        std::vector<int> fds;
+    };
+
+} // namespace
+
+void npy::shuffle_rows(const std::string& in_file, const std::string& out_file, const ShuffleOptions& opt)
+{
+    shuffle_split_rows(in_file, {out_file}, {1.0}, opt);
+}
+
+void npy::shuffle_split_rows(const std::string& in_file, const std::vector<std::string>& out_files,
+                             const std::vector<double>& fractions, const ShuffleOptions& opt)
+{
+    if (out_files.empty() || out_files.size() != fractions.size())
+        throw std::runtime_error("shuffle_split_rows: need one fraction per output file");
+
+    const MappedNpy arr(in_file);
+    if (arr.shape().empty() || arr.fortran_order())
+        throw std::runtime_error("shuffle_rows: " + in_file + " must be a C-order array with at least one axis");
+    const size_t rows = arr.shape()[0];
+    const size_t row_bytes = rows ? arr.num_bytes() / rows : 0;
+    const std::vector<size_t> row_shape(arr.shape().begin() + 1, arr.shape().end());
+
+    // Output row ranges of every split
+    const double total_fraction = std::accumulate(fractions.begin(), fractions.end(), 0.0);
+    std::vector<size_t> split_begin{0};
+    for (size_t s = 0; s + 1 < fractions.size(); ++s)
+        split_begin.push_back(std::min(rows, split_begin.back() + static_cast<size_t>(fractions[s] / total_fraction *
+                                                                                      static_cast<double>(rows))));
+    split_begin.push_back(rows);
+
+    Descriptors out;
+    std::vector<size_t> out_offset(out_files.size());
+    for (size_t s = 0; s < out_files.size(); ++s) {
+        std::vector<size_t> shape{split_begin[s + 1] - split_begin[s]};
+        shape.insert(shape.end(), row_shape.begin(), row_shape.end());
+        out.fds.push_back(_create_npy_file(out_files[s], arr.header().descr, false, shape, out_offset[s]));
+    }
+    if (rows == 0 || row_bytes == 0)
+        return;
+
+    // Enough buckets that each one fits in a thread's share of the budget once loaded
+    const size_t workers = _resolve_threads(opt.n_threads);
+    const size_t bucket_target = std::max<size_t>(row_bytes, opt.memory_budget / workers);
+    const size_t n_buckets =
+            std::min(max_buckets, std::max<size_t>(1, (arr.num_bytes() + bucket_target - 1) / bucket_target));
+    const size_t flush_bytes = std::max(row_bytes, std::min<size_t>(size_t{8} << 20, opt.memory_budget / n_buckets));
+
+    // Pass 1: scatter rows to buckets, bucket of row i is a hash of (seed, i)
+    std::vector<std::unique_ptr<TempFile>> buckets;
+    for (size_t b = 0; b < n_buckets; ++b)
+        buckets.emplace_back(new TempFile(opt.tmp_dir));
+    std::vector<size_t> bucket_rows(n_buckets, 0);
+    std::vector<std::vector<char>> buffers(n_buckets);
+
+    const auto flush = [&](const size_t b) {
+        std::vector<char>& buf = buffers[b];
+        if (fwrite(buf.data(), 1, buf.size(), buckets[b]->fp) != buf.size())
+            throw std::runtime_error("shuffle_rows: failed fwrite on " + buckets[b]->path);
+        buf.clear();
+    };
+
+    const char* src = arr.data<char>();
+    const size_t prefetch_rows = std::max<size_t>(1, (size_t{16} << 20) / row_bytes);
+    const uint64_t seed_hash = _mix64(opt.seed);
+    for (size_t i = 0; i < rows; ++i) {
+        if (i % prefetch_rows == 0)
+            arr.prefetch((i + prefetch_rows) * row_bytes, prefetch_rows * row_bytes);
+        const size_t b = n_buckets == 1 ? 0 : _mix64(seed_hash ^ i) % n_buckets;
+        std::vector<char>& buf = buffers[b];
+        buf.insert(buf.end(), src + i * row_bytes, src + (i + 1) * row_bytes);
+        ++bucket_rows[b];
+        if (buf.size() >= flush_bytes)
+            flush(b);
+    }
+    for (size_t b = 0; b < n_buckets; ++b) {
+        flush(b);
+        buffers[b] = std::vector<char>();
+        fflush(buckets[b]->fp);
+    }
+
+    std::vector<size_t> bucket_begin(n_buckets, 0);
+    for (size_t b = 1; b < n_buckets; ++b)
+        bucket_begin[b] = bucket_begin[b - 1] + bucket_rows[b - 1];
+
+    // Pass 2: Fisher-Yates shuffle of every bucket in memory, then write it to its output range. Only as
+    // many buckets are loaded at once as fit in the budget.
+    const size_t largest = *std::max_element(bucket_rows.begin(), bucket_rows.end()) * row_bytes;
+    const size_t pass2_threads = std::max<size_t>(1, std::min(workers, opt.memory_budget / std::max<size_t>(1, largest)));
+    parallel_for(n_buckets, pass2_threads, [&](const size_t b) {
+        const size_t n = bucket_rows[b];
+        std::vector<char> data(n * row_bytes);
+        rewind(buckets[b]->fp);
+        if (fread(data.data(), 1, data.size(), buckets[b]->fp) != data.size())
+            throw std::runtime_error("shuffle_rows: failed fread on " + buckets[b]->path);
+
+        std::mt19937_64 rng(_mix64(seed_hash + b + 1));
+        std::vector<char> tmp(row_bytes);
+        for (size_t i = n; i > 1; --i) {
+            const size_t j = static_cast<size_t>(rng() % i);
+            if (j == i - 1)
+                continue;
+            char* a = data.data() + (i - 1) * row_bytes;
+            char* c = data.data() + j * row_bytes;
+            std::memcpy(tmp.data(), a, row_bytes);
+            std::memcpy(a, c, row_bytes);
+            std::memcpy(c, tmp.data(), row_bytes);
+        }
+
+        // The bucket's global range may straddle split boundaries
+        size_t done = 0;
+        while (done < n) {
+            const size_t global = bucket_begin[b] + done;
+            const size_t s = static_cast<size_t>(
+                    std::upper_bound(split_begin.begin(), split_begin.end(), global) - split_begin.begin() - 1);
+            const size_t take = std::min(n - done, split_begin[s + 1] - global);
+            _pwrite_all(out.fds[s], data.data() + done * row_bytes, take * row_bytes,
+                        out_offset[s] + (global - split_begin[s]) * row_bytes);
+            done += take;
+        }
+    });
+}
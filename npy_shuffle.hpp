@@ -0,0 +1,30 @@
+#ifndef NPY_SHUFFLE_H_
+#define NPY_SHUFFLE_H_
+
+#include "npy_utils.hpp"
+
+namespace npy {
+
+    struct ShuffleOptions {
+        uint64_t seed = 0;
+        // Upper bound on the bytes held in memory at once (bucket buffers in pass 1, loaded buckets in pass 2)
+        size_t memory_budget = size_t{1} << 30;
+        std::string tmp_dir = ".";
+        size_t n_threads = 0;
+    };
+
+    // Uniformly shuffle the rows (entries along axis 0) of a C-order npy file too large for memory.
+    // Pass 1 streams the input once and scatters every row to a random on-disk bucket through large
+    // buffered writes; pass 2 loads each bucket, shuffles it in memory and writes it to its final position.
+    // The result depends only on the input and opt.seed.
+    void shuffle_rows(const std::string& in_file, const std::string& out_file,
+                      const ShuffleOptions& opt = ShuffleOptions());
+
+    // Same as shuffle_rows, but the shuffled rows are split over out_files (e.g. train/val/test) in the
+    // given proportions; the last file receives any rounding remainder
+    void shuffle_split_rows(const std::string& in_file, const std::vector<std::string>& out_files,
+                            const std::vector<double>& fractions, const ShuffleOptions& opt = ShuffleOptions());
+
+} // namespace npy
+
+#endif
@@ -0,0 +1,123 @@
+#include "npy_sketch.hpp"
+
+size_t npy::KllSketch::capacity(const size_t level) const
+{
+    // Capacities shrink geometrically (factor 2/3) from the top level down
+    const size_t depth = levels.size() - level - 1;
+    return std::max<size_t>(2, static_cast<size_t>(std::ceil(static_cast<double>(k) * std::pow(2.0 / 3.0, depth))));
+}
+
+void npy::KllSketch::compress()
+{
+    for (size_t h = 0; h < levels.size(); ++h) {
+        if (levels[h].size() < capacity(h))
+            continue;
+        if (h + 1 == levels.size())
+            levels.emplace_back();
+
+        std::vector<double>& level = levels[h];
+        std::sort(level.begin(), level.end());
+        // Keep the odd item out at this level, promote every other remaining item with doubled weight
+        const size_t keep = level.size() % 2;
+        const size_t start = keep + (rng() & 1);
+        for (size_t i = start; i < level.size(); i += 2)
+            levels[h + 1].push_back(level[i]);
+        level.resize(keep);
+    }
+}
+
+void npy::KllSketch::merge(const KllSketch& other)
+{
+    if (levels.size() < other.levels.size())
+        levels.resize(other.levels.size());
+    for (size_t h = 0; h < other.levels.size(); ++h)
+        levels[h].insert(levels[h].end(), other.levels[h].begin(), other.levels[h].end());
+    n += other.n;
+
+    // Compaction may add a level, which lowers the capacity of every level below it
+    bool over = true;
+    while (over) {
+        compress();
+        over = false;
+        for (size_t h = 0; h < levels.size(); ++h)
+            over = over || levels[h].size() >= capacity(h);
+    }
+}
+
+double npy::KllSketch::quantile(const double q) const
+{
+    std::vector<std::pair<double, uint64_t>> items;
+    uint64_t total = 0;
+    for (size_t h = 0; h < levels.size(); ++h)
+        for (const double x: levels[h]) {
+            items.emplace_back(x, uint64_t{1} << h);
+            total += uint64_t{1} << h;
+        }
+    if (items.empty())
+        return std::nan("");
+
+    std::sort(items.begin(), items.end());
+    const double target = std::min(std::max(q, 0.0), 1.0) * static_cast<double>(total);
+    uint64_t seen = 0;
+    for (const auto& item: items) {
+        seen += item.second;
+        if (static_cast<double>(seen) >= target)
+            return item.first;
+    }
+    return items.back().first;
+}
+
+npy::Histogram::Histogram(const HistogramSpec& spec) : counts(spec.bins, 0), log_scale(spec.log_scale)
+{
+    if (spec.bins == 0 || !(spec.hi > spec.lo) || (spec.log_scale && spec.lo <= 0))
+        throw std::runtime_error("Histogram: invalid bucket specification");
+    a = log_scale ? std::log(spec.lo) : spec.lo;
+    b = log_scale ? std::log(spec.hi) : spec.hi;
+    scale = static_cast<double>(spec.bins) / (b - a);
+}
+
+void npy::Histogram::merge(const Histogram& other)
+{
+    if (other.counts.size() != counts.size() || other.a != a || other.scale != scale || other.log_scale != log_scale)
+        throw std::runtime_error("Histogram: cannot merge histograms with different buckets");
+    for (size_t i = 0; i < counts.size(); ++i)
+        counts[i] += other.counts[i];
+    underflow += other.underflow;
+    overflow += other.overflow;
+    nan_count += other.nan_count;
+}
+
+void npy::ColumnSketches::merge(const ColumnSketches& other)
+{
+    if (other.quantiles.size() != quantiles.size())
+        throw std::runtime_error("ColumnSketches: cannot merge sketches with different column counts");
+    for (size_t j = 0; j < quantiles.size(); ++j) {
+        quantiles[j].merge(other.quantiles[j]);
+        histograms[j].merge(other.histograms[j]);
+    }
+}
+
+void npy::save_quantiles(const ColumnSketches& sketches, const std::vector<double>& qs, const std::string& filename)
+{
+    Eigen::Matrix<double, -1, -1, Eigen::RowMajor> out(sketches.quantiles.size(), qs.size());
+    for (size_t j = 0; j < sketches.quantiles.size(); ++j)
+        for (size_t i = 0; i < qs.size(); ++i)
+            out(j, i) = sketches.quantiles[j].quantile(qs[i]);
+    save_arr_as_matrix(filename, out.data(), out.rows(), out.cols());
+}
+
+void npy::save_histograms(const ColumnSketches& sketches, const std::string& filename)
+{
+    const size_t cols = sketches.histograms.size();
+    const size_t bins = cols ? sketches.histograms[0].counts.size() : 0;
+    Eigen::Matrix<int64_t, -1, -1, Eigen::RowMajor> out(cols, bins + 3);
+    for (size_t j = 0; j < cols; ++j) {
+        const Histogram& h = sketches.histograms[j];
+        for (size_t b = 0; b < bins; ++b)
+            out(j, b) = h.counts[b];
+        out(j, bins) = h.underflow;
+        out(j, bins + 1) = h.overflow;
+        out(j, bins + 2) = h.nan_count;
+    }
+    save_arr_as_matrix(filename, out.data(), out.rows(), out.cols());
+}
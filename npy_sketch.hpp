@@ -0,0 +1,152 @@
+#ifndef NPY_SKETCH_H_
+#define NPY_SKETCH_H_
+
+#include "npy_chunks.hpp"
+
+#include <cmath>
+#include <random>
+
+namespace npy {
+
+    // KLL quantile sketch: O(k log(n / k)) memory, rank error around 1.7 / k, mergeable. NaNs are skipped.
+    class KllSketch {
+    public:
+        explicit KllSketch(size_t k = 200) : k(k), levels(1) {}
+
+        void add(double x)
+        {
+            if (std::isnan(x))
+                return;
+            levels[0].push_back(x);
+            ++n;
+            if (levels[0].size() >= capacity(0))
+                compress();
+        }
+
+        void merge(const KllSketch& other);
+
+        // Approximate q-quantile, q in [0, 1]; NaN for an empty sketch
+        [[nodiscard]] double quantile(double q) const;
+        [[nodiscard]] size_t count() const { return n; }
+
+    private:
+        [[nodiscard]] size_t capacity(size_t level) const;
+        void compress();
+
+        size_t k;
+        size_t n = 0;
+        std::minstd_rand rng;
+        std::vector<std::vector<double>> levels;
+    };
+
+    // Fixed-bucket histogram over [lo, hi) with linear or logarithmic (lo > 0) bucket edges
+    struct HistogramSpec {
+        double lo = 0;
+        double hi = 1;
+        size_t bins = 64;
+        bool log_scale = false;
+    };
+
+    class Histogram {
+    public:
+        explicit Histogram(const HistogramSpec& spec = HistogramSpec());
+
+        void add(double x)
+        {
+            if (std::isnan(x)) {
+                ++nan_count;
+                return;
+            }
+            const double t = log_scale ? (x > 0 ? std::log(x) : -HUGE_VAL) : x;
+            if (t < a) {
+                ++underflow;
+                return;
+            }
+            // Range checks stay in double: converting +inf or huge values to size_t is undefined
+            if (t >= b) {
+                ++overflow;
+                return;
+            }
+            // t just below b can still round up to counts.size()
+            ++counts[std::min(static_cast<size_t>((t - a) * scale), counts.size() - 1)];
+        }
+
+        void merge(const Histogram& other);
+
+        std::vector<int64_t> counts;
+        int64_t underflow = 0;
+        int64_t overflow = 0;
+        int64_t nan_count = 0;
+
+    private:
+        bool log_scale;
+        double a;
+        double b;
+        double scale;
+    };
+
+    // One quantile sketch and one histogram per column
+    struct ColumnSketches {
+        std::vector<KllSketch> quantiles;
+        std::vector<Histogram> histograms;
+
+        ColumnSketches() = default;
+        ColumnSketches(size_t cols, const HistogramSpec& spec, size_t k) :
+            quantiles(cols, KllSketch(k)), histograms(cols, Histogram(spec))
+        {}
+
+        // Combine with sketches of the same columns over other rows (e.g. another shard)
+        void merge(const ColumnSketches& other);
+    };
+
+    // (cols, qs.size()) float64 matrix of approximate quantiles
+    void save_quantiles(const ColumnSketches& sketches, const std::vector<double>& qs, const std::string& filename);
+    // (cols, bins + 3) int64 matrix: bucket counts followed by underflow, overflow and NaN counts
+    void save_histograms(const ColumnSketches& sketches, const std::string& filename);
+
+    // Single pass over a MappedNpy or VirtualArray computing per-column sketches in parallel chunks.
+    // Each worker keeps its own sketches and they are merged at the end.
+    template<typename T, typename Source>
+    auto column_sketches(const Source& src, const HistogramSpec& spec, const size_t k = 200,
+                         const size_t chunk_rows = 1 << 14, const size_t n_threads = 0) -> ColumnSketches
+    {
+        const size_t cols = _num_cols(src);
+        std::vector<std::unique_ptr<ColumnSketches>> partial(_resolve_threads(n_threads));
+
+        for_each_chunk_worker<T>(
+                src, chunk_rows,
+                [&](const size_t worker, const size_t offset, const auto& block) {
+                    if (!partial[worker])
+                        partial[worker].reset(new ColumnSketches(cols, spec, k));
+                    ColumnSketches& s = *partial[worker];
+                    // Column blocks of Fortran-order files start at column `offset`
+                    const size_t col0 = std::decay_t<decltype(block)>::IsRowMajor ? 0 : offset;
+                    for (Eigen::Index j = 0; j < block.cols(); ++j) {
+                        KllSketch& q = s.quantiles[col0 + j];
+                        Histogram& h = s.histograms[col0 + j];
+                        for (Eigen::Index i = 0; i < block.rows(); ++i) {
+                            const auto x = static_cast<double>(block(i, j));
+                            q.add(x);
+                            h.add(x);
+                        }
+                    }
+                },
+                n_threads);
+
+        ColumnSketches result(cols, spec, k);
+        for (const auto& p: partial)
+            if (p)
+                result.merge(*p);
+        return result;
+    }
+
+    template<typename T>
+    auto column_sketches(const std::string& fname, const HistogramSpec& spec, const size_t k = 200,
+                         const size_t chunk_rows = 1 << 14, const size_t n_threads = 0) -> ColumnSketches
+    {
+        return column_sketches<T>(MappedNpy(fname), spec, k, chunk_rows, n_threads);
+    }
+
+} // namespace npy
+
+#endif
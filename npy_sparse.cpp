@@ -0,0 +1,118 @@
+#include "npy_sparse.hpp"
+
+#include <cstring>
+
+npy::MappedCsr::MappedCsr(const std::string& npz_file)
+{
+    std::map<std::string, MappedNpy> arrays = map_npz(npz_file);
+    for (const char* name: {"indptr", "indices", "data", "shape"})
+        if (!arrays.count(name))
+            throw std::runtime_error("MappedCsr: " + npz_file + " has no member '" + name + "'");
+    if (arrays.count("format")) {
+        const MappedNpy& f = arrays["format"];
+        if (std::string(f.data<char>(), f.num_bytes()).compare(0, 3, "csr") != 0)
+            throw std::runtime_error("MappedCsr: " + npz_file + " does not hold a CSR matrix");
+    }
+    indptr = arrays["indptr"];
+    indices = arrays["indices"];
+    data = arrays["data"];
+    for (const MappedNpy* a: {&indptr, &indices})
+        if (a->shape().size() != 1 || (a->word_size() != 4 && a->word_size() != 8) || a->header().descr[1] != 'i')
+            throw std::runtime_error("MappedCsr: indptr and indices must be int32 or int64 vectors");
+
+    const MappedNpy& shape = arrays["shape"];
+    if (shape.num_vals() != 2 || shape.word_size() != 8)
+        throw std::runtime_error("MappedCsr: expected an int64 shape of length 2 in " + npz_file);
+    n_rows = static_cast<size_t>(shape.data<int64_t>()[0]);
+    n_cols = static_cast<size_t>(shape.data<int64_t>()[1]);
+    n_nnz = indices.num_vals();
+    if (indptr.num_vals() != n_rows + 1 || data.num_vals() != n_nnz)
+        throw std::runtime_error("MappedCsr: inconsistent array sizes in " + npz_file);
+}
+
+auto npy::MappedCsr::row_partition(size_t n_parts) const -> std::vector<size_t>
+{
+    n_parts = std::max<size_t>(1, std::min(n_parts, n_rows));
+    std::vector<size_t> bounds(n_parts + 1, n_rows);
+    visit([&](const auto* ptr, const auto*) {
+        for (size_t p = 0; p < n_parts; ++p) {
+            const auto target = static_cast<int64_t>(n_nnz / n_parts * p);
+            bounds[p] = static_cast<size_t>(
+                    std::lower_bound(ptr, ptr + n_rows, target, [](const auto a, const int64_t b) { return a < b; }) -
+                    ptr);
+        }
+    });
+    bounds[0] = 0;
+    bounds[n_parts] = n_rows;
+    for (size_t p = 1; p < n_parts; ++p)
+        bounds[p] = std::max(bounds[p], bounds[p - 1]);
+    return bounds;
+}
+
+namespace {
+
+    template<typename V>
+    auto pagerank_impl(const npy::MappedCsr& A, const V* vals, const npy::PageRankOptions& opt) -> Eigen::VectorXd
+    {
+        const size_t n = A.rows();
+        // Out-weight of node j = sum of column j, added up by all threads into one shared vector
+        std::vector<std::atomic<double>> column_sum(n);
+        for (auto& c: column_sum)
+            c.store(0.0, std::memory_order_relaxed);
+        const std::vector<size_t> parts = A.row_partition(4 * npy::_resolve_threads(opt.n_threads));
+        A.visit([&](const auto* indptr, const auto* indices) {
+            npy::parallel_for(parts.size() - 1, opt.n_threads, [&](const size_t p) {
+                for (auto k = static_cast<size_t>(indptr[parts[p]]); k < static_cast<size_t>(indptr[parts[p + 1]]);
+                     ++k) {
+                    std::atomic<double>& c = column_sum[static_cast<size_t>(indices[k])];
+                    const auto v = static_cast<double>(vals[k]);
+                    double old = c.load(std::memory_order_relaxed);
+                    while (!c.compare_exchange_weak(old, old + v, std::memory_order_relaxed))
+                        ;
+                }
+            });
+        });
+        Eigen::VectorXd out_weight(n);
+        for (size_t j = 0; j < n; ++j)
+            out_weight[static_cast<Eigen::Index>(j)] = column_sum[j].load(std::memory_order_relaxed);
+        column_sum = std::vector<std::atomic<double>>();
+
+        const auto nd = static_cast<double>(n);
+        const Eigen::ArrayXd dangling = (out_weight.array() == 0).cast<double>();
+        const Eigen::ArrayXd inv_out = (out_weight.array() == 0).select(0.0, out_weight.array().inverse());
+        Eigen::VectorXd rank = Eigen::VectorXd::Constant(static_cast<Eigen::Index>(n), 1.0 / nd);
+        Eigen::VectorXd scaled(n), next(n);
+        for (size_t it = 0; it < opt.max_iter; ++it) {
+            scaled = rank.array() * inv_out;
+            npy::_spmv(A, vals, scaled.data(), next.data(), opt.n_threads);
+            const double lost = (rank.array() * dangling).sum();
+            next = (opt.damping * (next.array() + lost / nd) + (1 - opt.damping) / nd).matrix();
+            const double delta = (next - rank).lpNorm<1>();
+            rank.swap(next);
+            if (delta < opt.tol)
+                break;
+        }
+        return rank;
+    }
+
+} // namespace
+
+auto npy::pagerank(const MappedCsr& A, const PageRankOptions& opt) -> Eigen::VectorXd
+{
+    if (A.rows() != A.cols())
+        throw std::runtime_error("pagerank: expected a square matrix");
+    if (A.rows() == 0)
+        return Eigen::VectorXd();
+    Eigen::VectorXd rank;
+    A.visit_values([&](const auto* vals) { rank = pagerank_impl(A, vals, opt); });
+    return rank;
+}
+
+bool npy::is_npz_file(const std::string& fname)
+{
+    const file_ptr fp = _open_file(fname, "rb");
+    if (!fp)
+        throw std::runtime_error("is_npz_file: Unable to open file " + fname);
+    char magic[4] = {};
+    return fread(magic, 1, sizeof(magic), fp.get()) == sizeof(magic) && std::memcmp(magic, "PK\x03\x04", 4) == 0;
+}
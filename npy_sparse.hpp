@@ -0,0 +1,358 @@
+#ifndef NPY_SPARSE_H_
+#define NPY_SPARSE_H_
+
+#include "npy_mmap.hpp"
+#include "npy_parallel.hpp"
+
+#include <Eigen/Sparse>
+#include <unistd.h>
+
+namespace npy {
+
+    // CSR matrix saved by scipy.sparse.save_npz(..., compressed=False), used in place: indptr, indices and
+    // data stay memory-mapped and no Eigen::SparseMatrix is ever built. indptr and indices may be int32 or
+    // int64 independently; kernels are instantiated for the combination found in the file.
+    class MappedCsr {
+    public:
+        explicit MappedCsr(const std::string& npz_file);
+
+        [[nodiscard]] size_t rows() const { return n_rows; }
+        [[nodiscard]] size_t cols() const { return n_cols; }
+        [[nodiscard]] size_t nnz() const { return n_nnz; }
+        [[nodiscard]] const MappedNpy& values() const { return data; }
+
+        // Call f(indptr, indices) with both arrays as pointers of their stored integer types
+        template<typename F>
+        void visit(F&& f) const
+        {
+            if (indptr.word_size() == 8 && indices.word_size() == 8)
+                f(indptr.data<int64_t>(), indices.data<int64_t>());
+            else if (indptr.word_size() == 8)
+                f(indptr.data<int64_t>(), indices.data<int32_t>());
+            else if (indices.word_size() == 8)
+                f(indptr.data<int32_t>(), indices.data<int64_t>());
+            else
+                f(indptr.data<int32_t>(), indices.data<int32_t>());
+        }
+
+        // Row boundaries of n_parts ranges holding about the same number of nonzeros (rows are never split)
+        auto row_partition(size_t n_parts) const -> std::vector<size_t>;
+
+        template<typename T>
+        const T* values_as() const
+        {
+            if (data.header().descr != _npy_descr<T>())
+                throw std::runtime_error("MappedCsr: data type " + data.header().descr + " does not match");
+            return data.data<T>();
+        }
+
+        // Call f(values) with the nonzeros as a pointer of their stored type (any float, integer or bool dtype)
+        template<typename F>
+        void visit_values(F&& f) const
+        {
+            const std::string& d = data.header().descr;
+            if (d == "<f8")
+                f(data.data<double>());
+            else if (d == "<f4")
+                f(data.data<float>());
+            else if (d == "<i8")
+                f(data.data<int64_t>());
+            else if (d == "<i4")
+                f(data.data<int32_t>());
+            else if (d == "<i2")
+                f(data.data<int16_t>());
+            else if (d == "|i1")
+                f(data.data<int8_t>());
+            else if (d == "<u8")
+                f(data.data<uint64_t>());
+            else if (d == "<u4")
+                f(data.data<uint32_t>());
+            else if (d == "<u2")
+                f(data.data<uint16_t>());
+            else if (d == "|u1" || d == "|b1")
+                f(data.data<uint8_t>());
+            else
+                throw std::runtime_error("MappedCsr: unsupported data type " + d);
+        }
+
+    private:
+        MappedNpy indptr, indices, data;
+        size_t n_rows = 0, n_cols = 0, n_nnz = 0;
+    };
+
+    // Distance, in nonzeros, at which x[indices[k]] is prefetched ahead of its use
+    constexpr size_t csr_prefetch_distance = 16;
+
+    // y = A x for dense x of A.cols() entries and y of A.rows() entries. Rows are split into nnz-balanced
+    // ranges (four per thread) and the gathers from x are software-prefetched.
+    template<typename T, typename V>
+    void _spmv(const MappedCsr& A, const V* vals, const T* x, T* y, const size_t n_threads)
+    {
+        const std::vector<size_t> parts = A.row_partition(4 * _resolve_threads(n_threads));
+        A.visit([&](const auto* indptr, const auto* indices) {
+            parallel_for(parts.size() - 1, n_threads, [&](const size_t p) {
+                const auto end = static_cast<size_t>(indptr[parts[p + 1]]);
+                for (size_t r = parts[p]; r < parts[p + 1]; ++r) {
+                    T acc = 0;
+                    for (auto k = static_cast<size_t>(indptr[r]); k < static_cast<size_t>(indptr[r + 1]); ++k) {
+                        if (k + csr_prefetch_distance < end)
+                            __builtin_prefetch(x + indices[k + csr_prefetch_distance]);
+                        acc += static_cast<T>(vals[k]) * x[indices[k]];
+                    }
+                    y[r] = acc;
+                }
+            });
+        });
+    }
+
+    template<typename T>
+    void spmv(const MappedCsr& A, const T* x, T* y, const size_t n_threads = 0)
+    {
+        _spmv(A, A.values_as<T>(), x, y, n_threads);
+    }
+
+    template<typename T>
+    auto spmv(const MappedCsr& A, const Eigen::Matrix<T, -1, 1>& x, const size_t n_threads = 0)
+            -> Eigen::Matrix<T, -1, 1>
+    {
+        if (static_cast<size_t>(x.size()) != A.cols())
+            throw std::runtime_error("spmv: x has " + std::to_string(x.size()) + " entries, expected " +
+                                     std::to_string(A.cols()));
+        Eigen::Matrix<T, -1, 1> y(A.rows());
+        spmv<T>(A, x.data(), y.data(), n_threads);
+        return y;
+    }
+
+    // Y = A X for a dense row-major X with A.cols() rows; each nonzero scales one contiguous row of X
+    template<typename T>
+    auto spmm(const MappedCsr& A, const Eigen::Matrix<T, -1, -1, Eigen::RowMajor>& X, const size_t n_threads = 0)
+            -> Eigen::Matrix<T, -1, -1, Eigen::RowMajor>
+    {
+        if (static_cast<size_t>(X.rows()) != A.cols())
+            throw std::runtime_error("spmm: X has " + std::to_string(X.rows()) + " rows, expected " +
+                                     std::to_string(A.cols()));
+        const T* vals = A.values_as<T>();
+        const auto k_cols = X.cols();
+        Eigen::Matrix<T, -1, -1, Eigen::RowMajor> Y = Eigen::Matrix<T, -1, -1, Eigen::RowMajor>::Zero(A.rows(), k_cols);
+        const std::vector<size_t> parts = A.row_partition(4 * _resolve_threads(n_threads));
+        A.visit([&](const auto* indptr, const auto* indices) {
+            parallel_for(parts.size() - 1, n_threads, [&](const size_t p) {
+                const auto end = static_cast<size_t>(indptr[parts[p + 1]]);
+                for (size_t r = parts[p]; r < parts[p + 1]; ++r) {
+                    auto y = Y.row(static_cast<Eigen::Index>(r));
+                    for (auto k = static_cast<size_t>(indptr[r]); k < static_cast<size_t>(indptr[r + 1]); ++k) {
+                        if (k + csr_prefetch_distance < end)
+                            __builtin_prefetch(X.data() + indices[k + csr_prefetch_distance] * k_cols);
+                        y += vals[k] * X.row(static_cast<Eigen::Index>(indices[k]));
+                    }
+                }
+            });
+        });
+        return Y;
+    }
+
+    struct PageRankOptions {
+        double damping = 0.85;
+        // Stop once the L1 change of the rank vector falls below tol
+        double tol = 1e-10;
+        size_t max_iter = 100;
+        size_t n_threads = 0;
+    };
+
+    // PageRank over a square CSR matrix in pull form: A(i, j) is the weight of the edge j -> i, i.e. the
+    // transpose of the usual adjacency matrix (save adjacency.T.tocsr()). The weights may be of any float,
+    // integer or bool type and are read as double. Out-weights are the column sums of A, accumulated in one
+    // parallel pass, and dangling nodes spread their rank uniformly. Every iteration is one spmv on the mapped
+    // arrays.
+    auto pagerank(const MappedCsr& A, const PageRankOptions& opt = PageRankOptions()) -> Eigen::VectorXd;
+
+    // Fraction of nonzero entries estimated from `samples` pseudo-random positions (exact for small matrices)
+    template<typename T, int ORDER>
+    double estimate_density(const Eigen::Matrix<T, -1, -1, ORDER>& mat, const size_t samples = 4096,
+                            const uint64_t seed = 0)
+    {
+        const auto n = static_cast<size_t>(mat.size());
+        if (n == 0)
+            return 0;
+        if (n <= samples)
+            return static_cast<double>((mat.array() != T(0)).count()) / static_cast<double>(n);
+        size_t nonzero = 0;
+        for (size_t s = 0; s < samples; ++s)
+            nonzero += mat.data()[_mix64(seed + s) % n] != T(0);
+        return static_cast<double>(nonzero) / static_cast<double>(samples);
+    }
+
+    // Rows per task when counting and gathering nonzeros
+    constexpr size_t csr_row_block = 256;
+
+    // Count the nonzeros of every row, in parallel over row blocks; Eigen vectorizes the comparisons
+    template<typename T, int ORDER>
+    auto _row_nnz(const Eigen::Matrix<T, -1, -1, ORDER>& mat, const size_t n_threads) -> std::vector<int64_t>
+    {
+        const auto rows = static_cast<size_t>(mat.rows());
+        std::vector<int64_t> nnz(rows);
+        parallel_for((rows + csr_row_block - 1) / csr_row_block, n_threads, [&](const size_t t) {
+            const auto r0 = static_cast<Eigen::Index>(t * csr_row_block);
+            const auto len = static_cast<Eigen::Index>(std::min(csr_row_block, rows - t * csr_row_block));
+            Eigen::Map<Eigen::Matrix<int64_t, -1, 1>> out(nnz.data() + r0, len);
+            if (ORDER == Eigen::RowMajor)
+                out = (mat.middleRows(r0, len).array() != T(0)).rowwise().count().template cast<int64_t>();
+            else
+                for (Eigen::Index j = 0; j < mat.cols(); ++j)
+                    out.array() += (mat.col(j).segment(r0, len).array() != T(0)).template cast<int64_t>();
+        });
+        return nnz;
+    }
+
+    // Gather the nonzeros into CSR arrays (indptr already prefix-summed), rows sorted by column
+    template<typename T, int ORDER, typename I>
+    void _fill_csr(const Eigen::Matrix<T, -1, -1, ORDER>& mat, const std::vector<I>& indptr, std::vector<I>& indices,
+                   std::vector<T>& values, const size_t n_threads)
+    {
+        const auto rows = static_cast<size_t>(mat.rows());
+        const auto cols = static_cast<Eigen::Index>(mat.cols());
+        parallel_for((rows + csr_row_block - 1) / csr_row_block, n_threads, [&](const size_t t) {
+            const size_t r0 = t * csr_row_block, r1 = std::min(rows, r0 + csr_row_block);
+            std::vector<I> cursor(indptr.begin() + static_cast<std::ptrdiff_t>(r0),
+                                  indptr.begin() + static_cast<std::ptrdiff_t>(r1));
+            const auto put = [&](const size_t r, const Eigen::Index j, const T v) {
+                I& at = cursor[r - r0];
+                indices[static_cast<size_t>(at)] = static_cast<I>(j);
+                values[static_cast<size_t>(at)] = v;
+                ++at;
+            };
+            if (ORDER == Eigen::RowMajor) {
+                for (size_t r = r0; r < r1; ++r)
+                    for (Eigen::Index j = 0; j < cols; ++j)
+                        if (mat(static_cast<Eigen::Index>(r), j) != T(0))
+                            put(r, j, mat(static_cast<Eigen::Index>(r), j));
+            } else {
+                for (Eigen::Index j = 0; j < cols; ++j)
+                    for (size_t r = r0; r < r1; ++r)
+                        if (mat(static_cast<Eigen::Index>(r), j) != T(0))
+                            put(r, j, mat(static_cast<Eigen::Index>(r), j));
+            }
+        });
+    }
+
+    template<typename T, int ORDER, typename I>
+    void _save_csr_npz(const std::string& fname, const Eigen::Matrix<T, -1, -1, ORDER>& mat,
+                       const std::vector<int64_t>& row_nnz, const size_t n_threads)
+    {
+        std::vector<I> indptr(row_nnz.size() + 1, 0);
+        for (size_t r = 0; r < row_nnz.size(); ++r)
+            indptr[r + 1] = indptr[r] + static_cast<I>(row_nnz[r]);
+        const auto nnz = static_cast<size_t>(indptr.back());
+        std::vector<I> indices(nnz);
+        std::vector<T> values(nnz);
+        _fill_csr(mat, indptr, indices, values, n_threads);
+
+        const int64_t shape[2] = {static_cast<int64_t>(mat.rows()), static_cast<int64_t>(mat.cols())};
+        save_npz(fname, {{"indices", _npy_descr<I>(), {nnz}, indices.data()},
+                         {"indptr", _npy_descr<I>(), {indptr.size()}, indptr.data()},
+                         {"format", "|S3", {}, "csr"},
+                         {"shape", _npy_descr<int64_t>(), {2}, shape},
+                         {"data", _npy_descr<T>(), {nnz}, values.data()}});
+    }
+
+    // Save mat as a CSR npz that scipy.sparse.load_npz reads (and MappedCsr maps); indices are int32 when they
+    // fit, as scipy would choose, int64 otherwise
+    template<typename T, int ORDER>
+    void save_csr_npz(const std::string& fname, const Eigen::Matrix<T, -1, -1, ORDER>& mat, const size_t n_threads = 0)
+    {
+        const std::vector<int64_t> row_nnz = _row_nnz(mat, n_threads);
+        int64_t nnz = 0;
+        for (const int64_t n: row_nnz)
+            nnz += n;
+        if (nnz <= INT32_MAX && mat.cols() <= INT32_MAX)
+            _save_csr_npz<T, ORDER, int32_t>(fname, mat, row_nnz, n_threads);
+        else
+            _save_csr_npz<T, ORDER, int64_t>(fname, mat, row_nnz, n_threads);
+    }
+
+    // Save mat as a CSR npz when its sampled density is below density_threshold, otherwise (density at or above
+    // the threshold) as a plain npy file at the same path; load_mat_adaptive tells the two apart by their magic
+    // bytes. Returns whether CSR was written.
+    template<typename T, int ORDER>
+    bool save_mat_adaptive(const std::string& fname, const Eigen::Matrix<T, -1, -1, ORDER>& mat,
+                           const double density_threshold = 0.05, const size_t n_threads = 0)
+    {
+        if (estimate_density(mat) < density_threshold) {
+            save_csr_npz(fname, mat, n_threads);
+            return true;
+        }
+        size_t data_offset;
+        const int fd = _create_npy_file(fname, _npy_descr<T>(), ORDER == Eigen::ColMajor,
+                                        {static_cast<size_t>(mat.rows()), static_cast<size_t>(mat.cols())},
+                                        data_offset);
+        try {
+            _pwrite_all(fd, mat.data(), static_cast<size_t>(mat.size()) * sizeof(T), data_offset);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        close(fd);
+        return false;
+    }
+
+    // Whether fname is a zip archive (npz) rather than a plain npy file
+    bool is_npz_file(const std::string& fname);
+
+    // Dense matrix from either a plain npy file or a CSR npz, whose nonzeros are scattered into the zeroed
+    // result in parallel over nnz-balanced row ranges
+    template<typename T, int ORDER = Eigen::RowMajor>
+    auto load_mat_adaptive(const std::string& fname, const size_t n_threads = 0) -> Eigen::Matrix<T, -1, -1, ORDER>
+    {
+        if (!is_npz_file(fname))
+            return load_npy_mat<T, ORDER>(fname);
+        const MappedCsr A(fname);
+        const T* vals = A.values_as<T>();
+        Eigen::Matrix<T, -1, -1, ORDER> out(A.rows(), A.cols());
+        const std::vector<size_t> parts = A.row_partition(4 * _resolve_threads(n_threads));
+        A.visit([&](const auto* indptr, const auto* indices) {
+            parallel_for(parts.size() - 1, n_threads, [&](const size_t p) {
+                const auto r0 = static_cast<Eigen::Index>(parts[p]);
+                const auto n = static_cast<Eigen::Index>(parts[p + 1] - parts[p]);
+                out.middleRows(r0, n).setZero();
+                for (size_t r = parts[p]; r < parts[p + 1]; ++r)
+                    for (auto k = static_cast<size_t>(indptr[r]); k < static_cast<size_t>(indptr[r + 1]); ++k)
+                        out(static_cast<Eigen::Index>(r), static_cast<Eigen::Index>(indices[k])) = vals[k];
+            });
+        });
+        return out;
+    }
+
+    // Eigen sparse matrix from a CSR npz (arrays copied in parallel) or from a dense npy file
+    template<typename T>
+    auto load_sparse_mat(const std::string& fname, const size_t n_threads = 0) -> Eigen::SparseMatrix<T, Eigen::RowMajor>
+    {
+        using Sparse = Eigen::SparseMatrix<T, Eigen::RowMajor>;
+        using Index = typename Sparse::StorageIndex;
+        if (!is_npz_file(fname))
+            return load_npy_mat<T>(fname).sparseView();
+        const MappedCsr A(fname);
+        if (A.nnz() > static_cast<size_t>(std::numeric_limits<Index>::max()))
+            throw std::runtime_error("load_sparse_mat: too many nonzeros for Eigen's index type in " + fname);
+        const T* vals = A.values_as<T>();
+        Sparse S(static_cast<Eigen::Index>(A.rows()), static_cast<Eigen::Index>(A.cols()));
+        S.resizeNonZeros(static_cast<Eigen::Index>(A.nnz()));
+        const std::vector<size_t> parts = A.row_partition(4 * _resolve_threads(n_threads));
+        A.visit([&](const auto* indptr, const auto* indices) {
+            parallel_for(parts.size() - 1, n_threads, [&](const size_t p) {
+                for (size_t r = parts[p]; r < parts[p + 1]; ++r)
+                    S.outerIndexPtr()[r + 1] = static_cast<Index>(indptr[r + 1]);
+                const auto k0 = static_cast<size_t>(indptr[parts[p]]);
+                const auto k1 = static_cast<size_t>(indptr[parts[p + 1]]);
+                for (size_t k = k0; k < k1; ++k) {
+                    S.innerIndexPtr()[k] = static_cast<Index>(indices[k]);
+                    S.valuePtr()[k] = vals[k];
+                }
+            });
+        });
+        S.outerIndexPtr()[0] = 0;
+        return S;
+    }
+
+} // namespace npy
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef NPY_STACKER_H_
+#define NPY_STACKER_H_
+
+#include "npy_utils.hpp"
+
+namespace npy {
+
+    // Incremental version of npy_folder2mat for folders that keep gaining prefix{i}suffix shards.
+    // The stacked rows stay in memory between calls and refresh() only opens and reads shards that
+    // appeared since the previous call, so refreshing costs O(new data). Shards must be 2D C-order
+    // arrays with the same column count; their row counts may differ.
+    template<typename T>
+    class FolderStacker {
+    public:
+        FolderStacker(std::string folder_name, std::string prefix, const int start_i, std::string suffix) :
+            folder_name(std::move(folder_name)), prefix(std::move(prefix)), suffix(std::move(suffix)), next_i(start_i)
+        {}
+
+        // Append every new complete shard, returns the number of shards added. A shard that is still being
+        // written (header incomplete or payload shorter than its header claims) stops the scan and is picked
+        // up by a later call.
+        size_t refresh()
+        {
+            size_t added = 0;
+            while (true) {
+                const std::string file_name = folder_name + "/" + prefix + std::to_string(next_i) + suffix;
+                file_ptr fp = _open_file(file_name, "rb");
+                if (!fp)
+                    break;
+                if (!header_written(fp.get()))
+                    break;
+
+                std::vector<size_t> shape;
+                size_t word_size;
+                bool fortran_order;
+                npy::parse_npy_header(fp.get(), word_size, shape, fortran_order);
+                if (shape.size() != 2 || fortran_order)
+                    throw std::runtime_error("FolderStacker: " + file_name + " is not a 2D C-order array");
+                if (word_size != sizeof(T))
+                    throw std::runtime_error("FolderStacker: word size mismatch in " + file_name);
+                if (n_shards == 0)
+                    cols = shape[1];
+                else if (shape[1] != cols)
+                    throw std::runtime_error("FolderStacker: column count mismatch in " + file_name);
+
+                const size_t n_bytes = shape[0] * shape[1] * sizeof(T);
+                const long data_offset = ftell(fp.get());
+                fseek(fp.get(), 0, SEEK_END);
+                if (static_cast<size_t>(ftell(fp.get()) - data_offset) < n_bytes)
+                    break;
+                fseek(fp.get(), data_offset, SEEK_SET);
+
+                grow(n_rows + shape[0]);
+                T* dst = buffer.data() + n_rows * cols;
+                if (fread(dst, 1, n_bytes, fp.get()) != n_bytes)
+                    throw std::runtime_error("FolderStacker: failed fread on " + file_name);
+
+                n_rows += shape[0];
+                ++n_shards;
+                ++next_i;
+                ++added;
+            }
+            return added;
+        }
+
+        // View over all rows stacked so far; invalidated by the next refresh() that adds shards
+        auto mat() const -> Eigen::Map<const Eigen::Matrix<T, -1, -1, Eigen::RowMajor>>
+        {
+            return Eigen::Map<const Eigen::Matrix<T, -1, -1, Eigen::RowMajor>>(buffer.data(), n_rows, cols);
+        }
+
+        [[nodiscard]] size_t rows() const { return n_rows; }
+        [[nodiscard]] size_t num_cols() const { return cols; }
+        [[nodiscard]] size_t num_shards() const { return n_shards; }
+
+    private:
+        // Whether the file already holds its whole npy header (parse_npy_header throws on a truncated one)
+        static bool header_written(FILE* fp)
+        {
+            unsigned char pre[12];
+            const size_t got = fread(pre, 1, sizeof(pre), fp);
+            fseek(fp, 0, SEEK_END);
+            const auto size = static_cast<size_t>(ftell(fp));
+            rewind(fp);
+            if (got < 10)
+                return false;
+            // Version 1.0 stores the header length in 2 bytes, later versions in 4
+            size_t header_end;
+            if (pre[6] == 1)
+                header_end = 10 + (pre[8] | pre[9] << 8);
+            else if (got < 12)
+                return false;
+            else
+                header_end = 12 + (pre[8] | pre[9] << 8 | pre[10] << 16 | static_cast<size_t>(pre[11]) << 24);
+            return size >= header_end;
+        }
+
+        // Geometric growth keeps the total copying over many refreshes linear in the stacked size
+        void grow(const size_t total_rows)
+        {
+            const size_t needed = total_rows * cols;
+            if (needed > buffer.capacity())
+                buffer.reserve(std::max(needed, 2 * buffer.capacity()));
+            buffer.resize(needed);
+        }
+
+        std::string folder_name;
+        std::string prefix;
+        std::string suffix;
+        int next_i;
+        size_t n_shards = 0;
+        size_t n_rows = 0;
+        size_t cols = 0;
+        std::vector<T> buffer;
+    };
+
+} // namespace npy
+
+#endif
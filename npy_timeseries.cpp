@@ -0,0 +1,476 @@
+#include "npy_timeseries.hpp"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+    constexpr char ts_magic[8] = {'N', 'P', 'Y', 'G', 'O', 'R', 'L', 'A'};
+    constexpr uint32_t ts_version = 1;
+    constexpr size_t ts_header_size = 8 + 4 + 4 + 3 * 8;
+
+    // MSB-first bit stream in 64-bit words
+    class BitWriter {
+    public:
+        explicit BitWriter(std::vector<uint64_t>& words) : words(words) {}
+
+        // Append the low n bits of v, 0 <= n <= 64
+        void write(uint64_t v, const unsigned n)
+        {
+            if (n == 0)
+                return;
+            if (n < 64)
+                v &= (uint64_t{1} << n) - 1;
+            const unsigned space = 64 - fill;
+            if (n < space) {
+                cur |= v << (space - n);
+                fill += n;
+                return;
+            }
+            words.push_back(cur | v >> (n - space));
+            fill = n - space;
+            cur = fill == 0 ? 0 : v << (64 - fill);
+        }
+
+        void flush()
+        {
+            if (fill > 0)
+                words.push_back(cur);
+            cur = 0;
+            fill = 0;
+        }
+
+    private:
+        std::vector<uint64_t>& words;
+        uint64_t cur = 0;
+        unsigned fill = 0;
+    };
+
+    // Reads may look one word past the block, which the writer guarantees exists (padding word at the end)
+    class BitReader {
+    public:
+        explicit BitReader(const uint64_t* words) : words(words) {}
+
+        // Next 64 bits of the stream without consuming them
+        [[nodiscard]] uint64_t peek() const
+        {
+            const size_t w = pos >> 6;
+            const unsigned off = pos & 63;
+            return words[w] << off | (words[w + 1] >> 1) >> (63 - off);
+        }
+
+        void skip(const unsigned n) { pos += n; }
+
+        // Consume n bits, 0 <= n <= 64
+        uint64_t read(const unsigned n)
+        {
+            const uint64_t v = n == 0 ? 0 : peek() >> (64 - n);
+            pos += n;
+            return v;
+        }
+
+    private:
+        const uint64_t* words;
+        size_t pos = 0;
+    };
+
+    inline uint64_t zigzag(const int64_t v) { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+    inline int64_t unzigzag(const uint64_t u) { return static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1); }
+
+    // Delta-of-delta buckets: prefix of k ones (k < 5) then a zero, or five ones, selects the payload width
+    constexpr unsigned dod_bits[6] = {0, 7, 9, 12, 32, 64};
+
+    void encode_dod(const int64_t* x, const size_t stride, const size_t n, BitWriter& out)
+    {
+        uint64_t prev = static_cast<uint64_t>(x[0]), delta = 0;
+        for (size_t i = 1; i < n; ++i) {
+            const auto v = static_cast<uint64_t>(x[i * stride]);
+            const uint64_t d = v - prev;
+            const uint64_t z = zigzag(static_cast<int64_t>(d - delta));
+            unsigned bucket = 0;
+            while (bucket < 5 && z >> dod_bits[bucket] != 0)
+                ++bucket;
+            out.write((uint64_t{1} << bucket) - 1, bucket); // `bucket` ones
+            if (bucket < 5)
+                out.write(0, 1);
+            out.write(z, dod_bits[bucket]);
+            prev = v;
+            delta = d;
+        }
+    }
+
+    // Prefix length and payload width of a delta-of-delta code by the top five bits of the stream (entries
+    // below 16 start with a zero bit: a zero delta-of-delta without payload)
+    struct DodCode {
+        uint8_t prefix;
+        uint8_t bits;
+    };
+    constexpr DodCode dod_codes[32] = {
+            {1, 0},  {1, 0},  {1, 0},  {1, 0},  {1, 0},  {1, 0},  {1, 0},  {1, 0},  {1, 0},  {1, 0},  {1, 0},
+            {1, 0},  {1, 0},  {1, 0},  {1, 0},  {1, 0},  {2, 7},  {2, 7},  {2, 7},  {2, 7},  {2, 7},  {2, 7},
+            {2, 7},  {2, 7},  {3, 9},  {3, 9},  {3, 9},  {3, 9},  {4, 12}, {4, 12}, {5, 32}, {5, 64}};
+    // Longest code decoded from the cached window without a new peek (prefix 11110 + 32 payload bits)
+    constexpr unsigned dod_window_code = 5 + 32;
+
+    // Both decoders keep the next 64 - used bits of the stream at the top of w, so most codes are decoded with
+    // shifts instead of a fresh unaligned peek. The stream is only peeked while values remain: a finished
+    // block may end right before the single padding word, and peek() reads the word after the current one.
+    void decode_dod(BitReader in, const uint64_t first, const size_t n, int64_t* out)
+    {
+        uint64_t prev = first, delta = 0;
+        out[0] = static_cast<int64_t>(first);
+        uint64_t w = n > 1 ? in.peek() : 0;
+        unsigned used = 0;
+        for (size_t i = 1; i < n;) {
+            if (used > 64 - dod_window_code) {
+                in.skip(used);
+                w = in.peek();
+                used = 0;
+            }
+            if (w >> 56 == 0) { // run of at least eight zero delta-of-deltas: a constant step
+                if (used > 0) { // the window's low bits are shifted-in zeros, not stream bits
+                    in.skip(used);
+                    w = in.peek();
+                }
+                const size_t run = std::min<size_t>(w == 0 ? 64 : static_cast<size_t>(__builtin_clzll(w)), n - i);
+                for (size_t j = 0; j < run; ++j)
+                    out[i + j] = static_cast<int64_t>(prev += delta);
+                in.skip(static_cast<unsigned>(run));
+                used = 0;
+                i += run;
+                if (i < n)
+                    w = in.peek();
+                continue;
+            }
+            // Single zero codes ({1, 0}) take the table path too, which keeps the loop free of data-dependent
+            // branches on jittery streams
+            const DodCode code = dod_codes[w >> 59];
+            uint64_t z;
+            if (code.bits < 64) {
+                z = (w << code.prefix) >> 1 >> (63 - code.bits);
+                const unsigned len = code.prefix + code.bits;
+                w <<= len;
+                used += len;
+            } else {
+                in.skip(used + code.prefix);
+                z = in.read(64);
+                used = 0;
+                if (i + 1 < n)
+                    w = in.peek();
+            }
+            delta += static_cast<uint64_t>(unzigzag(z));
+            prev += delta;
+            out[i++] = static_cast<int64_t>(prev);
+        }
+    }
+
+    template<typename U>
+    unsigned leading_zeros(const U v)
+    {
+        return sizeof(U) == 8 ? static_cast<unsigned>(__builtin_clzll(v))
+                              : static_cast<unsigned>(__builtin_clz(static_cast<uint32_t>(v)));
+    }
+
+    // XOR with the previous value: '0' for a repeat, '10' + meaningful bits when they fit the previous
+    // leading/trailing-zero window, '11' + 6-bit leading count + 6-bit (length - 1) + meaningful bits otherwise
+    template<typename U>
+    void encode_xor(const U* x, const size_t stride, const size_t n, BitWriter& out)
+    {
+        constexpr unsigned width = 8 * sizeof(U);
+        U prev = x[0];
+        unsigned lead = width + 1, trail = 0; // no window yet
+        for (size_t i = 1; i < n; ++i) {
+            const U v = x[i * stride];
+            const U diff = v ^ prev;
+            prev = v;
+            if (diff == 0) {
+                out.write(0, 1);
+                continue;
+            }
+            const unsigned l = leading_zeros(diff);
+            const auto t = static_cast<unsigned>(__builtin_ctzll(diff));
+            if (lead <= width && l >= lead && t >= trail) {
+                out.write(2, 2);
+                out.write(diff >> trail, width - lead - trail);
+            } else {
+                lead = l;
+                trail = t;
+                out.write(3, 2);
+                out.write(lead, 6);
+                out.write(width - lead - trail - 1, 6);
+                out.write(diff >> trail, width - lead - trail);
+            }
+        }
+    }
+
+    template<typename U>
+    void decode_xor(BitReader in, const U first, const size_t n, U* out)
+    {
+        constexpr unsigned width = 8 * sizeof(U);
+        U prev = first;
+        unsigned lead = 0, trail = 0;
+        out[0] = first;
+        uint64_t w = n > 1 ? in.peek() : 0;
+        unsigned used = 0;
+        for (size_t i = 1; i < n;) {
+            // Keep at least a full control field ('11' + 12 bits) in the window
+            if (used > 64 - 14) {
+                in.skip(used);
+                w = in.peek();
+                used = 0;
+            }
+            if (w >> 56 == 0) { // run of at least eight repeated values
+                if (used > 0) { // the window's low bits are shifted-in zeros, not stream bits
+                    in.skip(used);
+                    w = in.peek();
+                }
+                const size_t run = std::min<size_t>(w == 0 ? 64 : static_cast<size_t>(__builtin_clzll(w)), n - i);
+                std::fill(out + i, out + i + run, prev);
+                in.skip(static_cast<unsigned>(run));
+                used = 0;
+                i += run;
+                if (i < n)
+                    w = in.peek();
+                continue;
+            }
+            // Repeat, same-window and new-window codes are told apart with selects rather than branches
+            const uint64_t changed = w >> 63;
+            const bool fresh = changed & w >> 62;
+            const auto new_lead = static_cast<unsigned>(w >> 56 & 63);
+            lead = fresh ? new_lead : lead;
+            trail = fresh ? width - new_lead - static_cast<unsigned>(w >> 50 & 63) - 1 : trail;
+            const unsigned control = fresh ? 14 : 2;
+            const unsigned m = width - lead - trail;
+            const unsigned len = changed ? control + m : 1;
+            uint64_t bits;
+            if (used + len <= 64) {
+                // m can only reach 64 on a repeat, whose bits are masked off
+                bits = ((w << control) >> 1 >> ((63 - m) & 63)) & (0 - changed);
+                w = len < 64 ? w << len : 0;
+                used += len;
+            } else { // meaningful bits run past the window
+                in.skip(used + control);
+                bits = in.read(m);
+                used = 0;
+                if (i + 1 < n)
+                    w = in.peek();
+            }
+            prev ^= static_cast<U>(bits << trail);
+            out[i++] = prev;
+        }
+    }
+
+    template<typename V>
+    void put(std::vector<char>& out, const V v)
+    {
+        const size_t at = out.size();
+        out.resize(at + sizeof(V));
+        std::memcpy(&out[at], &v, sizeof(V));
+    }
+
+    size_t descr_word_size(const std::string& descr)
+    {
+        if (descr == npy::_npy_descr<int64_t>() || descr == npy::_npy_descr<double>())
+            return 8;
+        if (descr == npy::_npy_descr<float>())
+            return 4;
+        throw std::runtime_error("save_timeseries: only int64, float64 and float32 columns, got " + descr);
+    }
+
+} // namespace
+
+void npy::save_timeseries(const std::string& fname, const void* data, const std::string& descr, const size_t rows,
+                          const size_t cols, const bool fortran_order, const TimeSeriesOptions& opt)
+{
+    const size_t ws = descr_word_size(descr);
+    const size_t block_len = std::max<size_t>(opt.block_rows, 2);
+    const size_t nb = (rows + block_len - 1) / block_len;
+    const auto base = static_cast<const char*>(data);
+
+    // Encode every (column, block) independently
+    std::vector<std::vector<uint64_t>> streams(cols * nb);
+    std::vector<uint64_t> checkpoint(cols * nb);
+    parallel_for(cols * nb, opt.n_threads, [&](const size_t task) {
+        const size_t c = task / nb, b = task % nb;
+        const size_t r0 = b * block_len, n = std::min(rows, r0 + block_len) - r0;
+        const size_t stride = fortran_order ? 1 : cols;
+        const char* first = base + (fortran_order ? c * rows + r0 : r0 * cols + c) * ws;
+        std::memcpy(&checkpoint[task], first, ws);
+        BitWriter out(streams[task]);
+        if (descr == _npy_descr<int64_t>())
+            encode_dod(reinterpret_cast<const int64_t*>(first), stride, n, out);
+        else if (ws == 8)
+            encode_xor(reinterpret_cast<const uint64_t*>(first), stride, n, out);
+        else
+            encode_xor(reinterpret_cast<const uint32_t*>(first), stride, n, out);
+        out.flush();
+    });
+
+    std::vector<char> header(ts_magic, ts_magic + sizeof(ts_magic));
+    put<uint32_t>(header, ts_version);
+    char d[4] = {};
+    std::memcpy(d, descr.data(), std::min<size_t>(descr.size(), sizeof(d)));
+    header.insert(header.end(), d, d + sizeof(d));
+    put<uint64_t>(header, rows);
+    put<uint64_t>(header, cols);
+    put<uint64_t>(header, block_len);
+    uint64_t end = 0;
+    for (size_t i = 0; i < streams.size(); ++i) {
+        put<uint64_t>(header, end += streams[i].size());
+        put<uint64_t>(header, checkpoint[i]);
+    }
+    put<uint64_t>(header, end + 1); // plus the padding word
+
+    const file_ptr fp = _open_file(fname, "wb");
+    if (!fp)
+        throw std::runtime_error("save_timeseries: Unable to open file " + fname);
+    if (fwrite(header.data(), 1, header.size(), fp.get()) != header.size())
+        throw std::runtime_error("save_timeseries: failed fwrite on " + fname);
+    for (const auto& s: streams)
+        if (!s.empty() && fwrite(s.data(), sizeof(uint64_t), s.size(), fp.get()) != s.size())
+            throw std::runtime_error("save_timeseries: failed fwrite on " + fname);
+    const uint64_t pad = 0;
+    if (fwrite(&pad, sizeof(pad), 1, fp.get()) != 1)
+        throw std::runtime_error("save_timeseries: failed fwrite on " + fname);
+}
+
+void npy::compress_npy_timeseries(const std::string& in_file, const std::string& out_file,
+                                  const TimeSeriesOptions& opt)
+{
+    const MappedNpy src(in_file);
+    if (src.shape().empty() || src.shape().size() > 2)
+        throw std::runtime_error("compress_npy_timeseries: expected a 1D or 2D array in " + in_file);
+    const size_t rows = src.shape()[0];
+    const size_t cols = src.shape().size() == 2 ? src.shape()[1] : 1;
+    save_timeseries(out_file, src.data<char>(), src.header().descr, rows, cols, src.fortran_order(), opt);
+}
+
+npy::TimeSeriesReader::TimeSeriesReader(const std::string& fname) : filename(fname)
+{
+    const int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("TimeSeriesReader: Unable to open file " + fname);
+    struct stat st{};
+    const bool ok = fstat(fd, &st) == 0;
+    const auto file_size = static_cast<size_t>(st.st_size);
+    void* base = ok && file_size > 0 ? mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (base == MAP_FAILED)
+        throw std::runtime_error("TimeSeriesReader: failed mmap on " + fname);
+    region = std::shared_ptr<void>(base, [file_size](void* p) { munmap(p, file_size); });
+
+    const auto p = static_cast<const char*>(base);
+    const auto u64 = [&](const size_t offset) {
+        if (offset + 8 > file_size)
+            throw std::runtime_error("TimeSeriesReader: truncated file " + fname);
+        uint64_t v;
+        std::memcpy(&v, p + offset, sizeof(v));
+        return v;
+    };
+    uint32_t version = 0;
+    if (file_size < ts_header_size || std::memcmp(p, ts_magic, sizeof(ts_magic)) != 0)
+        throw std::runtime_error("TimeSeriesReader: " + fname + " is not a time-series npy file");
+    std::memcpy(&version, p + 8, sizeof(version));
+    if (version != ts_version)
+        throw std::runtime_error("TimeSeriesReader: unsupported version in " + fname);
+    dtype = std::string(p + 12, strnlen(p + 12, 4));
+    word_size = descr_word_size(dtype);
+    n_rows = u64(16);
+    n_cols = u64(24);
+    block_len = u64(32);
+    if (block_len < 2)
+        throw std::runtime_error("TimeSeriesReader: corrupt header in " + fname);
+
+    const size_t n_index = n_cols * num_blocks();
+    block_end.resize(n_index);
+    checkpoint.resize(n_index);
+    for (size_t i = 0; i < n_index; ++i) {
+        block_end[i] = u64(ts_header_size + 16 * i);
+        checkpoint[i] = u64(ts_header_size + 16 * i + 8);
+    }
+    const size_t words_offset = ts_header_size + 16 * n_index + 8;
+    n_words = u64(words_offset - 8);
+    if (words_offset + n_words * 8 > file_size || (n_index > 0 && block_end.back() + 1 > n_words))
+        throw std::runtime_error("TimeSeriesReader: truncated file " + fname);
+    words = reinterpret_cast<const uint64_t*>(p + words_offset);
+}
+
+void npy::TimeSeriesReader::decode_block(const size_t col, const size_t b, char* out) const
+{
+    const size_t i = col * num_blocks() + b;
+    const size_t n = std::min(n_rows, (b + 1) * block_len) - b * block_len;
+    BitReader in(words + (i == 0 ? 0 : block_end[i - 1]));
+    if (dtype == _npy_descr<int64_t>())
+        decode_dod(in, checkpoint[i], n, reinterpret_cast<int64_t*>(out));
+    else if (word_size == 8)
+        decode_xor<uint64_t>(in, checkpoint[i], n, reinterpret_cast<uint64_t*>(out));
+    else
+        decode_xor<uint32_t>(in, static_cast<uint32_t>(checkpoint[i]), n, reinterpret_cast<uint32_t*>(out));
+}
+
+void npy::TimeSeriesReader::read_column(const size_t col, const size_t begin, const size_t n, void* out) const
+{
+    if (col >= n_cols || begin + n > n_rows)
+        throw std::runtime_error("TimeSeriesReader: rows or column out of range in " + filename);
+    auto dst = static_cast<char*>(out);
+    std::vector<char> scratch;
+    for (size_t r = begin; r < begin + n;) {
+        const size_t b = r / block_len, r0 = b * block_len;
+        const size_t len = std::min(n_rows, r0 + block_len) - r0;
+        const size_t take = std::min(begin + n, r0 + len) - r;
+        if (r == r0 && take == len) { // whole block: decode in place
+            decode_block(col, b, dst);
+        } else {
+            scratch.resize(len * word_size);
+            decode_block(col, b, scratch.data());
+            std::memcpy(dst, scratch.data() + (r - r0) * word_size, take * word_size);
+        }
+        dst += take * word_size;
+        r += take;
+    }
+}
+
+size_t npy::TimeSeriesReader::lower_bound(const size_t col, const int64_t t) const
+{
+    if (dtype != _npy_descr<int64_t>())
+        throw std::runtime_error("TimeSeriesReader::lower_bound: " + filename + " has no int64 columns");
+    if (col >= n_cols)
+        throw std::runtime_error("TimeSeriesReader::lower_bound: column out of range");
+    const size_t nb = num_blocks();
+    if (nb == 0)
+        return 0;
+    // Last block whose checkpoint is < t holds the answer unless it lies past the block's end
+    const uint64_t* cp = checkpoint.data() + col * nb;
+    const size_t b = static_cast<size_t>(std::partition_point(cp, cp + nb, [t](const uint64_t v) {
+                                             return static_cast<int64_t>(v) < t;
+                                         }) -
+                                         cp);
+    if (b == 0)
+        return 0;
+    const size_t r0 = (b - 1) * block_len, len = std::min(n_rows, r0 + block_len) - r0;
+    std::vector<int64_t> values(len);
+    decode_block(col, b - 1, reinterpret_cast<char*>(values.data()));
+    return r0 + static_cast<size_t>(std::lower_bound(values.begin(), values.end(), t) - values.begin());
+}
+
+void npy::TimeSeriesReader::decompress_to_npy(const std::string& out_file, const size_t n_threads) const
+{
+    size_t data_offset;
+    const int fd = _create_npy_file(out_file, dtype, true, {n_rows, n_cols}, data_offset);
+    try {
+        parallel_for(n_cols * num_blocks(), n_threads, [&](const size_t task) {
+            const size_t c = task / num_blocks(), b = task % num_blocks();
+            const size_t r0 = b * block_len, len = std::min(n_rows, r0 + block_len) - r0;
+            std::vector<char> values(len * word_size);
+            decode_block(c, b, values.data());
+            _pwrite_all(fd, values.data(), values.size(), data_offset + (c * n_rows + r0) * word_size);
+        });
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
@@ -0,0 +1,105 @@
+#ifndef NPY_TIMESERIES_H_
+#define NPY_TIMESERIES_H_
+
+#include "npy_mmap.hpp"
+#include "npy_parallel.hpp"
+
+namespace npy {
+
+    // Lossless Gorilla-style container for 2D int64 / float64 / float32 tables, column by column:
+    //   "NPYGORLA" | u32 version | char descr[4] | u64 rows | u64 cols | u64 block_rows |
+    //   (u64 block_end_word, u64 first_value_bits)[cols][n_blocks] | u64 n_words | u64 words[n_words]
+    // int64 columns (timestamps) are coded as delta-of-delta with variable-width buckets, float columns as the
+    // XOR with the previous value (leading/trailing-zero windows). Every block of block_rows values restarts
+    // from a verbatim first value that doubles as a checkpoint in the index, so blocks are encoded and decoded
+    // independently and a row or time range only touches the blocks it overlaps.
+    struct TimeSeriesOptions {
+        size_t block_rows = 1 << 12;
+        size_t n_threads = 0;
+    };
+
+    // Compress a rows x cols table of descr ("<i8", "<f8" or "<f4"), stored in C or Fortran order at data
+    void save_timeseries(const std::string& fname, const void* data, const std::string& descr, size_t rows,
+                         size_t cols, bool fortran_order, const TimeSeriesOptions& opt = TimeSeriesOptions());
+
+    template<typename T, int ORDER>
+    void save_timeseries(const std::string& fname, const Eigen::Matrix<T, -1, -1, ORDER>& mat,
+                         const TimeSeriesOptions& opt = TimeSeriesOptions())
+    {
+        save_timeseries(fname, mat.data(), _npy_descr<T>(), static_cast<size_t>(mat.rows()),
+                        static_cast<size_t>(mat.cols()), ORDER == Eigen::ColMajor, opt);
+    }
+
+    // Compress a 1D or 2D npy file of int64, float64 or float32
+    void compress_npy_timeseries(const std::string& in_file, const std::string& out_file,
+                                 const TimeSeriesOptions& opt = TimeSeriesOptions());
+
+    // Random-access decoder. Each (column, block) stream is a serial chain of variable-length codes. Runs of
+    // repeats or constant steps are expanded in bulk at several GB/s per core. Columns where nearly every value
+    // carries its own code are bound by that chain and decode at about 1-1.5 GB/s per core.
+    class TimeSeriesReader {
+    public:
+        explicit TimeSeriesReader(const std::string& fname);
+
+        [[nodiscard]] size_t rows() const { return n_rows; }
+        [[nodiscard]] size_t cols() const { return n_cols; }
+        [[nodiscard]] const std::string& descr() const { return dtype; }
+        [[nodiscard]] size_t block_rows() const { return block_len; }
+
+        // Decode rows [begin, begin + n) of column col to out (n values of the column's type)
+        void read_column(size_t col, size_t begin, size_t n, void* out) const;
+
+        // First row whose value in the int64 column col is >= t, assuming the column is sorted; found with a
+        // binary search over the block checkpoints and the decode of a single block
+        [[nodiscard]] size_t lower_bound(size_t col, int64_t t) const;
+
+        // Rows [begin, begin + n) of every column, decoded in parallel across columns
+        template<typename T>
+        auto read_rows(const size_t begin, const size_t n, const size_t n_threads = 0) const -> Eigen::Matrix<T, -1, -1>
+        {
+            if (dtype != _npy_descr<T>())
+                throw std::runtime_error("TimeSeriesReader: file holds " + dtype);
+            Eigen::Matrix<T, -1, -1> out(n, n_cols);
+            parallel_for(n_cols, n_threads,
+                         [&](const size_t c) { read_column(c, begin, n, out.col(static_cast<Eigen::Index>(c)).data()); });
+            return out;
+        }
+
+        template<typename T>
+        auto read_all(const size_t n_threads = 0) const -> Eigen::Matrix<T, -1, -1>
+        {
+            return read_rows<T>(0, n_rows, n_threads);
+        }
+
+        // Rows whose timestamp in the sorted int64 column ts_col lies in [t0, t1)
+        template<typename T>
+        auto read_time_range(const size_t ts_col, const int64_t t0, const int64_t t1, const size_t n_threads = 0) const
+                -> Eigen::Matrix<T, -1, -1>
+        {
+            const size_t begin = lower_bound(ts_col, t0);
+            const size_t end = std::max(begin, lower_bound(ts_col, t1));
+            return read_rows<T>(begin, end - begin, n_threads);
+        }
+
+        // Write the whole table back to an npy file (Fortran order, so every column is written contiguously)
+        void decompress_to_npy(const std::string& out_file, size_t n_threads = 0) const;
+
+    private:
+        [[nodiscard]] size_t num_blocks() const { return (n_rows + block_len - 1) / block_len; }
+        // Decode all values of block b of column col into out
+        void decode_block(size_t col, size_t b, char* out) const;
+
+        std::string filename;
+        std::string dtype;
+        size_t word_size = 0;
+        size_t n_rows = 0, n_cols = 0, block_len = 0;
+        std::vector<uint64_t> block_end;  // [col * num_blocks() + b], in words of the stream
+        std::vector<uint64_t> checkpoint; // first value bits of each block
+        std::shared_ptr<void> region;
+        const uint64_t* words = nullptr;
+        size_t n_words = 0;
+    };
+
+} // namespace npy
+
+#endif
@@ -0,0 +1,85 @@
+#include "npy_transpose.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+auto npy::_plan_permutation(const std::vector<size_t>& shape, std::vector<size_t> perm, const bool fortran_order)
+        -> PermutePlan
+{
+    const size_t nd = shape.size();
+    if (perm.empty())
+        for (size_t k = nd; k-- > 0;)
+            perm.push_back(k);
+    std::vector<bool> seen(nd, false);
+    if (perm.size() != nd)
+        throw std::runtime_error("_plan_permutation: axes do not match the array's " + std::to_string(nd) + " dims");
+    for (const size_t p: perm) {
+        if (p >= nd || seen[p])
+            throw std::runtime_error("_plan_permutation: axes are not a permutation");
+        seen[p] = true;
+    }
+
+    PermutePlan plan;
+    for (const size_t p: perm)
+        plan.out_shape.push_back(shape[p]);
+
+    // Fortran data is the C-order array with reversed axes: logical axis i is C axis nd - 1 - i
+    std::vector<size_t> src = shape;
+    if (fortran_order) {
+        std::reverse(src.begin(), src.end());
+        for (size_t& p: perm)
+            p = nd - 1 - p;
+    }
+
+    // Drop size-1 axes, renumbering the remaining source axes
+    std::vector<size_t> new_index(nd, SIZE_MAX), kept_shape;
+    for (size_t i = 0; i < nd; ++i)
+        if (src[i] != 1) {
+            new_index[i] = kept_shape.size();
+            kept_shape.push_back(src[i]);
+        }
+    std::vector<size_t> kept_perm;
+    for (const size_t p: perm)
+        if (new_index[p] != SIZE_MAX)
+            kept_perm.push_back(new_index[p]);
+
+    // Merge runs of output axes that are consecutive source axes
+    std::vector<std::vector<size_t>> groups; // source axes of each merged axis, in output order
+    for (size_t k = 0; k < kept_perm.size(); ++k) {
+        if (k > 0 && kept_perm[k] == kept_perm[k - 1] + 1)
+            groups.back().push_back(kept_perm[k]);
+        else
+            groups.push_back({kept_perm[k]});
+    }
+    // Merged axes ordered by their first source axis give the simplified source shape
+    std::vector<size_t> order(groups.size());
+    for (size_t g = 0; g < groups.size(); ++g)
+        order[g] = g;
+    std::sort(order.begin(), order.end(), [&](const size_t x, const size_t y) { return groups[x][0] < groups[y][0]; });
+    plan.perm.resize(groups.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        size_t len = 1;
+        for (const size_t axis: groups[order[i]])
+            len *= kept_shape[axis];
+        plan.src_shape.push_back(len);
+        plan.perm[order[i]] = i;
+    }
+    return plan;
+}
+
+auto npy::_map_new_npy(const std::string& out_file, const std::string& descr, const std::vector<size_t>& shape,
+                       void*& payload) -> std::shared_ptr<void>
+{
+    size_t data_offset;
+    const int fd = _create_npy_file(out_file, descr, false, shape, data_offset);
+    size_t n_bytes = static_cast<size_t>(atoi(descr.c_str() + 2));
+    for (const size_t s: shape)
+        n_bytes *= s;
+    const size_t map_size = data_offset + n_bytes;
+    void* base = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        throw std::runtime_error("_map_new_npy: failed mmap on " + out_file);
+    payload = static_cast<char*>(base) + data_offset;
+    return std::shared_ptr<void>(base, [map_size](void* p) { munmap(p, map_size); });
+}
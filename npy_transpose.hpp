@@ -0,0 +1,161 @@
+#ifndef NPY_TRANSPOSE_H_
+#define NPY_TRANSPOSE_H_
+
+#include "npy_mmap.hpp"
+#include "npy_parallel.hpp"
+
+namespace npy {
+
+    // C-order view of a permutation: size-1 axes dropped and axes that stay adjacent merged, so the kernel
+    // sees the fewest, longest dimensions. Fortran sources are described by their reversed C-order view.
+    struct PermutePlan {
+        std::vector<size_t> src_shape;
+        std::vector<size_t> perm;
+        std::vector<size_t> out_shape; // np.transpose shape of the original, unsimplified request
+    };
+
+    // perm follows np.transpose: output axis k is source axis perm[k]; an empty perm reverses the axes
+    auto _plan_permutation(const std::vector<size_t>& shape, std::vector<size_t> perm, bool fortran_order)
+            -> PermutePlan;
+
+    // Create out_file with a C-order header for shape and map its payload writable; the mapping lives as long
+    // as the returned handle
+    auto _map_new_npy(const std::string& out_file, const std::string& descr, const std::vector<size_t>& shape,
+                      void*& payload) -> std::shared_ptr<void>;
+
+    // Edge of the square tiles used when the innermost axis moves
+    constexpr size_t transpose_tile = 32;
+
+    template<typename IN, typename OUT, typename Convert>
+    void _permute_kernel(const IN* src, const PermutePlan& plan, OUT* dst, Convert convert, const size_t n_threads)
+    {
+        const std::vector<size_t>& shape = plan.src_shape;
+        const std::vector<size_t>& perm = plan.perm;
+        const size_t nd = shape.size();
+        if (std::find(shape.begin(), shape.end(), size_t{0}) != shape.end())
+            return;
+        if (nd == 0) {
+            dst[0] = convert(src[0]);
+            return;
+        }
+        std::vector<size_t> src_stride(nd, 1), out_shape(nd), out_stride(nd, 1);
+        for (size_t i = nd - 1; i-- > 0;)
+            src_stride[i] = src_stride[i + 1] * shape[i + 1];
+        for (size_t k = 0; k < nd; ++k)
+            out_shape[k] = shape[perm[k]];
+        for (size_t k = nd - 1; k-- > 0;)
+            out_stride[k] = out_stride[k + 1] * out_shape[k + 1];
+
+        const size_t b = nd - 1; // output axis contiguous in dst
+        if (perm[b] == nd - 1) {
+            // Innermost axis stays innermost: every output row is a contiguous run of the source
+            const size_t len = out_shape[b];
+            const size_t n_rows = out_stride[0] * out_shape[0] / len;
+            const size_t batch = std::max<size_t>(1, (size_t{1} << 16) / len);
+            parallel_for((n_rows + batch - 1) / batch, n_threads, [&](const size_t task) {
+                for (size_t row = task * batch; row < std::min(n_rows, (task + 1) * batch); ++row) {
+                    size_t s = 0;
+                    for (size_t k = b, rem = row; k-- > 0; rem /= out_shape[k])
+                        s += rem % out_shape[k] * src_stride[perm[k]];
+                    const IN* in = src + s;
+                    OUT* out = dst + row * len;
+                    for (size_t i = 0; i < len; ++i)
+                        out[i] = convert(in[i]);
+                }
+            });
+            return;
+        }
+
+        // Innermost axis moves: walk tiles of the output plane (a, b), where output axis a is contiguous in the
+        // source, reading and writing each tile while it is in cache
+        const size_t a = static_cast<size_t>(std::find(perm.begin(), perm.end(), nd - 1) - perm.begin());
+        const size_t na = out_shape[a], nb = out_shape[b];
+        const size_t sb = src_stride[perm[b]], sa_out = out_stride[a];
+        const size_t tiles_a = (na + transpose_tile - 1) / transpose_tile;
+        const size_t tiles_b = (nb + transpose_tile - 1) / transpose_tile;
+        const size_t n_outer = out_stride[0] * out_shape[0] / (na * nb);
+        parallel_for(n_outer * tiles_a, n_threads, [&](const size_t task) {
+            size_t s = 0, d = 0;
+            for (size_t k = nd, rem = task / tiles_a; k-- > 0;) {
+                if (k == a || k == b)
+                    continue;
+                const size_t i = rem % out_shape[k];
+                rem /= out_shape[k];
+                s += i * src_stride[perm[k]];
+                d += i * out_stride[k];
+            }
+            const size_t a0 = task % tiles_a * transpose_tile, a1 = std::min(na, a0 + transpose_tile);
+            for (size_t tb = 0; tb < tiles_b; ++tb) {
+                const size_t b0 = tb * transpose_tile, b1 = std::min(nb, b0 + transpose_tile);
+                for (size_t ia = a0; ia < a1; ++ia) {
+                    const IN* in = src + s + ia;
+                    OUT* out = dst + d + ia * sa_out;
+                    for (size_t ib = b0; ib < b1; ++ib)
+                        out[ib] = convert(in[ib * sb]);
+                }
+            }
+        });
+    }
+
+    // dst = np.transpose(src, perm) converted to OUT and multiplied by scale, in one pass and without an
+    // intermediate buffer. src is C order unless fortran_order is set; dst is always C order.
+    template<typename IN, typename OUT = IN>
+    void permute_axes(const IN* src, const std::vector<size_t>& shape, const std::vector<size_t>& perm, OUT* dst,
+                      const double scale = 1.0, const bool fortran_order = false, const size_t n_threads = 0)
+    {
+        const PermutePlan plan = _plan_permutation(shape, perm, fortran_order);
+        if (scale == 1.0)
+            _permute_kernel(src, plan, dst, [](const IN x) { return static_cast<OUT>(x); }, n_threads);
+        else
+            _permute_kernel(
+                    src, plan, dst, [scale](const IN x) { return static_cast<OUT>(static_cast<double>(x) * scale); },
+                    n_threads);
+    }
+
+    // Load an npy file of any rank as np.transpose(array, perm) in C order, optionally converted to OUT and
+    // scaled (e.g. uint8 NHWC images to float NCHW with scale 1 / 255). The source is memory-mapped, so the
+    // returned array is the only full-size buffer.
+    template<typename IN, typename OUT = IN>
+    auto load_npy_permuted(const std::string& fname, const std::vector<size_t>& perm, const double scale = 1.0,
+                           const size_t n_threads = 0) -> NpyArray
+    {
+        const MappedNpy src(fname);
+        if (src.word_size() != sizeof(IN))
+            throw std::runtime_error("load_npy_permuted: element size mismatch in " + fname);
+        const PermutePlan plan = _plan_permutation(src.shape(), perm, src.fortran_order());
+        NpyArray out(plan.out_shape, sizeof(OUT), false);
+        permute_axes<IN, OUT>(src.data<IN>(), src.shape(), perm, out.data<OUT>(), scale, src.fortran_order(),
+                              n_threads);
+        return out;
+    }
+
+    // Save np.transpose(data, perm) of a C-order array with the given shape, converted to OUT and scaled,
+    // transposing straight into the mapped output file
+    template<typename IN, typename OUT = IN>
+    void save_npy_permuted(const std::string& fname, const IN* data, const std::vector<size_t>& shape,
+                           const std::vector<size_t>& perm, const double scale = 1.0, const size_t n_threads = 0)
+    {
+        const PermutePlan plan = _plan_permutation(shape, perm, false);
+        void* payload = nullptr;
+        const std::shared_ptr<void> mapping = _map_new_npy(fname, _npy_descr<OUT>(), plan.out_shape, payload);
+        permute_axes<IN, OUT>(data, shape, perm, static_cast<OUT*>(payload), scale, false, n_threads);
+    }
+
+    // File to file permutation: both files are mapped and no buffer is allocated
+    template<typename IN, typename OUT = IN>
+    void permute_npy(const std::string& in_file, const std::string& out_file, const std::vector<size_t>& perm,
+                     const double scale = 1.0, const size_t n_threads = 0)
+    {
+        const MappedNpy src(in_file);
+        if (src.word_size() != sizeof(IN))
+            throw std::runtime_error("permute_npy: element size mismatch in " + in_file);
+        const PermutePlan plan = _plan_permutation(src.shape(), perm, src.fortran_order());
+        void* payload = nullptr;
+        const std::shared_ptr<void> mapping = _map_new_npy(out_file, _npy_descr<OUT>(), plan.out_shape, payload);
+        permute_axes<IN, OUT>(src.data<IN>(), src.shape(), perm, static_cast<OUT*>(payload), scale,
+                              src.fortran_order(), n_threads);
+    }
+
+} // namespace npy
+
+#endif
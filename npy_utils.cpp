@@ -1,5 +1,11 @@
 #include "npy_utils.hpp"
 
+#include <array>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
 
 auto find_header_substring(const char* str) -> std::string
 {
@@ -38,6 +44,13 @@ auto find_header_substring(const char* str) -> std::string
 }
 
 void npy::parse_npy_header(FILE* fp, size_t& word_size, std::vector<size_t>& shape, bool& fortran_order)
+{
+    std::string descr;
+    parse_npy_header(fp, word_size, shape, fortran_order, descr);
+}
+
+void npy::parse_npy_header(FILE* fp, size_t& word_size, std::vector<size_t>& shape, bool& fortran_order,
+                           std::string& descr)
 {
     char buffer[256];
     const size_t res = fread(buffer, sizeof(char), 11, fp);
@@ -72,7 +85,7 @@ void npy::parse_npy_header(FILE* fp, size_t& word_size, std::vector<size_t>& sha
 
     std::string str_shape = header.substr(loc1 + 1, loc2 - loc1 - 1);
     while (std::regex_search(str_shape, sm, num_regex)) {
-        shape.push_back(std::stoi(sm[0].str()));
+        shape.push_back(std::stoull(sm[0].str()));
         str_shape = sm.suffix().str();
     }
 
@@ -88,9 +101,251 @@ void npy::parse_npy_header(FILE* fp, size_t& word_size, std::vector<size_t>& sha
     std::string str_ws = header.substr(loc1 + 2);
     loc2 = str_ws.find('\'');
     word_size = atoi(str_ws.substr(0, loc2).c_str());
+    descr = header.substr(loc1, loc2 + 2);
     // std::cout << "word_size: " << word_size << std::endl;
 }
 
+auto npy::npy_read_header(const std::string& fname) -> NpyHeader
+{
+    file_ptr fp = _open_file(fname, "rb");
+    if (!fp)
+        throw std::runtime_error("npy_read_header: Unable to open file " + fname);
+
+    NpyHeader h;
+    parse_npy_header(fp.get(), h.word_size, h.shape, h.fortran_order, h.descr);
+    h.data_offset = static_cast<size_t>(ftell(fp.get()));
+    return h;
+}
+
+auto npy::_npy_header(const std::string& descr, const bool fortran_order, const std::vector<size_t>& shape,
+                      const size_t min_size) -> std::string
+{
+    std::string header = "{'descr': '" + descr + "', 'fortran_order': ";
+    header += (fortran_order ? "True" : "False");
+    header += ", 'shape': (";
+    for (size_t i = 0; i < shape.size(); ++i)
+        header += std::to_string(shape[i]) + (shape.size() == 1 || i + 1 < shape.size() ? "," : "") +
+                  (i + 1 < shape.size() ? " " : "");
+    header += "), }";
+
+    // Pad with spaces so the whole prefix (magic, version, length, dict) is 16-byte aligned and at least min_size
+    size_t total = 12 + header.size() + 1;
+    total = std::max(total, min_size);
+    total = (total + 15) / 16 * 16;
+    header.append(total - 12 - header.size() - 1, ' ');
+    header += '\n';
+
+    std::string prefix = "\x93NUMPY";
+    prefix += static_cast<char>(2);
+    prefix += static_cast<char>(0);
+    const auto header_len = static_cast<uint32_t>(header.size());
+    prefix.append(reinterpret_cast<const char*>(&header_len), 4);
+    return prefix + header;
+}
+
+void npy::_pwrite_all(const int fd, const void* data, size_t n, size_t offset)
+{
+    auto p = static_cast<const char*>(data);
+    while (n > 0) {
+        const ssize_t k = pwrite(fd, p, n, static_cast<off_t>(offset));
+        if (k <= 0)
+            throw std::runtime_error("_pwrite_all: failed pwrite");
+        p += k;
+        n -= static_cast<size_t>(k);
+        offset += static_cast<size_t>(k);
+    }
+}
+
+void npy::_pread_all(const int fd, void* data, size_t n, size_t offset)
+{
+    auto p = static_cast<char*>(data);
+    while (n > 0) {
+        const ssize_t k = pread(fd, p, n, static_cast<off_t>(offset));
+        if (k <= 0)
+            throw std::runtime_error("_pread_all: failed pread");
+        p += k;
+        n -= static_cast<size_t>(k);
+        offset += static_cast<size_t>(k);
+    }
+}
+
+auto npy::_create_npy_file(const std::string& fname, const std::string& descr, const bool fortran_order,
+                           const std::vector<size_t>& shape, size_t& data_offset) -> int
+{
+    const std::string header = _npy_header(descr, fortran_order, shape);
+    size_t num_vals = 1;
+    for (const size_t s: shape)
+        num_vals *= s;
+    const size_t word_size = static_cast<size_t>(atoi(descr.c_str() + 2));
+
+    const int fd = open(fname.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("_create_npy_file: Unable to open file " + fname);
+    try {
+        _pwrite_all(fd, header.data(), header.size(), 0);
+        if (ftruncate(fd, static_cast<off_t>(header.size() + num_vals * word_size)) != 0)
+            throw std::runtime_error("_create_npy_file: failed ftruncate on " + fname);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    data_offset = header.size();
+    return fd;
+}
+
+uint32_t npy::_crc32(const void* data, size_t n, uint32_t crc)
+{
+    // Slicing-by-8 tables, built once
+    static const auto table = [] {
+        std::vector<std::array<uint32_t, 256>> t(8);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i)
+            for (size_t s = 1; s < 8; ++s)
+                t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xff];
+        return t;
+    }();
+
+    auto p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (; n >= 8; n -= 8, p += 8) {
+        uint32_t lo, hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = table[7][lo & 0xff] ^ table[6][lo >> 8 & 0xff] ^ table[5][lo >> 16 & 0xff] ^ table[4][lo >> 24] ^
+              table[3][hi & 0xff] ^ table[2][hi >> 8 & 0xff] ^ table[1][hi >> 16 & 0xff] ^ table[0][hi >> 24];
+    }
+    for (; n > 0; --n, ++p)
+        crc = table[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+namespace {
+
+    template<typename V>
+    void put_le(std::string& out, const V v)
+    {
+        for (size_t i = 0; i < sizeof(V); ++i)
+            out += static_cast<char>(static_cast<uint64_t>(v) >> (8 * i) & 0xff);
+    }
+
+} // namespace
+
+void npy::save_npz(const std::string& fname, const std::vector<NpzMember>& members)
+{
+    const file_ptr fp = _open_file(fname, "wb");
+    if (!fp)
+        throw std::runtime_error("save_npz: Unable to open file " + fname);
+    const auto write = [&](const void* data, const size_t n) {
+        if (n > 0 && fwrite(data, 1, n, fp.get()) != n)
+            throw std::runtime_error("save_npz: failed fwrite on " + fname);
+    };
+    constexpr uint64_t saturated = 0xffffffff;
+
+    std::string central;
+    uint64_t offset = 0;
+    for (const NpzMember& m: members) {
+        const std::string header = _npy_header(m.descr, false, m.shape);
+        size_t n_bytes = static_cast<size_t>(atoi(m.descr.c_str() + 2));
+        for (const size_t s: m.shape)
+            n_bytes *= s;
+        const uint64_t size = header.size() + n_bytes;
+        const uint32_t crc = _crc32(m.data, n_bytes, _crc32(header.data(), header.size()));
+        const std::string name = m.name + ".npy";
+        const bool big_size = size >= saturated, big_offset = offset >= saturated;
+
+        // Local header; zip64 sizes go in its extra field
+        std::string local;
+        put_le<uint32_t>(local, 0x04034b50);
+        put_le<uint16_t>(local, big_size ? 45 : 20);
+        put_le<uint16_t>(local, 0);    // flags
+        put_le<uint16_t>(local, 0);    // stored
+        put_le<uint16_t>(local, 0);    // time
+        put_le<uint16_t>(local, 0x21); // date: 1980-01-01
+        put_le<uint32_t>(local, crc);
+        put_le<uint32_t>(local, big_size ? saturated : size);
+        put_le<uint32_t>(local, big_size ? saturated : size);
+        put_le<uint16_t>(local, static_cast<uint16_t>(name.size()));
+        put_le<uint16_t>(local, big_size ? 20 : 0);
+        local += name;
+        if (big_size) {
+            put_le<uint16_t>(local, 1);
+            put_le<uint16_t>(local, 16);
+            put_le<uint64_t>(local, size);
+            put_le<uint64_t>(local, size);
+        }
+
+        std::string extra;
+        if (big_size || big_offset) {
+            put_le<uint16_t>(extra, 1);
+            put_le<uint16_t>(extra, static_cast<uint16_t>((big_size ? 16 : 0) + (big_offset ? 8 : 0)));
+            if (big_size) {
+                put_le<uint64_t>(extra, size);
+                put_le<uint64_t>(extra, size);
+            }
+            if (big_offset)
+                put_le<uint64_t>(extra, offset);
+        }
+        put_le<uint32_t>(central, 0x02014b50);
+        put_le<uint16_t>(central, 45); // made by
+        put_le<uint16_t>(central, big_size || big_offset ? 45 : 20);
+        put_le<uint16_t>(central, 0);
+        put_le<uint16_t>(central, 0);
+        put_le<uint16_t>(central, 0);
+        put_le<uint16_t>(central, 0x21);
+        put_le<uint32_t>(central, crc);
+        put_le<uint32_t>(central, big_size ? saturated : size);
+        put_le<uint32_t>(central, big_size ? saturated : size);
+        put_le<uint16_t>(central, static_cast<uint16_t>(name.size()));
+        put_le<uint16_t>(central, static_cast<uint16_t>(extra.size()));
+        put_le<uint16_t>(central, 0); // comment
+        put_le<uint16_t>(central, 0); // disk
+        put_le<uint16_t>(central, 0); // internal attributes
+        put_le<uint32_t>(central, 0); // external attributes
+        put_le<uint32_t>(central, big_offset ? saturated : offset);
+        central += name + extra;
+
+        write(local.data(), local.size());
+        write(header.data(), header.size());
+        write(m.data, n_bytes);
+        offset += local.size() + size;
+    }
+
+    // Central directory, then zip64 end records when offsets or counts overflow the classic fields
+    const uint64_t cd_offset = offset;
+    std::string tail = central;
+    if (cd_offset >= saturated || members.size() >= 0xffff) {
+        put_le<uint32_t>(tail, 0x06064b50);
+        put_le<uint64_t>(tail, 44);
+        put_le<uint16_t>(tail, 45);
+        put_le<uint16_t>(tail, 45);
+        put_le<uint32_t>(tail, 0);
+        put_le<uint32_t>(tail, 0);
+        put_le<uint64_t>(tail, members.size());
+        put_le<uint64_t>(tail, members.size());
+        put_le<uint64_t>(tail, central.size());
+        put_le<uint64_t>(tail, cd_offset);
+        put_le<uint32_t>(tail, 0x07064b50);
+        put_le<uint32_t>(tail, 0);
+        put_le<uint64_t>(tail, cd_offset + central.size());
+        put_le<uint32_t>(tail, 1);
+    }
+    put_le<uint32_t>(tail, 0x06054b50);
+    put_le<uint16_t>(tail, 0);
+    put_le<uint16_t>(tail, 0);
+    put_le<uint16_t>(tail, static_cast<uint16_t>(std::min<size_t>(members.size(), 0xffff)));
+    put_le<uint16_t>(tail, static_cast<uint16_t>(std::min<size_t>(members.size(), 0xffff)));
+    put_le<uint32_t>(tail, std::min<uint64_t>(central.size(), saturated));
+    put_le<uint32_t>(tail, std::min<uint64_t>(cd_offset, saturated));
+    put_le<uint16_t>(tail, 0);
+    write(tail.data(), tail.size());
+}
+
 auto load_the_npy_file(FILE* fp) -> npy::NpyArray
 {
     std::vector<size_t> shape;
@@ -1,7 +1,10 @@
 #ifndef LIBCNPY_H_
 #define LIBCNPY_H_
 
+#include "npy_manifest.hpp"
+
 #include <Eigen/Dense>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <map>
@@ -54,38 +57,154 @@ namespace npy {
 
     using npz_t = std::map<std::string, NpyArray>;
 
+    // Header fields of an npy file plus the byte offset at which its payload starts
+    struct NpyHeader {
+        std::vector<size_t> shape;
+        size_t word_size = 0;
+        bool fortran_order = false;
+        std::string descr;
+        size_t data_offset = 0;
+    };
+
+    using file_ptr = std::unique_ptr<FILE, decltype(&fclose)>;
+
+    inline file_ptr _open_file(const std::string& fname, const char* mode)
+    {
+        return file_ptr(fopen(fname.c_str(), mode), &fclose);
+    }
+
     void parse_npy_header(FILE* fp, size_t& word_size, std::vector<size_t>& shape, bool& fortran_order);
+    void parse_npy_header(FILE* fp, size_t& word_size, std::vector<size_t>& shape, bool& fortran_order,
+                          std::string& descr);
+    auto npy_read_header(const std::string& fname) -> NpyHeader;
+    // Write/read exactly n bytes at offset, throwing on failure
+    void _pwrite_all(int fd, const void* data, size_t n, size_t offset);
+    void _pread_all(int fd, void* data, size_t n, size_t offset);
+    // Create fname with a header for the given array and its payload area preallocated, returns the open
+    // read-write descriptor; the payload starts at data_offset
+    auto _create_npy_file(const std::string& fname, const std::string& descr, bool fortran_order,
+                          const std::vector<size_t>& shape, size_t& data_offset) -> int;
+    // Header size reserved by writers that patch the shape in place once the row count is known
+    constexpr size_t growable_header_size = 128;
+    // Build a complete version 2.0 npy prefix (magic through padded header dict), at least min_size bytes long
+    auto _npy_header(const std::string& descr, bool fortran_order, const std::vector<size_t>& shape,
+                     size_t min_size = 0) -> std::string;
+    // CRC-32 (zip polynomial) of n bytes, continuing from a previous crc
+    uint32_t _crc32(const void* data, size_t n, uint32_t crc = 0);
+
+    // One C-order array of an npz archive; data must hold prod(shape) elements of descr
+    struct NpzMember {
+        std::string name;
+        std::string descr;
+        std::vector<size_t> shape;
+        const void* data;
+    };
+
+    // Write an uncompressed npz archive (zip64 when needed) readable by np.load and mappable by map_npz
+    void save_npz(const std::string& fname, const std::vector<NpzMember>& members);
     auto npy_load(const std::string& fname) -> NpyArray;
     auto load_npy_arr(const std::string& fname) -> std::tuple<std::unique_ptr<char[]>, size_t, size_t>;
 
+    // splitmix64 finalizer: cheap, well-mixed 64-bit hash used for hash tables and seeded random streams
+    inline uint64_t _mix64(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    template<typename T>
+    auto _npy_descr() -> std::string
+    {
+        if (std::is_same<T, float>::value)
+            return "<f4";
+        if (std::is_same<T, double>::value)
+            return "<f8";
+        if (std::is_same<T, int8_t>::value)
+            return "|i1";
+        if (std::is_same<T, int16_t>::value)
+            return "<i2";
+        if (std::is_same<T, int32_t>::value)
+            return "<i4";
+        if (std::is_same<T, int64_t>::value)
+            return "<i8";
+        if (std::is_same<T, uint8_t>::value)
+            return "|u1";
+        if (std::is_same<T, uint16_t>::value)
+            return "<u2";
+        if (std::is_same<T, uint32_t>::value)
+            return "<u4";
+        if (std::is_same<T, uint64_t>::value)
+            return "<u8";
+        throw std::runtime_error("Unsupported data type");
+    }
+
+    // Read the 2D payload following an already parsed header straight into a matrix of the same storage order
+    template<typename T, int ORDER>
+    auto _read_mat_payload(FILE* fp, const std::string& npy_file, size_t rows, size_t cols)
+            -> Eigen::Matrix<T, -1, -1, ORDER>
+    {
+        Eigen::Matrix<T, -1, -1, ORDER> matrix(rows, cols);
+        const size_t n_bytes = rows * cols * sizeof(T);
+        const size_t nread = fread(matrix.data(), 1, n_bytes, fp);
+        if (nread != n_bytes)
+            throw std::runtime_error("load_npy_mat: failed fread on " + npy_file);
+        return matrix;
+    }
+
+    // Open a 2D npy file of T and parse its header in a single pass into h; the file is left at the payload
     template<typename T>
-    auto load_npy_mat(const std::string& npy_file)
+    auto _open_mat(const std::string& npy_file, NpyHeader& h) -> file_ptr
     {
-        npy::NpyArray npy_data = npy::npy_load(npy_file);
-        std::vector<size_t> shape = npy_data.shape;
+        file_ptr fp = _open_file(npy_file, "rb");
+        if (!fp)
+            throw std::runtime_error("load_npy_mat: Unable to open file " + npy_file);
+        npy::parse_npy_header(fp.get(), h.word_size, h.shape, h.fortran_order, h.descr);
+        h.data_offset = static_cast<size_t>(ftell(fp.get()));
 
-        if (shape.size() != 2) {
+        if (h.shape.size() != 2) {
             throw std::runtime_error("Only 2D arrays can be converted to Eigen matrices.");
         }
+        if (h.descr != _npy_descr<T>())
+            throw std::runtime_error("load_npy_mat: " + npy_file + " holds " + h.descr + ", expected " +
+                                     _npy_descr<T>());
+        return fp;
+    }
+
+    // Load a 2D npy file into an Eigen matrix with the requested storage order (RowMajor by default).
+    // When the file order matches ORDER the payload is read with a single contiguous fread; otherwise
+    // the data is read in file order and converted once by Eigen.
+    template<typename T, int ORDER = Eigen::RowMajor>
+    auto load_npy_mat(const std::string& npy_file) -> Eigen::Matrix<T, -1, -1, ORDER>
+    {
+        constexpr int OTHER_ORDER = ORDER == Eigen::RowMajor ? Eigen::ColMajor : Eigen::RowMajor;
 
-        T* raw_data = npy_data.data<T>();
+        NpyHeader h;
+        const file_ptr fp = _open_mat<T>(npy_file, h);
+        if (h.fortran_order == (ORDER == Eigen::ColMajor))
+            return _read_mat_payload<T, ORDER>(fp.get(), npy_file, h.shape[0], h.shape[1]);
 
-        Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> matrix(shape[0], shape[1]);
+        return _read_mat_payload<T, OTHER_ORDER>(fp.get(), npy_file, h.shape[0], h.shape[1]);
+    }
 
-        if (npy_data.fortran_order) {
-            for (size_t i = 0; i < shape[0]; ++i) {
-                for (size_t j = 0; j < shape[1]; ++j) {
-                    matrix(i, j) = raw_data[j * shape[0] + i];
-                }
-            }
+    // Load a 2D npy file in its on-disk storage order and pass it to f, which receives a RowMajor matrix for
+    // C-order files and a ColMajor matrix for Fortran-order files. No element is ever reordered, and the
+    // file is opened and its header parsed only once.
+    template<typename T, typename F>
+    void load_npy_mat_native(const std::string& npy_file, F&& f)
+    {
+        NpyHeader h;
+        file_ptr fp = _open_mat<T>(npy_file, h);
+        if (h.fortran_order) {
+            auto mat = _read_mat_payload<T, Eigen::ColMajor>(fp.get(), npy_file, h.shape[0], h.shape[1]);
+            fp.reset();
+            f(std::move(mat));
         } else {
-            for (size_t i = 0; i < shape[0]; ++i) {
-                for (size_t j = 0; j < shape[1]; ++j) {
-                    matrix(i, j) = raw_data[i * shape[1] + j];
-                }
-            }
+            auto mat = _read_mat_payload<T, Eigen::RowMajor>(fp.get(), npy_file, h.shape[0], h.shape[1]);
+            fp.reset();
+            f(std::move(mat));
         }
-        return matrix;
     }
 
     template<typename T, int fortran_order>
@@ -328,11 +447,21 @@ namespace npy {
         fclose(fp);
     }
 
-    // Main function to read .npy files and stack them into an Eigen matrix
+    // Main function to read .npy files and stack them into an Eigen matrix. When the folder has a manifest
+    // (see manifest_path) whose first shard is prefix{start_i}suffix, the shards are read through
+    // manifest2mat without discovering or parsing them again; rebuild the manifest after the shards change.
     template<typename T, int FORTRAN_ORDER>
     auto npy_folder2mat(const std::string& folder_name, const std::string& prefix, const int start_i, const std::string& suffix)
             -> Eigen::Matrix<T, -1, -1, FORTRAN_ORDER>
     {
+        const std::string manifest_file = manifest_path(folder_name, prefix, suffix);
+        if (std::ifstream(manifest_file).good()) {
+            const Manifest manifest = load_manifest(manifest_file);
+            if (!manifest.shards.empty() &&
+                manifest.shards.front().path == folder_name + "/" + prefix + std::to_string(start_i) + suffix)
+                return manifest2mat<T, FORTRAN_ORDER>(manifest);
+        }
+
         // Initialize variables
         std::vector<size_t> shape;
         size_t word_size;
@@ -0,0 +1,54 @@
+#include "npy_virtual.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+npy::VirtualArray::VirtualArray(const Manifest& manifest) : n_rows(manifest.rows), cols(manifest.cols)
+{
+    shards.reserve(manifest.shards.size());
+    offsets.reserve(manifest.shards.size() + 1);
+    for (const ShardInfo& s: manifest.shards) {
+        if (s.fortran_order)
+            throw std::runtime_error("VirtualArray: " + s.path + " is not a C-order array");
+
+        NpyHeader h;
+        h.shape = s.shape;
+        h.word_size = s.word_size;
+        h.fortran_order = s.fortran_order;
+        h.descr = s.descr;
+        h.data_offset = s.data_offset;
+
+        const int fd = open(s.path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("VirtualArray: Unable to open file " + s.path);
+        try {
+            shards.emplace_back(fd, h);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        close(fd);
+        offsets.push_back(s.row_offset);
+    }
+    offsets.push_back(n_rows);
+    word_size = manifest.shards.empty() ? 0 : manifest.shards[0].word_size;
+}
+
+npy::VirtualArray::VirtualArray(const std::string& folder_name, const std::string& prefix, const int start_i,
+                                const std::string& suffix) :
+    VirtualArray(build_manifest(folder_name, prefix, start_i, suffix))
+{}
+
+size_t npy::VirtualArray::shard_of(const size_t row) const
+{
+    if (row >= n_rows)
+        throw std::runtime_error("VirtualArray: row index out of bounds");
+    // Empty shards share their offset with the next one; upper_bound skips past them
+    return static_cast<size_t>(std::upper_bound(offsets.begin(), offsets.end(), row) - offsets.begin()) - 1;
+}
+
+void npy::VirtualArray::check_type(const size_t size) const
+{
+    if (size != word_size)
+        throw std::runtime_error("VirtualArray: word size does not match the requested type");
+}
@@ -0,0 +1,104 @@
+#ifndef NPY_VIRTUAL_H_
+#define NPY_VIRTUAL_H_
+
+#include "npy_manifest.hpp"
+#include "npy_mmap.hpp"
+
+#include <cstring>
+
+namespace npy {
+
+    // One logical 2D array made of many mapped C-order shards stacked along axis 0. Opening maps each shard
+    // and costs O(number of shards); no payload is read until it is accessed.
+    class VirtualArray {
+    public:
+        template<typename T>
+        using RowMat = Eigen::Matrix<T, -1, -1, Eigen::RowMajor>;
+        template<typename T>
+        using RowMap = Eigen::Map<const RowMat<T>>;
+
+        explicit VirtualArray(const Manifest& manifest);
+        VirtualArray(const std::string& folder_name, const std::string& prefix, int start_i, const std::string& suffix);
+
+        [[nodiscard]] size_t rows() const { return n_rows; }
+        [[nodiscard]] size_t num_cols() const { return cols; }
+        [[nodiscard]] size_t num_shards() const { return shards.size(); }
+        [[nodiscard]] const MappedNpy& shard(const size_t i) const { return shards[i]; }
+
+        // Index of the shard holding global row `row` (binary search over shard row offsets)
+        [[nodiscard]] size_t shard_of(size_t row) const;
+        [[nodiscard]] size_t shard_row_offset(const size_t i) const { return offsets[i]; }
+
+        template<typename T>
+        const T* row_ptr(const size_t row) const
+        {
+            check_type(sizeof(T));
+            const size_t s = shard_of(row);
+            return shards[s].data<T>() + (row - offsets[s]) * cols;
+        }
+
+        // Rows [begin, begin + n). Zero-copy view into the mapping when the range stays inside one shard,
+        // otherwise the rows are copied into scratch and the view points there.
+        template<typename T>
+        auto rows(const size_t begin, const size_t n, std::vector<T>& scratch) const -> RowMap<T>
+        {
+            check_type(sizeof(T));
+            if (begin + n > n_rows)
+                throw std::runtime_error("VirtualArray: row range out of bounds");
+            if (n == 0)
+                return RowMap<T>(nullptr, 0, cols);
+
+            size_t s = shard_of(begin);
+            if (begin + n <= offsets[s + 1])
+                return RowMap<T>(shards[s].data<T>() + (begin - offsets[s]) * cols, n, cols);
+
+            scratch.resize(n * cols);
+            size_t done = 0;
+            while (done < n) {
+                const size_t local = begin + done - offsets[s];
+                const size_t take = std::min(n - done, offsets[s + 1] - begin - done);
+                std::memcpy(scratch.data() + done * cols, shards[s].data<T>() + local * cols, take * cols * sizeof(T));
+                done += take;
+                ++s;
+            }
+            return RowMap<T>(scratch.data(), n, cols);
+        }
+
+        // Copy arbitrary rows, in the given order, into a new matrix
+        template<typename T>
+        auto gather(const std::vector<size_t>& indices) const -> RowMat<T>
+        {
+            RowMat<T> out(indices.size(), cols);
+            for (size_t i = 0; i < indices.size(); ++i) {
+                if (indices[i] >= n_rows)
+                    throw std::runtime_error("VirtualArray: row index out of bounds");
+                std::memcpy(out.data() + i * cols, row_ptr<T>(indices[i]), cols * sizeof(T));
+            }
+            return out;
+        }
+
+        // Call f(first_row, block) for consecutive blocks of chunk_rows rows; blocks spanning a shard
+        // boundary are assembled in a reused scratch buffer, all others are zero-copy
+        template<typename T, typename F>
+        void for_each_chunk(const size_t chunk_rows, F&& f) const
+        {
+            if (chunk_rows == 0)
+                throw std::runtime_error("VirtualArray: chunk_rows must be positive");
+            std::vector<T> scratch;
+            for (size_t begin = 0; begin < n_rows; begin += chunk_rows)
+                f(begin, rows<T>(begin, std::min(chunk_rows, n_rows - begin), scratch));
+        }
+
+    private:
+        void check_type(size_t size) const;
+
+        std::vector<MappedNpy> shards;
+        std::vector<size_t> offsets; // shard i covers rows [offsets[i], offsets[i + 1])
+        size_t n_rows = 0;
+        size_t cols = 0;
+        size_t word_size = 0;
+    };
+
+} // namespace npy
+
+#endif
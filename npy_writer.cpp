@@ -0,0 +1,91 @@
+#include "npy_writer.hpp"
+
+npy::NpyStreamWriter::NpyStreamWriter(const std::string& fname, const std::string& descr,
+                                      std::vector<size_t> row_shape) :
+    filename(fname), descr(descr), row_shape(std::move(row_shape))
+{
+    row_size = static_cast<size_t>(atoi(descr.c_str() + 2));
+    for (const size_t s: this->row_shape)
+        row_size *= s;
+
+    fp = fopen(fname.c_str(), "wb");
+    if (!fp)
+        throw std::runtime_error("NpyStreamWriter: Unable to open file " + fname);
+    const std::string h = header();
+    header_size = h.size();
+    if (fwrite(h.data(), 1, h.size(), fp) != h.size()) {
+        fclose(fp);
+        fp = nullptr;
+        throw std::runtime_error("NpyStreamWriter: failed fwrite on " + fname);
+    }
+}
+
+npy::NpyStreamWriter::~NpyStreamWriter()
+{
+    try {
+        close();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+auto npy::NpyStreamWriter::header() const -> std::string
+{
+    std::vector<size_t> shape{n_rows};
+    shape.insert(shape.end(), row_shape.begin(), row_shape.end());
+    return _npy_header(descr, false, shape, growable_header_size);
+}
+
+void npy::NpyStreamWriter::append(const void* data, const size_t n_rows)
+{
+    if (!fp)
+        throw std::runtime_error("NpyStreamWriter: append after close on " + filename);
+    const size_t n_bytes = n_rows * row_size;
+    if (fwrite(data, 1, n_bytes, fp) != n_bytes)
+        throw std::runtime_error("NpyStreamWriter: failed fwrite on " + filename);
+    this->n_rows += n_rows;
+}
+
+void npy::NpyStreamWriter::close()
+{
+    if (!fp)
+        return;
+    FILE* f = fp;
+    fp = nullptr;
+
+    const std::string h = header();
+    const bool ok = h.size() == header_size && fseek(f, 0, SEEK_SET) == 0 &&
+                    fwrite(h.data(), 1, h.size(), f) == h.size();
+    if (fclose(f) != 0 || !ok)
+        throw std::runtime_error("NpyStreamWriter: failed to finalize " + filename);
+}
+
+void npy::OrderedChunkSink::put(const size_t chunk, std::vector<char> bytes, const size_t n_rows)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    advanced.wait(lock, [&] { return aborted || chunk - next < max_ahead; });
+    if (aborted)
+        return;
+    if (chunk != next) {
+        pending.emplace(chunk, std::make_pair(std::move(bytes), n_rows));
+        return;
+    }
+
+    writer.append(bytes.data(), n_rows);
+    ++next;
+    for (auto it = pending.find(next); it != pending.end(); it = pending.find(next)) {
+        writer.append(it->second.first.data(), it->second.second);
+        pending.erase(it);
+        ++next;
+    }
+    advanced.notify_all();
+}
+
+void npy::OrderedChunkSink::abort()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        aborted = true;
+    }
+    advanced.notify_all();
+}
@@ -0,0 +1,80 @@
+#ifndef NPY_WRITER_H_
+#define NPY_WRITER_H_
+
+#include "npy_utils.hpp"
+
+#include <condition_variable>
+#include <mutex>
+
+namespace npy {
+
+    // Append-only writer for C-order arrays whose row count is not known up front. The header is written
+    // with room to spare and its shape is patched with the final row count by close().
+    class NpyStreamWriter {
+    public:
+        // row_shape is the shape of one row: {} for a 1D array, {cols} for a 2D matrix
+        NpyStreamWriter(const std::string& fname, const std::string& descr, std::vector<size_t> row_shape);
+        ~NpyStreamWriter();
+
+        NpyStreamWriter(const NpyStreamWriter&) = delete;
+        NpyStreamWriter& operator=(const NpyStreamWriter&) = delete;
+
+        // Append n_rows rows stored contiguously at data
+        void append(const void* data, size_t n_rows);
+
+        template<typename T>
+        void append(const Eigen::Matrix<T, -1, -1, Eigen::RowMajor>& block)
+        {
+            append(block.data(), static_cast<size_t>(block.rows()));
+        }
+
+        // Patch the header with the final shape and close the file; called by the destructor if needed
+        void close();
+
+        [[nodiscard]] size_t rows() const { return n_rows; }
+        [[nodiscard]] size_t row_bytes() const { return row_size; }
+
+    private:
+        auto header() const -> std::string;
+
+        std::string filename;
+        std::string descr;
+        std::vector<size_t> row_shape;
+        FILE* fp = nullptr;
+        size_t header_size = 0;
+        size_t row_size = 0;
+        size_t n_rows = 0;
+    };
+
+    // Collects chunk outputs that worker threads finish out of order and appends them to a writer in chunk
+    // order, so parallel passes produce the same file as a sequential one. Chunks must be numbered 0, 1, ...
+    // With a finite max_ahead, put() blocks while its chunk is max_ahead or more past the next chunk to be
+    // written, which bounds the buffered outputs. That relies on the next chunk being in progress on another
+    // thread, as with parallel_for's in-order hand-out, and a worker that fails must call abort() so that
+    // blocked threads return.
+    class OrderedChunkSink {
+    public:
+        explicit OrderedChunkSink(NpyStreamWriter& writer, size_t max_ahead = SIZE_MAX) :
+            writer(writer), max_ahead(std::max<size_t>(max_ahead, 1))
+        {
+        }
+
+        // Hand over the n_rows rows of chunk `chunk`; may append it and any chunks waiting behind it
+        void put(size_t chunk, std::vector<char> bytes, size_t n_rows);
+
+        // Release threads blocked in put(); chunks handed over afterwards are dropped
+        void abort();
+
+    private:
+        NpyStreamWriter& writer;
+        size_t max_ahead;
+        std::mutex mutex;
+        std::condition_variable advanced;
+        bool aborted = false;
+        size_t next = 0;
+        std::map<size_t, std::pair<std::vector<char>, size_t>> pending;
+    };
+
+} // namespace npy
+
+#endif
@@ -0,0 +1,65 @@
+#include "npy_chunks.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace npy;
+
+namespace {
+
+    auto save_ramp(const std::string& fname, const Eigen::Index rows, const Eigen::Index cols)
+            -> Eigen::Matrix<double, -1, -1, Eigen::RowMajor>
+    {
+        Eigen::Matrix<double, -1, -1, Eigen::RowMajor> m(rows, cols);
+        for (Eigen::Index i = 0; i < m.size(); ++i)
+            m.data()[i] = static_cast<double>(i);
+        save_mat(fname, m);
+        return m;
+    }
+
+} // namespace
+
+TEST(Chunks, ForEachChunkTakesFileNames)
+{
+    const npy_test::TempDir tmp;
+    const auto m = save_ramp(tmp.file("x.npy"), 1000, 3);
+    // A C string must pick the file name overload, not the generic source template
+    const std::string fname = tmp.file("x.npy");
+    std::atomic<size_t> rows{0};
+    std::atomic<int64_t> sum{0};
+    const auto visit = [&](const size_t offset, const auto& block) {
+        EXPECT_EQ(block(0, 0), m(static_cast<Eigen::Index>(offset), 0));
+        rows += static_cast<size_t>(block.rows());
+        sum += static_cast<int64_t>(block.sum());
+    };
+    for_each_chunk<double>(fname.c_str(), 64, visit, 3);
+    for_each_chunk<double>(fname, 64, visit, 3);
+    EXPECT_EQ(rows, 2000u);
+    EXPECT_EQ(sum, 2 * static_cast<int64_t>(m.sum()));
+}
+
+TEST(Chunks, MapReduceFoldsInChunkOrder)
+{
+    const npy_test::TempDir tmp;
+    save_ramp(tmp.file("y.npy"), 777, 2);
+    const auto first_rows = [](const MappedNpy& src, const size_t n_threads) {
+        return map_reduce_chunks<double>(
+                src, 10, [](const size_t offset, const auto&) { return std::vector<size_t>{offset}; },
+                [](std::vector<size_t> acc, std::vector<size_t> r) {
+                    acc.insert(acc.end(), r.begin(), r.end());
+                    return acc;
+                },
+                std::vector<size_t>(), n_threads);
+    };
+    std::vector<size_t> expected;
+    for (size_t r = 0; r < 777; r += 10)
+        expected.push_back(r);
+    const MappedNpy src(tmp.file("y.npy"));
+    EXPECT_EQ(first_rows(src, 1), expected);
+    EXPECT_EQ(first_rows(src, 4), expected);
+
+    const double total = map_reduce_chunks<double>(
+            tmp.file("y.npy").c_str(), 100, [](size_t, const auto& block) { return block.sum(); },
+            [](const double a, const double b) { return a + b; }, 0.0, 3);
+    EXPECT_EQ(total, 777.0 * 2 * (777 * 2 - 1) / 2);
+}
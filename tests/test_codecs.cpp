@@ -0,0 +1,273 @@
+#include "npy_bitpack.hpp"
+#include "npy_lossy.hpp"
+#include "npy_timeseries.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace npy;
+
+// Shapes are chosen so that the last lossy tile / cube, time-series block and bit-packed block are partial
+
+TEST(Lossy, HuffmanRoundTrip)
+{
+    // Geometric symbol counts give codes well past the decoder's lookup table, next to single-symbol,
+    // two-symbol and empty streams
+    std::mt19937_64 rng(9);
+    std::geometric_distribution<int> geo(0.05);
+    std::vector<std::vector<uint16_t>> streams(4);
+    for (int i = 0; i < 20000; ++i)
+        streams[0].push_back(static_cast<uint16_t>(lossy_radius + (rng() & 1 ? geo(rng) : -geo(rng))));
+    streams[0].push_back(0);
+    streams[0].push_back(65535);
+    streams[1].assign(1000, 42);
+    for (int i = 0; i < 999; ++i)
+        streams[2].push_back(static_cast<uint16_t>(i % 3 == 0));
+
+    std::vector<char> bytes;
+    for (const auto& s: streams)
+        _huffman_encode(s, bytes);
+    const char* p = bytes.data();
+    for (const auto& s: streams) {
+        std::vector<uint16_t> d(s.size());
+        _huffman_decode(p, bytes.data() + bytes.size(), d.size(), d.data());
+        EXPECT_EQ(d, s);
+    }
+    EXPECT_EQ(p, bytes.data() + bytes.size());
+
+    // Asking for more symbols than were encoded runs past the stream
+    p = bytes.data();
+    std::vector<uint16_t> d(streams[0].size() + 100);
+    EXPECT_THROW(_huffman_decode(p, bytes.data() + bytes.size(), d.size(), d.data()), std::runtime_error);
+}
+
+TEST(Lossy, Matrix2DWithinBound)
+{
+    const npy_test::TempDir tmp;
+    const Eigen::Index rows = 150, cols = 97;
+    Eigen::Matrix<double, -1, -1, Eigen::RowMajor> m(rows, cols);
+    for (Eigen::Index i = 0; i < rows; ++i)
+        for (Eigen::Index j = 0; j < cols; ++j)
+            m(i, j) = std::sin(0.05 * i) * std::cos(0.03 * j) + 1e-3 * ((i * 31 + j * 17) % 7);
+    m(3, 5) = std::numeric_limits<double>::quiet_NaN();
+    m(140, 96) = std::numeric_limits<double>::infinity();
+    m(70, 70) = 1e12;
+
+    LossyOptions opt;
+    opt.error_bound = 1e-4;
+    opt.n_threads = 3;
+    save_lossy(tmp.file("m.lossy"), m, opt);
+
+    const auto r = load_lossy_mat<double>(tmp.file("m.lossy"), 2);
+    ASSERT_EQ(r.rows(), rows);
+    ASSERT_EQ(r.cols(), cols);
+    for (Eigen::Index i = 0; i < rows; ++i)
+        for (Eigen::Index j = 0; j < cols; ++j) {
+            if (std::isnan(m(i, j)))
+                EXPECT_TRUE(std::isnan(r(i, j)));
+            else if (std::isinf(m(i, j)))
+                EXPECT_EQ(r(i, j), m(i, j));
+            else
+                EXPECT_LE(std::abs(r(i, j) - m(i, j)), opt.error_bound) << i << "," << j;
+        }
+
+    // A sub-matrix straddling tile boundaries decodes to the same values as the full read
+    const auto b = load_lossy_block<double>(tmp.file("m.lossy"), 60, 30, 90, 67);
+    EXPECT_TRUE(b.cwiseEqual(r.block(60, 30, 90, 67)).all());
+}
+
+TEST(Lossy, Volume3DAndSignal1D)
+{
+    const npy_test::TempDir tmp;
+    const std::vector<size_t> shape{19, 23, 35};
+    std::vector<float> vol(shape[0] * shape[1] * shape[2]);
+    for (size_t i = 0; i < vol.size(); ++i)
+        vol[i] = static_cast<float>(std::sin(0.001 * static_cast<double>(i)) * 100);
+    LossyOptions opt;
+    opt.error_bound = 1e-2;
+    save_lossy(tmp.file("v.lossy"), vol.data(), shape, opt);
+
+    const LossyReader reader(tmp.file("v.lossy"));
+    EXPECT_EQ(reader.shape(), shape);
+    const auto all = reader.read_all<float>(2);
+    ASSERT_EQ(all.size(), vol.size());
+    for (size_t i = 0; i < vol.size(); ++i)
+        EXPECT_LE(std::abs(static_cast<double>(all[i]) - vol[i]), opt.error_bound) << i;
+
+    std::vector<float> part(4 * 10 * 20);
+    reader.read_region<float>({15, 13, 15}, {4, 10, 20}, part.data());
+    for (size_t i = 0; i < 4; ++i)
+        for (size_t j = 0; j < 10; ++j)
+            for (size_t k = 0; k < 20; ++k)
+                EXPECT_EQ(part[(i * 10 + j) * 20 + k], all[((15 + i) * shape[1] + 13 + j) * shape[2] + 15 + k]);
+
+    std::mt19937_64 rng(7);
+    std::normal_distribution<double> noise;
+    std::vector<double> sig(5000);
+    for (double& v: sig)
+        v = noise(rng);
+    opt.error_bound = 1e-3;
+    save_lossy(tmp.file("s.lossy"), sig.data(), {sig.size()}, opt);
+    const auto s = LossyReader(tmp.file("s.lossy")).read_all<double>();
+    ASSERT_EQ(s.size(), sig.size());
+    for (size_t i = 0; i < sig.size(); ++i)
+        EXPECT_LE(std::abs(s[i] - sig[i]), opt.error_bound) << i;
+}
+
+TEST(Lossy, RejectsWrongType)
+{
+    const npy_test::TempDir tmp;
+    const std::vector<double> x(100, 1.0);
+    save_lossy(tmp.file("x.lossy"), x.data(), {x.size()});
+    EXPECT_THROW(LossyReader(tmp.file("x.lossy")).read_all<float>(), std::runtime_error);
+}
+
+TEST(TimeSeries, Int64DeltaOfDelta)
+{
+    const npy_test::TempDir tmp;
+    const Eigen::Index rows = 10007;
+    Eigen::Matrix<int64_t, -1, -1> m(rows, 3);
+    std::mt19937_64 rng(1);
+    int64_t t = 1600000000000000000;
+    for (Eigen::Index i = 0; i < rows; ++i) {
+        // Regular steps with jitter, occasional gaps in every delta-of-delta bucket, and wide random values
+        t += 1000 + static_cast<int64_t>(rng() % 5) - 2;
+        if (i % 997 == 0)
+            t += static_cast<int64_t>(rng() % (int64_t{1} << (i % 40)));
+        m(i, 0) = t;
+        m(i, 1) = i / 100;
+        m(i, 2) = static_cast<int64_t>(rng());
+    }
+    m(rows - 1, 2) = std::numeric_limits<int64_t>::min();
+    m(rows - 2, 2) = std::numeric_limits<int64_t>::max();
+
+    TimeSeriesOptions opt;
+    opt.block_rows = 1000;
+    opt.n_threads = 2;
+    save_timeseries(tmp.file("i.gor"), m, opt);
+
+    const TimeSeriesReader reader(tmp.file("i.gor"));
+    ASSERT_EQ(reader.rows(), static_cast<size_t>(rows));
+    ASSERT_EQ(reader.cols(), 3u);
+    EXPECT_TRUE(reader.read_all<int64_t>(2).cwiseEqual(m).all());
+    EXPECT_TRUE(reader.read_rows<int64_t>(1995, 8012).cwiseEqual(m.middleRows(1995, 8012)).all());
+    EXPECT_THROW(reader.read_all<double>(), std::runtime_error);
+
+    const int64_t t0 = m(4321, 0);
+    EXPECT_EQ(reader.lower_bound(0, t0), 4321u);
+    EXPECT_EQ(reader.lower_bound(0, m(rows - 1, 0) + 1), static_cast<size_t>(rows));
+    const auto range = reader.read_time_range<int64_t>(0, t0, m(5000, 0));
+    EXPECT_EQ(range.rows(), 5000 - 4321);
+}
+
+TEST(TimeSeries, FloatXor)
+{
+    const npy_test::TempDir tmp;
+    const Eigen::Index rows = 4099;
+    Eigen::Matrix<double, -1, -1, Eigen::RowMajor> d(rows, 4);
+    Eigen::Matrix<float, -1, -1> f(rows, 2);
+    std::mt19937_64 rng(3);
+    std::uniform_real_distribution<double> u(-1e6, 1e6);
+    for (Eigen::Index i = 0; i < rows; ++i) {
+        d(i, 0) = 20.0 + 0.25 * static_cast<double>(i / 50); // long runs of repeats
+        d(i, 1) = std::sin(0.01 * static_cast<double>(i));
+        d(i, 2) = u(rng);
+        d(i, 3) = i % 11 == 0 ? std::numeric_limits<double>::quiet_NaN() : -0.0;
+        f(i, 0) = static_cast<float>(u(rng));
+        f(i, 1) = static_cast<float>(i % 3);
+    }
+
+    TimeSeriesOptions opt;
+    opt.block_rows = 512;
+    save_timeseries(tmp.file("d.gor"), d, opt);
+    save_timeseries(tmp.file("f.gor"), f, opt);
+
+    // Compare bit patterns so NaN and -0.0 must survive exactly
+    const auto rd = TimeSeriesReader(tmp.file("d.gor")).read_all<double>(2);
+    ASSERT_EQ(rd.rows(), rows);
+    for (Eigen::Index i = 0; i < rows; ++i)
+        for (Eigen::Index j = 0; j < 4; ++j)
+            EXPECT_EQ(std::memcmp(&rd(i, j), &d(i, j), sizeof(double)), 0) << i << "," << j;
+    const auto rf = TimeSeriesReader(tmp.file("f.gor")).read_all<float>();
+    EXPECT_TRUE(rf.cwiseEqual(f).all());
+}
+
+// A constant column makes the delta-of-delta stream a single run that ends exactly at the last word of the
+// file; the decoder must not look past it. The reader's mapping is placed right before an inaccessible page
+// so that any read beyond the stream faults.
+TEST(TimeSeries, ConstantColumnEndsAtFileEnd)
+{
+    const npy_test::TempDir tmp;
+    Eigen::Matrix<int64_t, -1, -1> m(65, 339);
+    m.setConstant(42);
+    TimeSeriesOptions opt;
+    opt.block_rows = 65;
+    save_timeseries(tmp.file("c.gor"), m, opt);
+    struct stat st {};
+    ASSERT_EQ(stat(tmp.file("c.gor").c_str(), &st), 0);
+    ASSERT_EQ(st.st_size, 8192);
+
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    void* hole = mmap(nullptr, 8192 + page, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(hole, MAP_FAILED);
+    munmap(hole, 8192);
+    const TimeSeriesReader reader(tmp.file("c.gor"));
+    EXPECT_TRUE(reader.read_all<int64_t>().cwiseEqual(m).all());
+    munmap(static_cast<char*>(hole) + 8192, page);
+}
+
+TEST(BitPack, EveryWidthWithPartialBlocks)
+{
+    const npy_test::TempDir tmp;
+    std::mt19937_64 rng(5);
+    for (unsigned w = 0; w <= 64; ++w) {
+        // 1000 values in blocks of 128: the last block holds 104 values, so its last group of 64 is partial
+        std::vector<int64_t> x(1000);
+        const int64_t base = static_cast<int64_t>(rng());
+        for (auto& v: x)
+            v = static_cast<int64_t>(static_cast<uint64_t>(base) + (w == 64 ? rng() : w == 0 ? 0 : rng() >> (64 - w)));
+        BitPackOptions opt;
+        opt.block_len = 128;
+        save_bitpacked(tmp.file("w.bp"), x.data(), {x.size()}, false, opt);
+
+        const BitPackedReader reader(tmp.file("w.bp"));
+        ASSERT_EQ(reader.num_vals(), x.size());
+        std::vector<int64_t> r(x.size());
+        reader.read_range(0, r.size(), r.data(), 2);
+        EXPECT_EQ(r, x) << "width " << w;
+        std::vector<int64_t> part(300);
+        reader.read_range(77, part.size(), part.data());
+        EXPECT_TRUE(std::equal(part.begin(), part.end(), x.begin() + 77)) << "width " << w;
+        EXPECT_EQ(reader.at<int64_t>(999), x[999]);
+    }
+}
+
+TEST(BitPack, SmallTypesAndMatrices)
+{
+    const npy_test::TempDir tmp;
+    std::vector<int16_t> s(3001);
+    for (size_t i = 0; i < s.size(); ++i)
+        s[i] = static_cast<int16_t>(static_cast<int>(i * 37 % 2000) - 1000);
+    save_bitpacked(tmp.file("s.bp"), s.data(), {s.size()});
+    const BitPackedReader rs(tmp.file("s.bp"));
+    std::vector<int16_t> r(s.size());
+    rs.read_range(0, r.size(), r.data());
+    EXPECT_EQ(r, s);
+    EXPECT_THROW(rs.at<int32_t>(0), std::runtime_error);
+
+    Eigen::Matrix<uint8_t, -1, -1> c(33, 71);
+    for (Eigen::Index i = 0; i < c.size(); ++i)
+        c.data()[i] = static_cast<uint8_t>(i * 13);
+    save_bitpacked(tmp.file("c.bp"), c);
+    const BitPackedReader rc(tmp.file("c.bp"));
+    EXPECT_TRUE(rc.fortran_order());
+    EXPECT_TRUE((rc.load_mat<uint8_t, Eigen::ColMajor>(2).array() == c.array()).all());
+    EXPECT_TRUE((rc.load_mat<uint8_t, Eigen::RowMajor>().array() == c.array()).all());
+}
@@ -0,0 +1,85 @@
+#include "npy_concurrent.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <sys/wait.h>
+
+using namespace npy;
+
+TEST(ConcurrentAppender, ProcessesAppendWholeBlocks)
+{
+    const npy_test::TempDir tmp;
+    const std::string file = tmp.file("c.npy");
+    concurrent_create<double>(file, 3);
+
+    const int n_procs = 4, n_appends = 50;
+    for (int k = 0; k < n_procs; ++k) {
+        const pid_t pid = fork();
+        ASSERT_GE(pid, 0);
+        if (pid == 0) {
+            int status = 0;
+            try {
+                ConcurrentAppender a(file);
+                for (int j = 0; j < n_appends; ++j) {
+                    Eigen::Matrix<double, -1, -1, Eigen::RowMajor> block(k + 1, 3);
+                    block.setConstant(k);
+                    a.append(block);
+                }
+            } catch (...) {
+                status = 1;
+            }
+            _exit(status);
+        }
+    }
+    for (int k = 0; k < n_procs; ++k) {
+        int status = 0;
+        ASSERT_GT(wait(&status), 0);
+        ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    const size_t expected = n_appends * (1 + 2 + 3 + 4);
+    EXPECT_EQ(concurrent_finalize(file), expected);
+    const auto m = load_npy_mat<double>(file);
+    ASSERT_EQ(static_cast<size_t>(m.rows()), expected);
+    ASSERT_EQ(m.cols(), 3);
+
+    // Blocks never interleave: every run of equal values has a length that is a multiple of its block size
+    std::vector<int> rows_of(n_procs, 0);
+    for (Eigen::Index i = 0; i < m.rows();) {
+        const int k = static_cast<int>(m(i, 0));
+        ASSERT_GE(k, 0);
+        ASSERT_LT(k, n_procs);
+        EXPECT_TRUE((m.row(i).array() == k).all());
+        Eigen::Index j = i;
+        while (j < m.rows() && m(j, 0) == k)
+            ++j;
+        EXPECT_EQ((j - i) % (k + 1), 0) << "row " << i;
+        rows_of[static_cast<size_t>(k)] += static_cast<int>(j - i);
+        i = j;
+    }
+    for (int k = 0; k < n_procs; ++k)
+        EXPECT_EQ(rows_of[static_cast<size_t>(k)], n_appends * (k + 1));
+}
+
+TEST(ConcurrentAppender, RangesAreWrittenOnce)
+{
+    const npy_test::TempDir tmp;
+    const std::string file = tmp.file("r.npy");
+    concurrent_create<double>(file, 3);
+    ConcurrentAppender a(file);
+    const double rows[6] = {1, 2, 3, 4, 5, 6};
+    const size_t start = a.reserve(2);
+
+    EXPECT_THROW(a.write_rows(start + 1, rows, 1), std::runtime_error);
+    EXPECT_THROW(a.write_rows(start, rows, 1), std::runtime_error);
+    EXPECT_THROW(concurrent_finalize(file), std::runtime_error);
+    a.write_rows(start, rows, 2);
+    EXPECT_THROW(a.write_rows(start, rows, 2), std::runtime_error);
+    EXPECT_THROW(a.append(reinterpret_cast<const float*>(rows), 1), std::runtime_error);
+
+    EXPECT_EQ(concurrent_finalize(file), 2u);
+    const auto m = load_npy_mat<double>(file);
+    ASSERT_EQ(m.rows(), 2);
+    EXPECT_EQ(m(1, 2), 6);
+}
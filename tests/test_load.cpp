@@ -0,0 +1,59 @@
+#include "npy_utils.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace npy;
+
+TEST(LoadNpyMat, EitherOrderFromEitherFile)
+{
+    const npy_test::TempDir tmp;
+    Eigen::Matrix<float, -1, -1, Eigen::RowMajor> c(5, 7);
+    for (Eigen::Index i = 0; i < c.size(); ++i)
+        c.data()[i] = static_cast<float>(i);
+    const Eigen::Matrix<float, -1, -1, Eigen::ColMajor> f = c;
+    save_mat(tmp.file("c.npy"), c);
+    save_mat(tmp.file("f.npy"), f);
+
+    for (const char* name: {"c.npy", "f.npy"}) {
+        EXPECT_TRUE(load_npy_mat<float>(tmp.file(name)).cwiseEqual(c).all()) << name;
+        EXPECT_TRUE((load_npy_mat<float, Eigen::ColMajor>(tmp.file(name)).cwiseEqual(f).all())) << name;
+    }
+    bool native_col_major = false;
+    load_npy_mat_native<float>(tmp.file("f.npy"), [&](const auto& m) {
+        native_col_major = !std::decay_t<decltype(m)>::IsRowMajor;
+        EXPECT_TRUE(m.cwiseEqual(c).all());
+    });
+    EXPECT_TRUE(native_col_major);
+}
+
+TEST(LoadNpyMat, RejectsOtherTypesOfTheSameSize)
+{
+    const npy_test::TempDir tmp;
+    const Eigen::Matrix<int32_t, -1, -1, Eigen::RowMajor> m = Eigen::Matrix<int32_t, -1, -1, Eigen::RowMajor>::Ones(3, 2);
+    save_mat(tmp.file("i.npy"), m);
+    EXPECT_THROW(load_npy_mat<float>(tmp.file("i.npy")), std::runtime_error);
+    EXPECT_THROW(load_npy_mat<uint32_t>(tmp.file("i.npy")), std::runtime_error);
+    EXPECT_THROW(load_npy_mat<double>(tmp.file("i.npy")), std::runtime_error);
+    EXPECT_TRUE(load_npy_mat<int32_t>(tmp.file("i.npy")).cwiseEqual(m).all());
+}
+
+TEST(FolderToMat, ReadsThroughTheManifestWhenPresent)
+{
+    const npy_test::TempDir tmp;
+    Eigen::Matrix<double, -1, -1, Eigen::RowMajor> all(12, 3);
+    for (Eigen::Index i = 0; i < all.size(); ++i)
+        all.data()[i] = static_cast<double>(i);
+    for (int k = 0; k < 3; ++k)
+        save_mat(tmp.file("part" + std::to_string(k) + ".npy"),
+                 Eigen::Matrix<double, -1, -1, Eigen::RowMajor>(all.middleRows(4 * k, 4)));
+    const auto scanned = npy_folder2mat<double, Eigen::RowMajor>(tmp.path(), "part", 0, ".npy");
+    EXPECT_TRUE(scanned.cwiseEqual(all).all());
+
+    // The manifest lists the first two shards only, so a loader that follows it stops there
+    Manifest manifest = build_manifest(tmp.path(), "part", 0, ".npy");
+    manifest.shards.pop_back();
+    save_manifest(manifest, manifest_path(tmp.path(), "part", ".npy"));
+    const auto listed = npy_folder2mat<double, Eigen::RowMajor>(tmp.path(), "part", 0, ".npy");
+    EXPECT_TRUE(listed.cwiseEqual(all.topRows(8)).all());
+}
@@ -0,0 +1,65 @@
+#include "npy_sparse.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+using namespace npy;
+
+namespace {
+
+    // Pull-form adjacency of a random graph with small integer weights and a few dangling nodes
+    auto random_graph(const Eigen::Index n) -> Eigen::Matrix<double, -1, -1, Eigen::RowMajor>
+    {
+        std::mt19937_64 rng(17);
+        Eigen::Matrix<double, -1, -1, Eigen::RowMajor> m = Eigen::Matrix<double, -1, -1, Eigen::RowMajor>::Zero(n, n);
+        for (Eigen::Index j = 0; j < n; ++j) {
+            if (j % 10 == 3)
+                continue;
+            for (int e = 0; e < 5; ++e)
+                m(static_cast<Eigen::Index>(rng() % static_cast<uint64_t>(n)), j) = static_cast<double>(1 + rng() % 4);
+        }
+        return m;
+    }
+
+} // namespace
+
+TEST(Sparse, PageRankAcceptsAnyValueType)
+{
+    const npy_test::TempDir tmp;
+    const auto m = random_graph(300);
+    save_csr_npz(tmp.file("f8.npz"), m);
+    save_csr_npz(tmp.file("f4.npz"), Eigen::Matrix<float, -1, -1, Eigen::RowMajor>(m.cast<float>()));
+    save_csr_npz(tmp.file("i4.npz"), Eigen::Matrix<int32_t, -1, -1, Eigen::RowMajor>(m.cast<int32_t>()));
+
+    PageRankOptions opt;
+    opt.n_threads = 3;
+    opt.tol = 1e-13;
+    opt.max_iter = 500;
+    const Eigen::VectorXd ref = pagerank(MappedCsr(tmp.file("f8.npz")), opt);
+    ASSERT_EQ(ref.size(), 300);
+    EXPECT_NEAR(ref.sum(), 1.0, 1e-9);
+
+    // Dense power iteration on the same matrix
+    const Eigen::VectorXd out = m.colwise().sum().transpose();
+    Eigen::VectorXd rank = Eigen::VectorXd::Constant(300, 1.0 / 300);
+    for (int it = 0; it < 200; ++it) {
+        Eigen::VectorXd scaled = rank;
+        double lost = 0;
+        for (Eigen::Index j = 0; j < 300; ++j) {
+            if (out[j] == 0) {
+                lost += rank[j];
+                scaled[j] = 0;
+            } else {
+                scaled[j] /= out[j];
+            }
+        }
+        rank = (opt.damping * ((m * scaled).array() + lost / 300) + (1 - opt.damping) / 300).matrix();
+    }
+    EXPECT_LT((ref - rank).lpNorm<Eigen::Infinity>(), 1e-9);
+
+    // Integer weights are exact in float and int32, so every value type gives the same ranks
+    for (const char* name: {"f4.npz", "i4.npz"})
+        EXPECT_LT((pagerank(MappedCsr(tmp.file(name)), opt) - ref).lpNorm<Eigen::Infinity>(), 1e-12) << name;
+}
@@ -0,0 +1,133 @@
+#include "npy_dedup.hpp"
+#include "npy_groupby.hpp"
+#include "npy_join.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <set>
+
+using namespace npy;
+
+// Every operation is run once in memory and once with a tiny memory_budget that forces the spilling path;
+// both must produce the same rows (up to the documented row order).
+
+namespace {
+
+    template<typename T>
+    auto sorted_rows(const Eigen::Matrix<T, -1, -1, Eigen::RowMajor>& m) -> std::vector<std::vector<T>>
+    {
+        std::vector<std::vector<T>> rows(static_cast<size_t>(m.rows()));
+        for (Eigen::Index i = 0; i < m.rows(); ++i)
+            rows[static_cast<size_t>(i)].assign(m.row(i).data(), m.row(i).data() + m.cols());
+        std::sort(rows.begin(), rows.end());
+        return rows;
+    }
+
+    void save_tables(const npy_test::TempDir& tmp)
+    {
+        std::mt19937_64 rng(11);
+        Eigen::Matrix<int64_t, -1, -1, Eigen::RowMajor> left(3000, 3), right(2000, 2);
+        for (Eigen::Index i = 0; i < left.rows(); ++i)
+            left.row(i) << static_cast<int64_t>(rng() % 700), i, -i;
+        // Key 5 is hot on the right, so its partition cannot be split below the budget
+        for (Eigen::Index i = 0; i < right.rows(); ++i)
+            right.row(i) << (i % 7 == 0 ? 5 : static_cast<int64_t>(rng() % 900)), 10 * i;
+        save_mat(tmp.file("left.npy"), left);
+        save_mat(tmp.file("right.npy"), right);
+    }
+
+} // namespace
+
+TEST(Spill, HashJoinMatchesInMemory)
+{
+    const npy_test::TempDir tmp;
+    save_tables(tmp);
+    for (const JoinType type: {JoinType::Inner, JoinType::Left}) {
+        JoinOptions opt;
+        opt.type = type;
+        opt.fill = -1;
+        opt.n_threads = 3;
+        opt.chunk_rows = 256;
+        const size_t n_mem = hash_join<int64_t>(tmp.file("left.npy"), 0, tmp.file("right.npy"), 0,
+                                                tmp.file("mem.npy"), opt);
+        ASSERT_GT(n_mem, 0u);
+        const auto mem = sorted_rows(load_npy_mat<int64_t>(tmp.file("mem.npy")));
+        opt.partitions = 4;
+        opt.spill_dir = tmp.path();
+        // At 16 KiB only the hot key's partition is re-split, down to the last level; at 1 KiB the partition
+        // count is capped at 256 and most partitions are re-split as well
+        for (const size_t budget: {size_t{16} << 10, size_t{1} << 10}) {
+            opt.memory_budget = budget;
+            for (const char* name: {"s1.npy", "s2.npy"})
+                ASSERT_EQ(hash_join<int64_t>(tmp.file("left.npy"), 0, tmp.file("right.npy"), 0, tmp.file(name), opt),
+                          n_mem);
+            // Repeated runs with the same settings write the same rows in the same order
+            const auto s1 = load_npy_mat<int64_t>(tmp.file("s1.npy"));
+            EXPECT_TRUE(s1.cwiseEqual(load_npy_mat<int64_t>(tmp.file("s2.npy"))).all());
+            EXPECT_EQ(mem, sorted_rows(s1));
+        }
+    }
+}
+
+TEST(Spill, GroupByMatchesInMemory)
+{
+    const npy_test::TempDir tmp;
+    const Eigen::Index n = 50000;
+    Eigen::Matrix<double, -1, -1, Eigen::RowMajor> m(n, 3);
+    for (Eigen::Index i = 0; i < n; ++i)
+        m.row(i) << static_cast<double>(i * 7919 % 5003), static_cast<double>(i % 13), static_cast<double>(i);
+    save_mat(tmp.file("g.npy"), m);
+
+    const std::vector<Agg> aggs{Agg::Count, Agg::Sum, Agg::Mean, Agg::Min, Agg::Max};
+    GroupByOptions opt;
+    opt.n_threads = 3;
+    opt.chunk_rows = 1024;
+    opt.spill_dir = tmp.path();
+    const size_t n_mem = group_by<double>(tmp.file("g.npy"), 0, aggs, tmp.file("mem.npy"), opt);
+    EXPECT_EQ(n_mem, 5003u);
+    // Small enough that partitions are re-split at the next hash level as well
+    opt.memory_budget = 64 << 10;
+    opt.partitions = 4;
+    const size_t n_spill = group_by<double>(tmp.file("g.npy"), 0, aggs, tmp.file("spill.npy"), opt);
+    ASSERT_EQ(n_mem, n_spill);
+
+    // Value columns hold small integers, so every aggregate is exact whatever the summation order
+    const auto mem = load_npy_mat<double>(tmp.file("mem.npy"));
+    EXPECT_EQ(mem.cols(), 1 + 2 * 5);
+    EXPECT_EQ(sorted_rows(mem), sorted_rows(load_npy_mat<double>(tmp.file("spill.npy"))));
+}
+
+TEST(Spill, DedupMatchesInMemory)
+{
+    const npy_test::TempDir tmp;
+    std::mt19937_64 rng(13);
+    Eigen::Matrix<int32_t, -1, -1, Eigen::RowMajor> m(20000, 3);
+    for (Eigen::Index i = 0; i < m.rows(); ++i)
+        m.row(i) << static_cast<int32_t>(rng() % 40), static_cast<int32_t>(rng() % 50), 7;
+    save_mat(tmp.file("d.npy"), m);
+
+    std::set<std::vector<int32_t>> seen;
+    std::vector<std::vector<int32_t>> expected;
+    for (Eigen::Index i = 0; i < m.rows(); ++i) {
+        std::vector<int32_t> row(m.row(i).data(), m.row(i).data() + m.cols());
+        if (seen.insert(row).second)
+            expected.push_back(row);
+    }
+
+    for (const size_t budget: {size_t{1} << 30, size_t{64} << 10, size_t{1}}) {
+        DedupOptions opt;
+        opt.memory_budget = budget;
+        opt.spill_dir = tmp.path();
+        opt.chunk_rows = 1000;
+        opt.n_threads = 3;
+        EXPECT_EQ(count_unique_rows(tmp.file("d.npy"), opt), expected.size());
+        ASSERT_EQ(drop_duplicate_rows(tmp.file("d.npy"), tmp.file("u.npy"), opt), expected.size());
+        const auto u = load_npy_mat<int32_t>(tmp.file("u.npy"));
+        ASSERT_EQ(static_cast<size_t>(u.rows()), expected.size());
+        for (Eigen::Index i = 0; i < u.rows(); ++i)
+            EXPECT_EQ(std::vector<int32_t>(u.row(i).data(), u.row(i).data() + u.cols()),
+                      expected[static_cast<size_t>(i)]);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef NPY_TEST_UTIL_H_
+#define NPY_TEST_UTIL_H_
+
+#include <ftw.h>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+namespace npy_test {
+
+    // Fresh directory under /tmp for the files of one test, removed with its contents on destruction
+    class TempDir {
+    public:
+        TempDir()
+        {
+            char tmpl[] = "/tmp/npy_test_XXXXXX";
+            if (!mkdtemp(tmpl))
+                throw std::runtime_error("TempDir: mkdtemp failed");
+            dir = tmpl;
+        }
+
+        ~TempDir()
+        {
+            nftw(
+                    dir.c_str(), [](const char* p, const struct stat*, int, struct FTW*) { return ::remove(p); }, 16,
+                    FTW_DEPTH | FTW_PHYS);
+        }
+
+        TempDir(const TempDir&) = delete;
+        TempDir& operator=(const TempDir&) = delete;
+
+        [[nodiscard]] const std::string& path() const { return dir; }
+        [[nodiscard]] std::string file(const std::string& name) const { return dir + "/" + name; }
+
+    private:
+        std::string dir;
+    };
+
+} // namespace npy_test
+
+#endif
@@ -0,0 +1,64 @@
+#include "npy_parallel.hpp"
+#include "npy_writer.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstring>
+
+using namespace npy;
+
+namespace {
+
+    // Chunk c holds c % 5 rows of the value c; odd chunks take longer so later chunks finish first
+    void put_chunk(OrderedChunkSink& sink, const size_t c)
+    {
+        if (c % 2)
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        const std::vector<int64_t> rows(c % 5, static_cast<int64_t>(c));
+        std::vector<char> bytes(rows.size() * sizeof(int64_t));
+        std::memcpy(bytes.data(), rows.data(), bytes.size());
+        sink.put(c, std::move(bytes), rows.size());
+    }
+
+} // namespace
+
+TEST(OrderedChunkSink, BoundedRunAheadKeepsChunkOrder)
+{
+    const npy_test::TempDir tmp;
+    for (const size_t max_ahead: {size_t{1}, size_t{3}, SIZE_MAX}) {
+        {
+            NpyStreamWriter writer(tmp.file("o.npy"), "<i8", {});
+            OrderedChunkSink sink(writer, max_ahead);
+            parallel_for(300, 4, [&](const size_t c) { put_chunk(sink, c); });
+        }
+        const NpyArray arr = npy_load(tmp.file("o.npy"));
+        const auto* v = arr.data<int64_t>();
+        std::vector<int64_t> expected;
+        for (size_t c = 0; c < 300; ++c)
+            expected.insert(expected.end(), c % 5, static_cast<int64_t>(c));
+        ASSERT_EQ(arr.num_vals, expected.size());
+        EXPECT_TRUE(std::equal(expected.begin(), expected.end(), v)) << "max_ahead " << max_ahead;
+    }
+}
+
+TEST(OrderedChunkSink, AbortReleasesBlockedWorkers)
+{
+    const npy_test::TempDir tmp;
+    NpyStreamWriter writer(tmp.file("a.npy"), "<i8", {});
+    OrderedChunkSink sink(writer, 2);
+    EXPECT_THROW(parallel_for(100, 4,
+                              [&](const size_t c) {
+                                  try {
+                                      if (c == 10)
+                                          throw std::runtime_error("chunk failed");
+                                      put_chunk(sink, c);
+                                  } catch (...) {
+                                      sink.abort();
+                                      throw;
+                                  }
+                              }),
+                 std::runtime_error);
+    EXPECT_LE(writer.rows(), size_t{2 * 10});
+}